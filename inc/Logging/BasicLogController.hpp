@@ -1,11 +1,27 @@
 #ifndef __LOGGING_BASICLOGGER_HPP__
 #define __LOGGING_BASICLOGGER_HPP__
 
+// Statements below this level compile to nothing in SPDLOG_LOGGER_* / LOGGING_*_RATE_LIMITED.
+// Override per target, e.g. -DSPDLOG_ACTIVE_LEVEL=SPDLOG_LEVEL_TRACE for debug builds. Must be
+// set before spdlog is first included.
+#ifndef SPDLOG_ACTIVE_LEVEL
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <spdlog/async.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/callback_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <string>
 
 // Usage:
 //
@@ -13,27 +29,155 @@
 // std::unique_ptr<Test::Logging::BasicLogController> logger{
 //      std::make_unique<Test::Logging::BasicLogController>("logger", "log.txt")
 // };
+// logger->set_callback( []( const std::string &payload ) { ... } ); // optional, before logging
+//
+// Hot path (async mode, at most 10 lines per second from this call site):
+//
+// Logging::BasicLogController log( "loopback", "log.txt", Logging::BasicLogController::Async{} );
+// LOGGING_WARN_RATE_LIMITED( log.logger(), 10, "queue full, dropped {}", n );
 
 namespace Logging {
 
+//! @brief Lets through at most `per_second` events per one-second window.
+//
+// One instance per call site (the LOGGING_*_RATE_LIMITED macros keep a function-local static).
+// allow() is a coarse clock read (vDSO, no syscall) plus one relaxed atomic increment; suppressed
+// events are only counted.
+//
+class RateLimiter
+{
+public:
+  explicit RateLimiter( uint32_t per_second )
+      : m_per_second( per_second )
+  {
+  }
+
+  bool allow()
+  {
+    int64_t now = now_ns();
+    int64_t window = m_window.load( std::memory_order_relaxed );
+    if ( now - window >= WINDOW &&
+         m_window.compare_exchange_strong( window, now, std::memory_order_relaxed ) )
+      m_count.store( 0, std::memory_order_relaxed );
+    if ( m_count.fetch_add( 1, std::memory_order_relaxed ) < m_per_second ) return true;
+    m_suppressed.fetch_add( 1, std::memory_order_relaxed );
+    return false;
+  }
+
+  uint64_t suppressed() const { return m_suppressed.load( std::memory_order_relaxed ); }
+
+private:
+  static constexpr int64_t WINDOW = 1000000000; // ns
+
+  static int64_t now_ns()
+  {
+#ifdef CLOCK_MONOTONIC_COARSE
+    struct timespec ts;
+    ::clock_gettime( CLOCK_MONOTONIC_COARSE, &ts ); // tick granularity is plenty for 1 s windows
+    return static_cast<int64_t>( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch() )
+        .count();
+#endif
+  }
+
+  const uint32_t m_per_second;
+  std::atomic<int64_t> m_window{ INT64_MIN / 2 };
+  std::atomic<uint32_t> m_count{ 0 };
+  std::atomic<uint64_t> m_suppressed{ 0 };
+};
+
 //! @brief A non-synchronous log controller using SPDLog
 //
 //  Follows the Model–view–controller pattern:
 //
 // 1 Internal Model:
-// - `spdlog::logger`
+// - `spdlog::logger` (synchronous), or
+// - `spdlog::async_logger` fed through a bounded `spdlog::details::thread_pool` (async mode)
 //
 // 3 External Views:
 // - `spdlog::sinks::stdout_color_sink_mt`
 // - `spdlog::sinks::basic_file_sink_mt`
 // - `spdlog::sinks::callback_sink_mt`
 //
+// The synchronous logger flushes every record. In async mode the caller only formats the message
+// and enqueues it; sinks and flushing (on error, otherwise every `flush_interval`) run on the
+// pool's thread. A full queue overwrites its oldest record, so logging never blocks the caller;
+// dropped() reports how many were lost.
+//
 class BasicLogController
 {
 public:
+  struct Async
+  {
+    std::size_t queue_size = 8192; // records, preallocated
+    std::size_t threads = 1;
+    std::chrono::seconds flush_interval{ 1 };
+  };
+
   BasicLogController( std::string log_name, std::string log_path )
       : m_log_name( log_name ),
         m_log_path( log_path )
+  {
+    init_sinks();
+    m_logger = std::make_shared<spdlog::logger>(
+        spdlog::logger( m_log_name, { m_file_sink, m_console_sink, m_callback_sink } ) );
+
+    spdlog::set_default_logger( m_logger );
+    spdlog::flush_on( spdlog::level::trace );
+  }
+
+  BasicLogController( std::string log_name, std::string log_path, const Async &async )
+      : m_log_name( log_name ),
+        m_log_path( log_path ),
+        m_thread_pool(
+            std::make_shared<spdlog::details::thread_pool>( async.queue_size, async.threads ) )
+  {
+    init_sinks();
+    m_logger = std::make_shared<spdlog::async_logger>(
+        m_log_name,
+        spdlog::sinks_init_list{ m_file_sink, m_console_sink, m_callback_sink },
+        m_thread_pool,
+        spdlog::async_overflow_policy::overrun_oldest );
+
+    spdlog::set_default_logger( m_logger );
+    spdlog::flush_on( spdlog::level::err );
+    spdlog::flush_every( async.flush_interval );
+  }
+
+  // Deregisters the logger, so neither spdlog's registry nor its periodic flusher reaches the
+  // callback sink (which captures `this`) afterwards. A default logger that was this one goes
+  // back to spdlog's plain console logger.
+  ~BasicLogController()
+  {
+    if ( m_thread_pool ) spdlog::flush_every( std::chrono::seconds::zero() ); // joins the flusher
+    m_logger->flush(); // async: queued behind everything still pending
+    if ( spdlog::default_logger_raw() == m_logger.get() )
+    {
+      spdlog::set_default_logger( std::make_shared<spdlog::logger>(
+          "", std::make_shared<spdlog::sinks::stdout_color_sink_mt>() ) );
+    }
+    spdlog::drop( m_log_name );
+  }
+
+  BasicLogController( const BasicLogController & ) = delete;
+  BasicLogController &operator=( const BasicLogController & ) = delete;
+
+  // Receives the formatted message text (no pattern) of every record, e.g. to forward telemetry
+  // JSON lines. Set it before anything is logged, it is not synchronised with logging threads.
+  void set_callback( std::function<void( const std::string & )> callback )
+  {
+    m_callback = std::move( callback );
+  }
+
+  std::shared_ptr<spdlog::logger> logger() const { return m_logger; }
+
+  // Records overwritten because the async queue was full (always 0 when synchronous)
+  std::size_t dropped() const { return m_thread_pool ? m_thread_pool->overrun_counter() : 0; }
+
+private:
+  void init_sinks()
   {
     m_console_sink->set_level( spdlog::level::trace );
     // m_console_sink->set_pattern("[%c] [%^%l%$] %s:%v");
@@ -42,12 +186,8 @@ public:
     m_file_sink->set_level( spdlog::level::trace );
     // m_file_sink->set_pattern("[%c] [%^%l%$] %s:%v");
     m_file_sink->set_pattern( "%s:%# - %v" );
-
-    spdlog::set_default_logger( m_logger );
-    spdlog::flush_on( spdlog::level::trace );
   }
 
-private:
   std::string m_log_name{};
   std::string m_log_path{};
 
@@ -59,21 +199,69 @@ private:
   std::shared_ptr<spdlog::sinks::basic_file_sink_mt> m_file_sink{
       std::make_shared<spdlog::sinks::basic_file_sink_mt>( m_log_path, true ) };
 
+  std::function<void( const std::string & )> m_callback{};
+
+  // sink for handing records to m_callback
   std::shared_ptr<spdlog::sinks::callback_sink_mt> m_callback_sink{
-      std::make_shared<spdlog::sinks::callback_sink_mt>( []( const spdlog::details::log_msg &msg ) {
-        // std::cout << "BasicLogController Callback!!!" << "\n";
-      } ) };
-
-  // initialise spdlog::logger with sinks
-  std::shared_ptr<spdlog::logger> m_logger{
-      std::make_shared<spdlog::logger>( spdlog::logger( m_log_name,
-                                                        {
-                                                            m_file_sink,
-                                                            m_console_sink,
-                                                            m_callback_sink // DISABLE CALLBACK HERE
-                                                        } ) ) };
+      std::make_shared<spdlog::sinks::callback_sink_mt>(
+          [this]( const spdlog::details::log_msg &msg ) {
+            if ( m_callback ) m_callback( std::string( msg.payload.data(), msg.payload.size() ) );
+          } ) };
+
+  // async mode only, declared before the logger so it outlives it
+  std::shared_ptr<spdlog::details::thread_pool> m_thread_pool{};
+
+  // spdlog::logger (or async_logger) with the sinks above
+  std::shared_ptr<spdlog::logger> m_logger{};
 };
 
 } // namespace Logging
 
-#endif // __LOGGING_BASICLOGGER_HPP__
\ No newline at end of file
+// Rate-limited logging for hot paths: at most `per_second` records per second from this call
+// site. Compiled out entirely below SPDLOG_ACTIVE_LEVEL, checked against the logger's runtime
+// level before the limiter is touched.
+#define LOGGING_RATE_LIMITED( logger, level, per_second, ... )                                     \
+  do                                                                                               \
+  {                                                                                                \
+    static Logging::RateLimiter logging_rate_limiter_( per_second );                               \
+    if ( ( logger )->should_log( level ) && logging_rate_limiter_.allow() )                        \
+      ( logger )->log(                                                                             \
+          spdlog::source_loc{ __FILE__, __LINE__, SPDLOG_FUNCTION }, level, __VA_ARGS__ );         \
+  } while ( 0 )
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define LOGGING_TRACE_RATE_LIMITED( logger, per_second, ... )                                      \
+  LOGGING_RATE_LIMITED( logger, spdlog::level::trace, per_second, __VA_ARGS__ )
+#else
+#define LOGGING_TRACE_RATE_LIMITED( logger, per_second, ... ) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define LOGGING_DEBUG_RATE_LIMITED( logger, per_second, ... )                                      \
+  LOGGING_RATE_LIMITED( logger, spdlog::level::debug, per_second, __VA_ARGS__ )
+#else
+#define LOGGING_DEBUG_RATE_LIMITED( logger, per_second, ... ) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+#define LOGGING_INFO_RATE_LIMITED( logger, per_second, ... )                                       \
+  LOGGING_RATE_LIMITED( logger, spdlog::level::info, per_second, __VA_ARGS__ )
+#else
+#define LOGGING_INFO_RATE_LIMITED( logger, per_second, ... ) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_WARN
+#define LOGGING_WARN_RATE_LIMITED( logger, per_second, ... )                                       \
+  LOGGING_RATE_LIMITED( logger, spdlog::level::warn, per_second, __VA_ARGS__ )
+#else
+#define LOGGING_WARN_RATE_LIMITED( logger, per_second, ... ) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_ERROR
+#define LOGGING_ERROR_RATE_LIMITED( logger, per_second, ... )                                      \
+  LOGGING_RATE_LIMITED( logger, spdlog::level::err, per_second, __VA_ARGS__ )
+#else
+#define LOGGING_ERROR_RATE_LIMITED( logger, per_second, ... ) (void)0
+#endif
+
+#endif // __LOGGING_BASICLOGGER_HPP__
@@ -0,0 +1,391 @@
+#ifndef __LOGGING_EVENTLOG_HPP__
+#define __LOGGING_EVENTLOG_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+// Usage:
+//
+// #include <Logging/EventLog.hpp>
+// Logging::EventLog::start( "trace.evlog" );          // once, before the workers start
+// EVENTLOG( "enqueue slot={} len={}", slot, len );    // hot path, integers/floats only
+// Logging::EventLog::stop();                          // drains and closes the file
+//
+// EventLogDecoder trace.evlog                         // renders the file as text
+//
+// Build with -DLOGGING_NO_EVENTLOG to compile every EVENTLOG() statement out.
+
+namespace Logging {
+
+// On-disk layout, shared with the EventLogDecoder tool. All integers little-endian.
+//
+// file   := MAGIC entry*
+// entry  := 'F' u16 id, u16 nargs, u32 line, u32 file_len, u32 fmt_len, file, fmt, types[nargs]
+//         | 'C' u32 thread, u32 len, record bytes          (a slice of one thread's buffer)
+//         | 'T' u64 tsc, u64 unix_ns                       (clock pair, one per drain that wrote)
+//         | 'D' u32 thread, u64 dropped                    (records lost to a full buffer)
+// record := u64 (id | nargs << 16), u64 tsc, u64 args[nargs]
+//           id PADDING means "skip to the end of this 'C' slice"
+// types  := 'i' signed, 'u' unsigned, 'f' double, 'p' pointer
+namespace EventLogFormat {
+constexpr char MAGIC[8] = { 'L', 'B', 'E', 'V', 'L', 'O', 'G', '1' };
+constexpr uint16_t PADDING = 0xffff;
+} // namespace EventLogFormat
+
+//! @brief NanoLog-style binary event log: call sites store a format id and raw arguments only.
+//
+// Formatting is deferred to the offline EventLogDecoder. Each thread appends fixed-width records
+// (a header word, a TSC stamp and one word per argument) to its own lock-free SPSC byte ring; a
+// background thread copies new bytes out to the file every millisecond. A full ring drops the
+// record and counts it, so the hot path never blocks; only a thread's first record allocates its
+// ring. Format strings are registered once per call site (function-local static) and written to
+// the file before the first record that uses them.
+//
+class EventLog
+{
+public:
+  static constexpr std::size_t BUFFER_BYTES = 1 << 20; // per thread
+
+  // Throws std::runtime_error if the file cannot be created
+  static void start( const std::string &path, std::chrono::milliseconds period = PERIOD )
+  {
+    State &s = state();
+    std::lock_guard<std::mutex> lock( s.mutex );
+    if ( s.file ) return;
+    s.file = std::fopen( path.c_str(), "wb" );
+    if ( !s.file ) throw std::runtime_error( path + ": " + std::strerror( errno ) );
+    std::setvbuf( s.file, nullptr, _IOFBF, 1 << 20 );
+    std::fwrite( EventLogFormat::MAGIC, 1, sizeof( EventLogFormat::MAGIC ), s.file );
+    write_clock( s.file );
+    s.written_formats = 0;
+    s.stopping = false;
+    s.writer = std::thread( [period] { run( period ); } );
+    s_enabled.store( true, std::memory_order_release );
+  }
+
+  // Drains every thread's buffer and closes the file. Records made after this are discarded.
+  static void stop()
+  {
+    State &s = state();
+    s_enabled.store( false, std::memory_order_release );
+    {
+      std::lock_guard<std::mutex> lock( s.mutex );
+      if ( !s.file ) return;
+      s.stopping = true;
+    }
+    s.wake.notify_all();
+    s.writer.join();
+  }
+
+  static bool enabled() { return s_enabled.load( std::memory_order_relaxed ); }
+
+  // Call-site registration, once per EVENTLOG() statement; the arguments only supply their types
+  template <typename... Args>
+  static uint16_t define( const char *file, int line, const char *fmt, Args... )
+  {
+    const char types[] = { type_char<Args>()..., '\0' };
+    State &s = state();
+    std::lock_guard<std::mutex> lock( s.mutex );
+    s.formats.push_back( { file, static_cast<uint32_t>( line ), fmt, types } );
+    return static_cast<uint16_t>( s.formats.size() - 1 );
+  }
+
+  template <typename... Args> static void record( uint16_t id, const char *, Args... args )
+  {
+    constexpr std::size_t words = 2 + sizeof...( Args );
+    Buffer *b = t_buffer ? t_buffer : attach();
+    uint64_t *p = b->reserve( words );
+    if ( !p )
+    {
+      b->dropped.store( b->dropped.load( std::memory_order_relaxed ) + 1,
+                        std::memory_order_relaxed );
+      return;
+    }
+    p[0] = id | static_cast<uint64_t>( sizeof...( Args ) ) << 16;
+    p[1] = tsc();
+    std::size_t i = 2;
+    (void)i;
+    ( ( p[i++] = to_word( args ) ), ... );
+    b->commit( words );
+  }
+
+  static uint64_t tsc()
+  {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch() )
+        .count();
+#endif
+  }
+
+private:
+  static constexpr std::chrono::milliseconds PERIOD{ 1 };
+
+  // SPSC ring of 8-byte words: the owning thread produces, the writer thread consumes
+  struct Buffer
+  {
+    static constexpr std::size_t WORDS = BUFFER_BYTES / 8;
+
+    explicit Buffer( uint32_t thread_index )
+        : index( thread_index ),
+          words( new uint64_t[WORDS] )
+    {
+    }
+
+    // Producer: contiguous room for `n` words, wrapping with a padding record if needed
+    uint64_t *reserve( std::size_t n )
+    {
+      uint64_t head = m_head.load( std::memory_order_relaxed );
+      std::size_t offset = head % WORDS;
+      std::size_t need = offset + n > WORDS ? WORDS - offset + n : n;
+      if ( head + need - m_cached_tail > WORDS )
+      {
+        m_cached_tail = m_tail.load( std::memory_order_acquire );
+        if ( head + need - m_cached_tail > WORDS ) return nullptr;
+      }
+      if ( need != n )
+      {
+        words[offset] = EventLogFormat::PADDING;
+        m_head.store( head + WORDS - offset, std::memory_order_release );
+        offset = 0;
+      }
+      return &words[offset];
+    }
+
+    void commit( std::size_t n )
+    {
+      m_head.store( m_head.load( std::memory_order_relaxed ) + n, std::memory_order_release );
+    }
+
+    const uint32_t index;
+    std::unique_ptr<uint64_t[]> words;
+    std::atomic<uint64_t> dropped{ 0 };
+
+    alignas( 64 ) std::atomic<uint64_t> m_head{ 0 };
+    uint64_t m_cached_tail = 0;
+    alignas( 64 ) std::atomic<uint64_t> m_tail{ 0 };
+  };
+
+  struct Format
+  {
+    std::string file;
+    uint32_t line;
+    std::string fmt;
+    std::string types;
+  };
+
+  struct State
+  {
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::FILE *file = nullptr;
+    std::thread writer;
+    std::vector<Format> formats;
+    std::size_t written_formats = 0;
+    std::vector<std::unique_ptr<Buffer>> buffers; // never shrinks, threads keep raw pointers
+  };
+
+  static State &state()
+  {
+    static State s;
+    return s;
+  }
+
+  static Buffer *attach()
+  {
+    State &s = state();
+    std::lock_guard<std::mutex> lock( s.mutex );
+    s.buffers.push_back( std::make_unique<Buffer>( static_cast<uint32_t>( s.buffers.size() ) ) );
+    t_buffer = s.buffers.back().get();
+    return t_buffer;
+  }
+
+  template <typename T> static constexpr char type_char()
+  {
+    using U = std::decay_t<T>;
+    static_assert( std::is_arithmetic<U>::value || std::is_enum<U>::value ||
+                       std::is_pointer<U>::value,
+                   "EVENTLOG arguments must be integers, floating point, enums or pointers" );
+    if ( std::is_pointer<U>::value ) return 'p';
+    if ( std::is_floating_point<U>::value ) return 'f';
+    if ( std::is_enum<U>::value ) return 'i';
+    return std::is_signed<U>::value ? 'i' : 'u';
+  }
+
+  template <typename T> static uint64_t to_word( T value )
+  {
+    if constexpr ( std::is_floating_point<T>::value )
+    {
+      double d = value;
+      uint64_t w;
+      std::memcpy( &w, &d, sizeof( w ) );
+      return w;
+    }
+    else if constexpr ( std::is_pointer<T>::value )
+      return reinterpret_cast<uintptr_t>( value );
+    else
+      return static_cast<uint64_t>( static_cast<int64_t>( value ) ); // sign-extends signed types
+  }
+
+  template <typename T> static void put( std::FILE *f, T value )
+  {
+    std::fwrite( &value, sizeof( value ), 1, f );
+  }
+
+  static void write_clock( std::FILE *file )
+  {
+    uint64_t unix_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch() )
+                           .count();
+    std::fputc( 'T', file );
+    put<uint64_t>( file, tsc() );
+    put<uint64_t>( file, unix_ns );
+  }
+
+  // What one drain writes, copied out under s.mutex so define() and attach() never wait on
+  // the disk
+  struct Pending
+  {
+    std::size_t first_format = 0;
+    std::vector<Format> formats;
+    std::vector<Buffer *> buffers;
+    std::vector<uint64_t> heads;
+  };
+
+  // Writer thread: formats first, then every buffer's new bytes
+  static void run( std::chrono::milliseconds period )
+  {
+    State &s = state();
+    std::unique_lock<std::mutex> lock( s.mutex );
+    Pending pending;
+    while ( true )
+    {
+      bool last = s.wake.wait_for( lock, period, [&s] { return s.stopping; } );
+      collect( s, pending );
+      lock.unlock();
+      drain( s.file, pending );
+      lock.lock();
+      if ( last ) break;
+    }
+    lock.unlock();
+
+    // stopping: no buffer is added any more, pending.buffers holds them all
+    for ( Buffer *b : pending.buffers )
+    {
+      std::fputc( 'D', s.file );
+      put<uint32_t>( s.file, b->index );
+      put<uint64_t>( s.file, b->dropped.load( std::memory_order_relaxed ) );
+      b->dropped.store( 0, std::memory_order_relaxed );
+    }
+    write_clock( s.file );
+    std::fclose( s.file );
+
+    lock.lock();
+    s.file = nullptr;
+  }
+
+  // Called with s.mutex held
+  static void collect( State &s, Pending &pending )
+  {
+    // heads before formats: a record is always made after its call site registered
+    pending.buffers.clear();
+    pending.heads.clear();
+    for ( const auto &b : s.buffers )
+    {
+      pending.buffers.push_back( b.get() );
+      pending.heads.push_back( b->m_head.load( std::memory_order_acquire ) );
+    }
+
+    pending.first_format = s.written_formats;
+    pending.formats.assign( s.formats.begin() + s.written_formats, s.formats.end() );
+    s.written_formats = s.formats.size();
+  }
+
+  // Writer thread only, without s.mutex
+  static void drain( std::FILE *file, const Pending &pending )
+  {
+    for ( std::size_t i = 0; i < pending.formats.size(); ++i )
+    {
+      const Format &f = pending.formats[i];
+      std::fputc( 'F', file );
+      put<uint16_t>( file, static_cast<uint16_t>( pending.first_format + i ) );
+      put<uint16_t>( file, static_cast<uint16_t>( f.types.size() ) );
+      put<uint32_t>( file, f.line );
+      put<uint32_t>( file, static_cast<uint32_t>( f.file.size() ) );
+      put<uint32_t>( file, static_cast<uint32_t>( f.fmt.size() ) );
+      std::fwrite( f.file.data(), 1, f.file.size(), file );
+      std::fwrite( f.fmt.data(), 1, f.fmt.size(), file );
+      std::fwrite( f.types.data(), 1, f.types.size(), file );
+    }
+
+    bool wrote = false;
+    for ( std::size_t i = 0; i < pending.heads.size(); ++i )
+    {
+      Buffer &b = *pending.buffers[i];
+      uint64_t tail = b.m_tail.load( std::memory_order_relaxed );
+      wrote |= tail < pending.heads[i];
+      while ( tail < pending.heads[i] )
+      {
+        // one slice per contiguous run, a padding record never spans the wrap
+        std::size_t offset = tail % Buffer::WORDS;
+        std::size_t n = std::min<uint64_t>( pending.heads[i] - tail, Buffer::WORDS - offset );
+        std::fputc( 'C', file );
+        put<uint32_t>( file, b.index );
+        put<uint32_t>( file, static_cast<uint32_t>( n * 8 ) );
+        std::fwrite( &b.words[offset], 8, n, file );
+        tail += n;
+      }
+      b.m_tail.store( tail, std::memory_order_release );
+    }
+    if ( wrote ) write_clock( file ); // keeps a killed process's file calibrated
+    std::fflush( file );
+  }
+
+  inline static std::atomic<bool> s_enabled{ false };
+  inline static thread_local Buffer *t_buffer = nullptr;
+};
+
+} // namespace Logging
+
+#ifdef LOGGING_NO_EVENTLOG
+// Arguments stay referenced (no unused-variable warnings) but nothing is evaluated
+#define EVENTLOG( ... )                                                                            \
+  do                                                                                               \
+  {                                                                                                \
+    if ( false ) Logging::EventLog::record( 0, __VA_ARGS__ );                                      \
+  } while ( 0 )
+#else
+// EVENTLOG( "format with {} placeholders", args... ): one binary record if the log is running.
+// Arguments must be integers, floating point, enums or pointers; "{}" is the only placeholder.
+#define EVENTLOG( ... )                                                                            \
+  do                                                                                               \
+  {                                                                                                \
+    if ( Logging::EventLog::enabled() )                                                            \
+    {                                                                                              \
+      static const uint16_t eventlog_id_ =                                                         \
+          Logging::EventLog::define( __FILE__, __LINE__, __VA_ARGS__ );                            \
+      Logging::EventLog::record( eventlog_id_, __VA_ARGS__ );                                      \
+    }                                                                                              \
+  } while ( 0 )
+#endif
+
+#endif // __LOGGING_EVENTLOG_HPP__
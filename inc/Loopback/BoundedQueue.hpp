@@ -0,0 +1,187 @@
+#ifndef LOOPBACK_BOUNDEDQUEUE_HPP
+#define LOOPBACK_BOUNDEDQUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Usage:
+//
+// #include <Loopback/BoundedQueue.hpp>
+// Loopback::BoundedQueue<Packet> queue( 4096, Loopback::OverflowPolicy::DropOldest );
+//
+// producer: if ( queue.push( pkt ) != Loopback::Push::Queued ) release( pkt );   queue.stop();
+// consumer: while ( queue.pop( pkt ) ) { ... }
+
+namespace Loopback {
+
+//! @brief What a producer does when the queue is full.
+enum class OverflowPolicy
+{
+  Block,      // wait for the consumer (backpressure onto ingress)
+  DropNewest, // reject the packet being pushed
+  DropOldest  // evict the packet at the head to make room
+};
+
+inline const char *to_string( OverflowPolicy policy )
+{
+  switch ( policy )
+  {
+  case OverflowPolicy::DropNewest:
+    return "drop-newest";
+  case OverflowPolicy::DropOldest:
+    return "drop-oldest";
+  default:
+    return "block";
+  }
+}
+
+// Parses "block", "drop-newest" or "drop-oldest"; false for anything else
+inline bool parse_overflow_policy( const std::string &name, OverflowPolicy &out )
+{
+  for ( OverflowPolicy p :
+        { OverflowPolicy::Block, OverflowPolicy::DropNewest, OverflowPolicy::DropOldest } )
+  {
+    if ( name == to_string( p ) )
+    {
+      out = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+enum class Push
+{
+  Queued,
+  DroppedNewest, // queue full, the pushed item was rejected
+  DroppedOldest, // queue full, the oldest item was evicted to make room
+  Closed         // queue stopped, nothing was queued
+};
+
+struct QueueStats
+{
+  std::size_t capacity = 0;
+  std::size_t high_water = 0; // deepest the queue has been
+  uint64_t queued = 0;
+  uint64_t dropped_newest = 0;
+  uint64_t dropped_oldest = 0;
+  uint64_t blocked = 0; // pushes that had to wait for space (OverflowPolicy::Block)
+};
+
+//! @brief Fixed-capacity MPMC queue (mutex + condvars) with a selectable overflow policy.
+//
+// Slots are allocated once, so memory use is bounded by `capacity` no matter how far egress
+// falls behind. Items are exchanged with the slot contents (std::swap) rather than copied:
+// heap storage owned by `T` is recycled, and whenever push() does not return Push::Queued the
+// caller's `item` holds the packet that is no longer queued (the rejected one or the evicted
+// oldest one), so pooled buffers, UMEM frames or mbufs can be released by the caller.
+//
+template <typename T> class BoundedQueue
+{
+public:
+  BoundedQueue( std::size_t capacity, OverflowPolicy policy )
+      : m_slots( capacity ? capacity : 1 ),
+        m_policy( policy )
+  {
+  }
+
+  BoundedQueue( const BoundedQueue & ) = delete;
+  BoundedQueue &operator=( const BoundedQueue & ) = delete;
+
+  Push push( T &item )
+  {
+    std::unique_lock<std::mutex> lock( m_mutex );
+    if ( m_count == m_slots.size() && m_running )
+    {
+      if ( m_policy == OverflowPolicy::DropNewest )
+      {
+        ++m_stats.dropped_newest;
+        return Push::DroppedNewest;
+      }
+      if ( m_policy == OverflowPolicy::DropOldest )
+      {
+        // swap the new item straight into the head slot, which becomes the new tail
+        std::swap( m_slots[m_head], item );
+        m_head = ( m_head + 1 ) % m_slots.size();
+        ++m_stats.dropped_oldest;
+        ++m_stats.queued;
+        m_not_empty.notify_one();
+        return Push::DroppedOldest;
+      }
+      ++m_stats.blocked;
+      m_not_full.wait( lock, [this] { return m_count < m_slots.size() || !m_running; } );
+    }
+    if ( !m_running ) return Push::Closed;
+
+    std::swap( m_slots[( m_head + m_count ) % m_slots.size()], item );
+    ++m_count;
+    ++m_stats.queued;
+    if ( m_count > m_stats.high_water ) m_stats.high_water = m_count;
+    m_not_empty.notify_one();
+    return Push::Queued;
+  }
+
+  // Waits for an item. Returns false once stopped and drained.
+  bool pop( T &out )
+  {
+    std::unique_lock<std::mutex> lock( m_mutex );
+    m_not_empty.wait( lock, [this] { return m_count || !m_running; } );
+    return take( out );
+  }
+
+  bool try_pop( T &out )
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return take( out );
+  }
+
+  // No more pushes; blocked producers return Push::Closed, consumers drain what is left
+  void stop()
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_running = false;
+    m_not_empty.notify_all();
+    m_not_full.notify_all();
+  }
+
+  QueueStats stats() const
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    QueueStats out = m_stats;
+    out.capacity = m_slots.size();
+    return out;
+  }
+
+  OverflowPolicy policy() const { return m_policy; }
+
+private:
+  bool take( T &out )
+  {
+    if ( m_count == 0 ) return false;
+    std::swap( out, m_slots[m_head] );
+    m_head = ( m_head + 1 ) % m_slots.size();
+    --m_count;
+    m_not_full.notify_one();
+    return true;
+  }
+
+  std::vector<T> m_slots;
+  std::size_t m_head = 0;
+  std::size_t m_count = 0;
+  bool m_running = true;
+  OverflowPolicy m_policy;
+  QueueStats m_stats;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_not_empty;
+  std::condition_variable m_not_full;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_BOUNDEDQUEUE_HPP
@@ -0,0 +1,48 @@
+#ifndef LOOPBACK_FANOUT_HPP
+#define LOOPBACK_FANOUT_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/if_packet.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+
+// Usage:
+//
+// #include <Loopback/Fanout.hpp>
+// for each worker socket:
+//   Loopback::join_fanout( fd, group, Loopback::FanoutMode::Hash );
+
+namespace Loopback {
+
+enum class FanoutMode
+{
+  Hash,       // PACKET_FANOUT_HASH: by flow hash, a flow always lands on the same socket
+  Cpu,        // PACKET_FANOUT_CPU: by the CPU that received the packet (follows RSS)
+  LoadBalance // PACKET_FANOUT_LB: round robin, flows are NOT kept together
+};
+
+//! @brief Add a bound AF_PACKET socket to a PACKET_FANOUT group.
+//
+// Every socket joining the same `group` on the same device must use the same mode. Hash mode
+// also sets PACKET_FANOUT_FLAG_DEFRAG so IP fragments are reassembled before hashing and stay
+// with their flow. Works for TpacketV3Source::fd() and for pcap_fileno() of a live handle.
+//
+inline void join_fanout( int fd, uint16_t group, FanoutMode mode )
+{
+  int type = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+  if ( mode == FanoutMode::Cpu )
+    type = PACKET_FANOUT_CPU;
+  else if ( mode == FanoutMode::LoadBalance )
+    type = PACKET_FANOUT_LB;
+
+  int arg = group | ( type << 16 );
+  if ( ::setsockopt( fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof( arg ) ) != 0 )
+    throw std::runtime_error( std::string( "PACKET_FANOUT: " ) + std::strerror( errno ) );
+}
+
+} // namespace Loopback
+
+#endif // LOOPBACK_FANOUT_HPP
@@ -0,0 +1,231 @@
+#ifndef LOOPBACK_FRAMEALLOCATOR_HPP
+#define LOOPBACK_FRAMEALLOCATOR_HPP
+
+#include <Loopback/SpscRing.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// Usage:
+//
+// #include <Loopback/FrameAllocator.hpp>
+// Loopback::FrameAllocator frames( 8192, 2048 );        // UMEM of 8192 frames of 2 KiB
+//
+// per thread: Loopback::FrameAllocator::Cache cache( frames );
+//             n = cache.alloc( addrs, 64 );   ...   cache.free( desc->addr );
+
+namespace Loopback {
+
+//! @brief Lock-free allocator of fixed-size frames in one region, e.g. an AF_XDP UMEM.
+//
+// Frames are handed out as byte offsets into the region, the form the fill, RX, TX and completion
+// rings use, and come back the same way: any offset inside a frame frees that frame.
+//
+// Every thread goes through its own Cache of up to two batches of frames. Only when a cache runs
+// empty or full does it touch the shared free list, and then it moves a whole batch with a single
+// compare-and-swap: the free list is a Treiber stack of batches, each a chain of frames linked
+// through a per-frame index. The head carries a version tag so a batch popped and pushed again
+// between another thread's load and CAS cannot be mistaken for the one it loaded (ABA).
+//
+class FrameAllocator
+{
+public:
+  using Addr = uint64_t;
+
+  struct Stats
+  {
+    uint32_t frames;
+    uint32_t batch;
+    uint64_t refills;   // batches taken from the shared free list
+    uint64_t spills;    // batches returned to it
+    uint64_t exhausted; // times a cache found it empty
+  };
+
+  // `frame_size` must be a power of two; `batch` frames move between a cache and the free list
+  FrameAllocator( uint32_t frames, uint32_t frame_size, uint32_t batch = 64 )
+      : m_frames( frames ),
+        m_batch( batch ? batch : 1 ),
+        m_shift( shift_for( frame_size ) ),
+        m_next( new std::atomic<uint32_t>[frames] ),
+        m_batch_next( new std::atomic<uint32_t>[frames] ),
+        m_batch_len( new std::atomic<uint32_t>[frames] )
+  {
+    std::vector<uint32_t> chain;
+    for ( uint32_t first = 0; first < frames; first += m_batch )
+    {
+      chain.clear();
+      for ( uint32_t f = first; f < frames && f < first + m_batch; ++f )
+        chain.push_back( f );
+      push_batch( chain.data(), static_cast<uint32_t>( chain.size() ) );
+    }
+    m_spills.store( 0, std::memory_order_relaxed );
+  }
+
+  FrameAllocator( const FrameAllocator & ) = delete;
+  FrameAllocator &operator=( const FrameAllocator & ) = delete;
+
+  uint32_t frames() const { return m_frames; }
+  uint32_t batch() const { return m_batch; }
+
+  uint32_t frame_of( Addr addr ) const { return static_cast<uint32_t>( addr >> m_shift ); }
+  Addr addr_of( uint32_t frame ) const { return Addr( frame ) << m_shift; }
+
+  Stats stats() const
+  {
+    return { m_frames,
+             m_batch,
+             m_refills.load( std::memory_order_relaxed ),
+             m_spills.load( std::memory_order_relaxed ),
+             m_exhausted.load( std::memory_order_relaxed ) };
+  }
+
+  //! @brief One thread's stash of free frames. Not thread-safe; gives its frames back on
+  //! destruction.
+  class Cache
+  {
+  public:
+    explicit Cache( FrameAllocator &allocator )
+        : m_allocator( allocator )
+    {
+      m_frames.reserve( 2 * allocator.batch() );
+    }
+
+    ~Cache() { flush(); }
+
+    Cache( const Cache & ) = delete;
+    Cache &operator=( const Cache & ) = delete;
+
+    // Up to `n` frame addresses into `out`, fewer only once every frame is in use
+    std::size_t alloc( Addr *out, std::size_t n )
+    {
+      std::size_t got = 0;
+      while ( got < n )
+      {
+        if ( m_frames.empty() && !m_allocator.pop_batch( m_frames ) ) break;
+        while ( got < n && !m_frames.empty() )
+        {
+          out[got++] = m_allocator.addr_of( m_frames.back() );
+          m_frames.pop_back();
+        }
+      }
+      return got;
+    }
+
+    void free( Addr addr )
+    {
+      m_frames.push_back( m_allocator.frame_of( addr ) );
+      if ( m_frames.size() >= 2 * m_allocator.batch() ) spill( m_allocator.batch() );
+    }
+
+    // Returns every cached frame to the shared free list
+    void flush()
+    {
+      while ( !m_frames.empty() )
+        spill( std::min<std::size_t>( m_frames.size(), m_allocator.batch() ) );
+    }
+
+    std::size_t size() const { return m_frames.size(); }
+
+  private:
+    void spill( std::size_t n )
+    {
+      const std::size_t first = m_frames.size() - n;
+      m_allocator.push_batch( m_frames.data() + first, static_cast<uint32_t>( n ) );
+      m_frames.resize( first );
+    }
+
+    FrameAllocator &m_allocator;
+    std::vector<uint32_t> m_frames;
+  };
+
+private:
+  static constexpr uint32_t NIL = UINT32_MAX;
+
+  static uint32_t shift_for( uint32_t frame_size )
+  {
+    if ( frame_size == 0 || ( frame_size & ( frame_size - 1 ) ) )
+      throw std::invalid_argument( "frame size must be a power of two" );
+    uint32_t shift = 0;
+    while ( ( 1u << shift ) < frame_size )
+      ++shift;
+    return shift;
+  }
+
+  static uint32_t index_of( uint64_t head ) { return static_cast<uint32_t>( head ); }
+  static uint64_t make_head( uint32_t index, uint64_t prev )
+  {
+    return ( ( prev >> 32 ) + 1 ) << 32 | index; // bump the tag on every change
+  }
+
+  // Links `n` frames into a chain and pushes it as one batch
+  void push_batch( const uint32_t *frames, uint32_t n )
+  {
+    const uint32_t first = frames[0];
+    for ( uint32_t i = 0; i + 1 < n; ++i )
+      m_next[frames[i]].store( frames[i + 1], std::memory_order_relaxed );
+    m_batch_len[first].store( n, std::memory_order_relaxed );
+
+    uint64_t head = m_head.value.load( std::memory_order_relaxed );
+    do
+    {
+      m_batch_next[first].store( index_of( head ), std::memory_order_relaxed );
+    } while ( !m_head.value.compare_exchange_weak(
+        head, make_head( first, head ), std::memory_order_release, std::memory_order_relaxed ) );
+    m_spills.fetch_add( 1, std::memory_order_relaxed );
+  }
+
+  // Pops one batch and appends its frames to `out`; false if the free list is empty
+  bool pop_batch( std::vector<uint32_t> &out )
+  {
+    uint64_t head = m_head.value.load( std::memory_order_acquire );
+    uint32_t first;
+    do
+    {
+      first = index_of( head );
+      if ( first == NIL )
+      {
+        m_exhausted.fetch_add( 1, std::memory_order_relaxed );
+        return false;
+      }
+      // may be stale if `first` was popped meanwhile, the tag then fails the CAS
+    } while ( !m_head.value.compare_exchange_weak(
+        head,
+        make_head( m_batch_next[first].load( std::memory_order_relaxed ), head ),
+        std::memory_order_acquire,
+        std::memory_order_acquire ) );
+
+    uint32_t f = first;
+    for ( uint32_t i = m_batch_len[first].load( std::memory_order_relaxed ); i; --i )
+    {
+      out.push_back( f );
+      f = m_next[f].load( std::memory_order_relaxed );
+    }
+    m_refills.fetch_add( 1, std::memory_order_relaxed );
+    return true;
+  }
+
+  struct alignas( CACHE_LINE_SIZE ) PaddedHead
+  {
+    std::atomic<uint64_t> value{ NIL };
+  };
+
+  const uint32_t m_frames;
+  const uint32_t m_batch;
+  const uint32_t m_shift;
+  std::unique_ptr<std::atomic<uint32_t>[]> m_next;       // next frame in the same batch
+  std::unique_ptr<std::atomic<uint32_t>[]> m_batch_next; // on a batch's first frame: next batch
+  std::unique_ptr<std::atomic<uint32_t>[]> m_batch_len;  // on a batch's first frame: its length
+  PaddedHead m_head;                                     // tag << 32 | first frame of top batch
+  std::atomic<uint64_t> m_refills{ 0 };
+  std::atomic<uint64_t> m_spills{ 0 };
+  std::atomic<uint64_t> m_exhausted{ 0 };
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_FRAMEALLOCATOR_HPP
@@ -0,0 +1,174 @@
+#ifndef LOOPBACK_IOURING_HPP
+#define LOOPBACK_IOURING_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Loopback {
+
+//! @brief Minimal io_uring submission/completion wrapper over the raw syscalls.
+//
+// Only what the egress writers need (IORING_OP_WRITE + waiting for completions), so there is no
+// liburing dependency. Not thread-safe: one thread submits and reaps.
+//
+class IoUring
+{
+public:
+  explicit IoUring( unsigned entries )
+  {
+    struct io_uring_params params;
+    std::memset( &params, 0, sizeof( params ) );
+    m_fd = static_cast<int>( ::syscall( __NR_io_uring_setup, entries, &params ) );
+    if ( m_fd < 0 )
+      throw std::runtime_error( std::string( "io_uring_setup: " ) + strerror( errno ) );
+
+    try
+    {
+      map_rings( params );
+    }
+    catch ( ... )
+    {
+      release();
+      throw;
+    }
+  }
+
+  ~IoUring() { release(); }
+
+  IoUring( const IoUring & ) = delete;
+  IoUring &operator=( const IoUring & ) = delete;
+
+  // Queue and submit a single write. Returns 0, or -errno with the SQE taken back off the ring.
+  int write( int fd, const void *buf, uint32_t len, uint64_t offset, uint64_t user_data )
+  {
+    unsigned tail = *m_sq_tail;
+    if ( tail - __atomic_load_n( m_sq_head, __ATOMIC_ACQUIRE ) >= m_sq_entries ) return -EBUSY;
+
+    unsigned index = tail & m_sq_mask;
+    struct io_uring_sqe *sqe = &m_sqes[index];
+    std::memset( sqe, 0, sizeof( *sqe ) );
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>( buf );
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    m_sq_array[index] = index;
+    __atomic_store_n( m_sq_tail, tail + 1, __ATOMIC_RELEASE );
+
+    // without SQPOLL the kernel only consumes SQEs inside io_uring_enter, so one it did not
+    // take is still ours to withdraw; left queued it would go out with the next submit
+    int ret = enter( 1, 0, 0 );
+    if ( ret == 1 ) return 0;
+    __atomic_store_n( m_sq_tail, tail, __ATOMIC_RELEASE );
+    return ret < 0 ? ret : -EAGAIN;
+  }
+
+  // Pop one completion if available, without entering the kernel
+  bool peek( struct io_uring_cqe &out )
+  {
+    unsigned head = *m_cq_head;
+    if ( head == __atomic_load_n( m_cq_tail, __ATOMIC_ACQUIRE ) ) return false;
+    out = m_cqes[head & m_cq_mask];
+    __atomic_store_n( m_cq_head, head + 1, __ATOMIC_RELEASE );
+    return true;
+  }
+
+  // Block until one completion is available. Returns -errno on failure.
+  int wait( struct io_uring_cqe &out )
+  {
+    while ( !peek( out ) )
+    {
+      int ret = enter( 0, 1, IORING_ENTER_GETEVENTS );
+      if ( ret < 0 && ret != -EINTR ) return ret;
+    }
+    return 0;
+  }
+
+private:
+  void map_rings( const struct io_uring_params &params )
+  {
+    m_sq_map_len = params.sq_off.array + params.sq_entries * sizeof( uint32_t );
+    m_cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if ( single_mmap )
+    {
+      if ( m_cq_map_len > m_sq_map_len ) m_sq_map_len = m_cq_map_len;
+      m_cq_map_len = m_sq_map_len;
+    }
+
+    m_sq_map = map( m_sq_map_len, IORING_OFF_SQ_RING );
+    m_cq_map = single_mmap ? m_sq_map : map( m_cq_map_len, IORING_OFF_CQ_RING );
+    m_sqes_len = params.sq_entries * sizeof( struct io_uring_sqe );
+    m_sqes = static_cast<struct io_uring_sqe *>( map( m_sqes_len, IORING_OFF_SQES ) );
+
+    auto *sq = static_cast<uint8_t *>( m_sq_map );
+    m_sq_head = reinterpret_cast<unsigned *>( sq + params.sq_off.head );
+    m_sq_tail = reinterpret_cast<unsigned *>( sq + params.sq_off.tail );
+    m_sq_mask = *reinterpret_cast<unsigned *>( sq + params.sq_off.ring_mask );
+    m_sq_entries = params.sq_entries;
+    m_sq_array = reinterpret_cast<unsigned *>( sq + params.sq_off.array );
+
+    auto *cq = static_cast<uint8_t *>( m_cq_map );
+    m_cq_head = reinterpret_cast<unsigned *>( cq + params.cq_off.head );
+    m_cq_tail = reinterpret_cast<unsigned *>( cq + params.cq_off.tail );
+    m_cq_mask = *reinterpret_cast<unsigned *>( cq + params.cq_off.ring_mask );
+    m_cqes = reinterpret_cast<struct io_uring_cqe *>( cq + params.cq_off.cqes );
+  }
+
+  void *map( std::size_t len, off_t offset )
+  {
+    const int prot = PROT_READ | PROT_WRITE;
+    void *p = ::mmap( nullptr, len, prot, MAP_SHARED | MAP_POPULATE, m_fd, offset );
+    if ( p == MAP_FAILED )
+      throw std::runtime_error( std::string( "io_uring mmap: " ) + strerror( errno ) );
+    return p;
+  }
+
+  void release()
+  {
+    if ( m_sqes ) ::munmap( m_sqes, m_sqes_len );
+    if ( m_cq_map && m_cq_map != m_sq_map ) ::munmap( m_cq_map, m_cq_map_len );
+    if ( m_sq_map ) ::munmap( m_sq_map, m_sq_map_len );
+    if ( m_fd >= 0 ) ::close( m_fd );
+    m_sqes = nullptr;
+    m_sq_map = m_cq_map = nullptr;
+    m_fd = -1;
+  }
+
+  int enter( unsigned to_submit, unsigned min_complete, unsigned flags )
+  {
+    long ret = ::syscall( __NR_io_uring_enter, m_fd, to_submit, min_complete, flags, nullptr, 0 );
+    return ret < 0 ? -errno : static_cast<int>( ret );
+  }
+
+  int m_fd = -1;
+  void *m_sq_map = nullptr;
+  void *m_cq_map = nullptr;
+  std::size_t m_sq_map_len = 0;
+  std::size_t m_cq_map_len = 0;
+  struct io_uring_sqe *m_sqes = nullptr;
+  std::size_t m_sqes_len = 0;
+
+  unsigned *m_sq_head = nullptr;
+  unsigned *m_sq_tail = nullptr;
+  unsigned *m_sq_array = nullptr;
+  unsigned m_sq_mask = 0;
+  unsigned m_sq_entries = 0;
+
+  unsigned *m_cq_head = nullptr;
+  unsigned *m_cq_tail = nullptr;
+  unsigned m_cq_mask = 0;
+  struct io_uring_cqe *m_cqes = nullptr;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_IOURING_HPP
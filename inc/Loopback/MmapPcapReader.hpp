@@ -0,0 +1,245 @@
+#ifndef LOOPBACK_MMAPPCAPREADER_HPP
+#define LOOPBACK_MMAPPCAPREADER_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <pcap/pcap.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Usage:
+//
+// #include <Loopback/MmapPcapReader.hpp>
+// Loopback::MmapPcapReader reader( "input.pcap" );
+// while ( reader.next_ex( &hdr, &pkt ) == 1 ) { ... }   // same return codes as pcap_next_ex
+
+namespace Loopback {
+
+//! @brief Zero-copy pcap file reader over a read-only memory mapping.
+//
+// Mirrors the libpcap offline API (`next_ex`, `dispatch`, `geterr`) so it can stand in for a
+// `pcap_open_offline` handle. Packet data pointers are views straight into the mapping.
+//
+// The mapping is advised MADV_SEQUENTIAL, the next `window` bytes are prefetched with
+// MADV_WILLNEED and pages more than one window behind the read position are dropped with
+// MADV_DONTNEED, so RSS stays around two windows regardless of file size. Dropping is safe for
+// views still sitting in a queue: the mapping is file-backed, so touching a dropped page just
+// faults it back in from the page cache.
+//
+class MmapPcapReader
+{
+public:
+  static constexpr uint32_t MAGIC_USEC = 0xa1b2c3d4;
+  static constexpr uint32_t MAGIC_NSEC = 0xa1b23c4d;
+  static constexpr std::size_t DEFAULT_WINDOW = 8 * 1024 * 1024;
+
+  explicit MmapPcapReader( const std::string &path, std::size_t window = DEFAULT_WINDOW )
+  {
+    m_fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( m_fd < 0 ) throw std::runtime_error( path + ": " + std::strerror( errno ) );
+
+    struct stat st;
+    if ( ::fstat( m_fd, &st ) != 0 || static_cast<std::size_t>( st.st_size ) < GLOBAL_HDR_LEN )
+    {
+      ::close( m_fd );
+      throw std::runtime_error( path + ": not a pcap file (too short)" );
+    }
+    m_size = st.st_size;
+
+    void *map = ::mmap( nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0 );
+    if ( map == MAP_FAILED )
+    {
+      ::close( m_fd );
+      throw std::runtime_error( path + ": mmap failed: " + std::strerror( errno ) );
+    }
+    m_base = static_cast<const uint8_t *>( map );
+
+    if ( !parse_global_header() )
+    {
+      release();
+      throw std::runtime_error( path + ": unknown pcap magic" );
+    }
+
+    long page = ::sysconf( _SC_PAGESIZE );
+    std::size_t page_size = page > 0 ? static_cast<std::size_t>( page ) : 4096;
+    m_page_mask = ~( page_size - 1 );
+    m_window = window < 2 * page_size ? 2 * page_size : window & m_page_mask;
+
+    ::madvise( const_cast<uint8_t *>( m_base ), m_size, MADV_SEQUENTIAL );
+    m_pos = GLOBAL_HDR_LEN;
+    read_ahead();
+  }
+
+  ~MmapPcapReader() { release(); }
+
+  // True if `path` starts with a classic pcap magic (µs or ns, either byte order), the only
+  // format this reader parses. pcapng and anything unreadable are left to pcap_open_offline.
+  static bool is_classic( const std::string &path )
+  {
+    int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 ) return false;
+    uint32_t magic = 0;
+    ssize_t n = ::read( fd, &magic, sizeof( magic ) );
+    ::close( fd );
+    if ( n != static_cast<ssize_t>( sizeof( magic ) ) ) return false;
+    for ( uint32_t m : { magic, __builtin_bswap32( magic ) } )
+      if ( m == MAGIC_USEC || m == MAGIC_NSEC ) return true;
+    return false;
+  }
+
+  MmapPcapReader( const MmapPcapReader & ) = delete;
+  MmapPcapReader &operator=( const MmapPcapReader & ) = delete;
+
+  int datalink() const { return m_linktype; }
+  int snapshot() const { return m_snaplen; }
+  bool nanosecond() const { return m_nsec; }
+
+  // Unit of ts.tv_usec in the headers handed out, as with pcap_open_offline_with_tstamp_precision:
+  // PCAP_TSTAMP_PRECISION_MICRO (default) or PCAP_TSTAMP_PRECISION_NANO. file_precision() keeps
+  // whatever the capture has.
+  int precision() const { return m_precision; }
+  int file_precision() const
+  {
+    return m_nsec ? PCAP_TSTAMP_PRECISION_NANO : PCAP_TSTAMP_PRECISION_MICRO;
+  }
+  void set_precision( int precision ) { m_precision = precision; }
+  const char *geterr() const { return m_err.c_str(); }
+
+  // 1 = packet, -2 = end of file, -1 = error (see geterr). `*data` points into the mapping.
+  int next_ex( struct pcap_pkthdr **hdr, const u_char **data )
+  {
+    if ( m_pos == m_size ) return -2;
+    if ( m_size - m_pos < RECORD_HDR_LEN ) return truncated();
+
+    const uint8_t *rec = m_base + m_pos;
+    uint32_t ts_sec = load32( rec );
+    uint32_t ts_frac = load32( rec + 4 );
+    uint32_t caplen = load32( rec + 8 );
+    uint32_t len = load32( rec + 12 );
+    if ( caplen > m_size - m_pos - RECORD_HDR_LEN ) return truncated();
+
+    m_hdr.ts.tv_sec = ts_sec;
+    if ( m_precision == file_precision() )
+      m_hdr.ts.tv_usec = ts_frac;
+    else if ( m_nsec )
+      m_hdr.ts.tv_usec = ts_frac / 1000;
+    else
+      m_hdr.ts.tv_usec = ts_frac * 1000;
+    m_hdr.caplen = caplen;
+    m_hdr.len = len;
+    *hdr = &m_hdr;
+    *data = rec + RECORD_HDR_LEN;
+
+    m_pos += RECORD_HDR_LEN + caplen;
+    if ( m_pos >= m_advised ) read_ahead();
+    return 1;
+  }
+
+  // Same contract as pcap_dispatch on a savefile: returns packets handled, 0 at EOF, -1 on error
+  int dispatch( int cnt, pcap_handler callback, u_char *user )
+  {
+    struct pcap_pkthdr *hdr;
+    const u_char *data;
+    int n = 0;
+    while ( cnt <= 0 || n < cnt )
+    {
+      int ret = next_ex( &hdr, &data );
+      if ( ret == -2 ) break;
+      if ( ret < 0 ) return n ? n : ret;
+      callback( user, hdr, data );
+      ++n;
+    }
+    return n;
+  }
+
+private:
+  static constexpr std::size_t GLOBAL_HDR_LEN = 24;
+  static constexpr std::size_t RECORD_HDR_LEN = 16;
+
+  bool parse_global_header()
+  {
+    uint32_t magic;
+    std::memcpy( &magic, m_base, sizeof( magic ) );
+    if ( magic == MAGIC_USEC || magic == MAGIC_NSEC ) { m_swap = false; }
+    else if ( __builtin_bswap32( magic ) == MAGIC_USEC || __builtin_bswap32( magic ) == MAGIC_NSEC )
+    {
+      m_swap = true;
+      magic = __builtin_bswap32( magic );
+    }
+    else
+      return false;
+
+    m_nsec = magic == MAGIC_NSEC;
+    m_snaplen = static_cast<int>( load32( m_base + 16 ) );
+    m_linktype = static_cast<int>( load32( m_base + 20 ) & 0x03ffffff ); // low bits: LINKTYPE_
+    return true;
+  }
+
+  uint32_t load32( const uint8_t *p ) const
+  {
+    uint32_t v;
+    std::memcpy( &v, p, sizeof( v ) );
+    return m_swap ? __builtin_bswap32( v ) : v;
+  }
+
+  // Prefetch the next window and drop everything more than one window behind the read position
+  void read_ahead()
+  {
+    std::size_t start = m_pos & m_page_mask;
+    std::size_t end = start + m_window < m_size ? start + m_window : m_size;
+    if ( end > start )
+      ::madvise( const_cast<uint8_t *>( m_base ) + start, end - start, MADV_WILLNEED );
+    m_advised = start + m_window / 2; // refresh halfway through so I/O overlaps consumption
+
+    if ( start > m_window )
+    {
+      std::size_t drop_end = ( start - m_window ) & m_page_mask;
+      if ( drop_end > m_dropped )
+      {
+        uint8_t *drop = const_cast<uint8_t *>( m_base ) + m_dropped;
+        ::madvise( drop, drop_end - m_dropped, MADV_DONTNEED );
+        m_dropped = drop_end;
+      }
+    }
+  }
+
+  int truncated()
+  {
+    m_err = "truncated pcap record at offset " + std::to_string( m_pos );
+    return -1;
+  }
+
+  void release()
+  {
+    if ( m_base ) ::munmap( const_cast<uint8_t *>( m_base ), m_size );
+    if ( m_fd >= 0 ) ::close( m_fd );
+    m_base = nullptr;
+    m_fd = -1;
+  }
+
+  int m_fd = -1;
+  const uint8_t *m_base = nullptr;
+  std::size_t m_size = 0;
+  std::size_t m_pos = 0;
+  std::size_t m_window = DEFAULT_WINDOW;
+  std::size_t m_page_mask = ~std::size_t( 4095 );
+  std::size_t m_advised = 0; // read position at which to issue the next read-ahead
+  std::size_t m_dropped = 0; // pages below this offset have been released
+
+  bool m_swap = false;
+  bool m_nsec = false;
+  int m_precision = PCAP_TSTAMP_PRECISION_MICRO;
+  int m_snaplen = 0;
+  int m_linktype = 0;
+  struct pcap_pkthdr m_hdr{};
+  std::string m_err;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_MMAPPCAPREADER_HPP
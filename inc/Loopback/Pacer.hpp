@@ -0,0 +1,240 @@
+#ifndef LOOPBACK_PACER_HPP
+#define LOOPBACK_PACER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <pcap/pcap.h>
+#include <sys/prctl.h>
+#include <thread>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+// Usage:
+//
+// #include <Loopback/Pacer.hpp>
+// Loopback::Pacer pacer( Loopback::Pacer::Options{} );   // original gaps
+// uint64_t due = pacer.schedule( hdr );                   // per packet, in queue order
+// pacer.wait( due );                                      // sleep/spin until it is due
+// send( ... );
+
+namespace Loopback {
+
+//! @brief Calibrated time stamp counter, falls back to steady_clock where there is no TSC.
+//
+// Calibration spins for `calibration` against steady_clock once, after that now_ns() is a single
+// rdtsc, a subtraction and a multiply. Readings are on the steady_clock timeline: ticks are
+// counted from the start of the calibration, so the scaled value stays small and precise.
+// Assumes an invariant TSC (constant_tsc/nonstop_tsc), which every x86 CPU of the last decade has.
+//
+class Tsc
+{
+public:
+  explicit Tsc( std::chrono::microseconds calibration = std::chrono::microseconds( 20000 ) )
+  {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    auto t0 = std::chrono::steady_clock::now();
+    m_c0 = __rdtsc();
+    while ( std::chrono::steady_clock::now() - t0 < calibration )
+      ;
+    auto t1 = std::chrono::steady_clock::now();
+    uint64_t c1 = __rdtsc();
+    double ns = std::chrono::duration<double, std::nano>( t1 - t0 ).count();
+    m_ns_per_tick = ns / static_cast<double>( c1 - m_c0 );
+    m_base_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>( t0.time_since_epoch() ).count() );
+#else
+    (void)calibration;
+#endif
+  }
+
+  uint64_t now_ns() const
+  {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    const uint64_t ticks = __rdtsc() - m_c0;
+    return m_base_ns + static_cast<uint64_t>( static_cast<double>( ticks ) * m_ns_per_tick );
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch() )
+        .count();
+#endif
+  }
+
+  double ghz() const { return m_ns_per_tick > 0 ? 1.0 / m_ns_per_tick : 0; }
+
+private:
+  double m_ns_per_tick = 1.0;
+  uint64_t m_c0 = 0;      // TSC at calibration start
+  uint64_t m_base_ns = 0; // steady_clock at calibration start
+};
+
+//! @brief Releases packets at their capture-time offsets (optionally scaled) or at a fixed rate.
+//
+// - default: the gap between two packets is the gap between their pcap timestamps / `speedup`
+// - `pps` > 0: one packet every 1e9 / pps ns
+// - `mbps` > 0: each packet is due once the bytes before it would have left at that rate
+//
+// Deadlines are absolute offsets from the first packet, so lateness never accumulates: a packet
+// that goes out late is followed by back-to-back packets until the schedule is met again.
+// wait() sleeps until `spin` before the deadline and busy-waits on the TSC for the rest, which
+// keeps the error in the tens of nanoseconds without burning a core on long gaps. Every wait()
+// records how late the packet actually was in a log2 histogram.
+//
+class Pacer
+{
+public:
+  struct Options
+  {
+    double speedup = 1.0;
+    double pps = 0;
+    double mbps = 0;
+    std::chrono::microseconds spin{ 100 }; // busy-wait the last part of every gap
+    bool nanosecond = false; // ts.tv_usec holds nanoseconds (PCAP_TSTAMP_PRECISION_NANO)
+  };
+
+  struct Stats
+  {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    double target_pps = 0;
+    double achieved_pps = 0;
+    double target_mbps = 0;
+    double achieved_mbps = 0;
+    uint64_t error_p50_ns = 0; // upper bound of the histogram bucket
+    uint64_t error_p99_ns = 0;
+    uint64_t error_p999_ns = 0;
+    uint64_t error_max_ns = 0;
+    uint64_t late = 0; // packets released more than 1 us after their deadline
+  };
+
+  explicit Pacer( const Options &opts )
+      : m_opts( opts )
+  {
+    if ( m_opts.speedup <= 0 ) m_opts.speedup = 1.0;
+  }
+
+  // Deadline of the next packet, relative to the first one. Call once per packet, in order.
+  uint64_t schedule( const struct pcap_pkthdr &hdr )
+  {
+    uint64_t due;
+    if ( m_opts.pps > 0 )
+      due = static_cast<uint64_t>( m_packets * 1e9 / m_opts.pps );
+    else if ( m_opts.mbps > 0 )
+      due = static_cast<uint64_t>( m_bytes * 8 * 1e3 / m_opts.mbps );
+    else
+    {
+      uint64_t ts = static_cast<uint64_t>( hdr.ts.tv_sec ) * 1000000000ull +
+                    static_cast<uint64_t>( hdr.ts.tv_usec ) * ( m_opts.nanosecond ? 1 : 1000 );
+      if ( m_packets == 0 ) m_first_ts = ts;
+      // capture timestamps can step backwards, never schedule before the previous packet
+      due = ts > m_first_ts ? static_cast<uint64_t>( ( ts - m_first_ts ) / m_opts.speedup ) : 0;
+      due = std::max( due, m_last_due );
+    }
+    ++m_packets;
+    m_bytes += hdr.caplen;
+    m_last_due = due;
+    return due;
+  }
+
+  bool reached( uint64_t due ) { return elapsed() >= due; }
+
+  void wait( uint64_t due )
+  {
+    uint64_t now = elapsed();
+    const uint64_t spin = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>( m_opts.spin ).count() );
+    if ( now + spin < due )
+    {
+      std::this_thread::sleep_for( std::chrono::nanoseconds( due - now - spin ) );
+      now = elapsed();
+    }
+    while ( now < due )
+      now = elapsed();
+    record( now - due );
+  }
+
+  Stats stats() const
+  {
+    Stats out;
+    out.packets = m_packets;
+    out.bytes = m_bytes;
+    double secs = m_last_now / 1e9;
+    double target_secs = m_last_due / 1e9;
+    if ( secs > 0 )
+    {
+      out.achieved_pps = m_packets / secs;
+      out.achieved_mbps = m_bytes * 8 / secs / 1e6;
+    }
+    if ( target_secs > 0 )
+    {
+      out.target_pps = m_packets / target_secs;
+      out.target_mbps = m_bytes * 8 / target_secs / 1e6;
+    }
+    out.error_p50_ns = percentile( 0.5 );
+    out.error_p99_ns = percentile( 0.99 );
+    out.error_p999_ns = percentile( 0.999 );
+    out.error_max_ns = m_error_max;
+    out.late = m_late;
+    return out;
+  }
+
+private:
+  static constexpr int BUCKETS = 64;
+
+  // ns since the first packet; the clock starts on the first call
+  uint64_t elapsed()
+  {
+    uint64_t now = m_tsc.now_ns();
+    if ( !m_started )
+    {
+      ::prctl( PR_SET_TIMERSLACK, 1UL ); // default 50 us slack would dwarf short sleeps
+      m_start = now;
+      m_started = true;
+    }
+    m_last_now = now - m_start;
+    return m_last_now;
+  }
+
+  void record( uint64_t error_ns )
+  {
+    int bucket = error_ns ? 64 - __builtin_clzll( error_ns ) : 0; // error < 2^bucket
+    ++m_hist[std::min( bucket, BUCKETS - 1 )];
+    ++m_waits;
+    m_error_max = std::max( m_error_max, error_ns );
+    if ( error_ns > 1000 ) ++m_late;
+  }
+
+  uint64_t percentile( double p ) const
+  {
+    uint64_t rank = static_cast<uint64_t>( p * m_waits );
+    uint64_t seen = 0;
+    for ( int i = 0; i < BUCKETS; ++i )
+    {
+      seen += m_hist[i];
+      if ( seen > rank ) return i ? std::min<uint64_t>( ( 1ull << i ) - 1, m_error_max ) : 0;
+    }
+    return m_error_max;
+  }
+
+  Options m_opts;
+  Tsc m_tsc;
+  bool m_started = false;
+  uint64_t m_start = 0;
+  uint64_t m_last_now = 0;
+
+  uint64_t m_packets = 0;
+  uint64_t m_bytes = 0;
+  uint64_t m_first_ts = 0;
+  uint64_t m_last_due = 0;
+
+  uint64_t m_hist[BUCKETS] = {};
+  uint64_t m_waits = 0;
+  uint64_t m_error_max = 0;
+  uint64_t m_late = 0;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_PACER_HPP
@@ -0,0 +1,267 @@
+#ifndef LOOPBACK_PACKETARENA_HPP
+#define LOOPBACK_PACKETARENA_HPP
+
+#include <Loopback/MmapPcapReader.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <pcap/pcap.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+
+// Usage:
+//
+// #include <Loopback/PacketArena.hpp>
+// Loopback::PacketArena arena( "input.pcap", 10, true );   // 10 loops, hugepage-backed
+// while ( arena.next_ex( &hdr, &pkt ) == 1 ) { ... }         // same return codes as pcap_next_ex
+
+namespace Loopback {
+
+//! @brief Whole pcap capture preloaded into one contiguous anonymous mapping, replayed N times.
+//
+// Takes disk I/O and pcap parsing out of egress benchmarks. Packets are copied once at start-up
+// into a single region (explicit 2 MiB hugepages when requested and available, otherwise normal
+// pages with a transparent-hugepage hint), each starting on a cache line. The offline reader API
+// (`next_ex`, `dispatch`, `geterr`) walks the capture `loops` times; timestamps of later loops are
+// shifted by the capture's span so replay pacing keeps working across loop boundaries.
+//
+class PacketArena
+{
+public:
+  static constexpr std::size_t HUGEPAGE_SIZE = 2 * 1024 * 1024;
+
+  PacketArena( const std::string &path, unsigned loops, bool hugepages )
+      : m_loops( loops ? loops : 1 )
+  {
+    MmapPcapReader reader( path );
+    reader.set_precision( reader.file_precision() ); // keep nanoseconds for replay pacing
+    m_precision = reader.precision();
+    m_linktype = reader.datalink();
+    m_snaplen = reader.snapshot();
+
+    // pass 1: index records (views into the file mapping) and size the arena
+    std::vector<std::pair<struct pcap_pkthdr, const u_char *>> views;
+    struct pcap_pkthdr *hdr;
+    const u_char *data;
+    int ret;
+    std::size_t size = 0;
+    while ( ( ret = reader.next_ex( &hdr, &data ) ) == 1 )
+    {
+      views.emplace_back( *hdr, data );
+      size += align( hdr->caplen );
+    }
+    if ( ret == -1 ) throw std::runtime_error( path + ": " + reader.geterr() );
+    if ( views.empty() ) throw std::runtime_error( path + ": no packets to preload" );
+
+    allocate( size ? size : CACHE_LINE, hugepages );
+
+    // pass 2: copy into the arena
+    m_records.reserve( views.size() );
+    std::size_t offset = 0;
+    for ( const auto &view : views )
+    {
+      std::memcpy( m_base + offset, view.second, view.first.caplen );
+      m_records.push_back( { view.first, offset } );
+      offset += align( view.first.caplen );
+      m_bytes += view.first.caplen;
+    }
+
+    const struct timeval &first = m_records.front().hdr.ts;
+    const struct timeval &last = m_records.back().hdr.ts;
+    m_span = ( last.tv_sec - first.tv_sec ) * ticks_per_sec() + ( last.tv_usec - first.tv_usec );
+    m_span += 1;
+    if ( m_span < 1 ) m_span = 1;
+  }
+
+  ~PacketArena()
+  {
+    if ( m_base ) ::munmap( m_base, m_map_len );
+  }
+
+  PacketArena( const PacketArena & ) = delete;
+  PacketArena &operator=( const PacketArena & ) = delete;
+
+  int datalink() const { return m_linktype; }
+  int snapshot() const { return m_snaplen; }
+  int precision() const { return m_precision; } // that of the capture, see MmapPcapReader
+  const char *geterr() const { return ""; }
+
+  std::size_t packets() const { return m_records.size(); } // per loop
+  uint64_t bytes() const { return m_bytes; }                // per loop
+  unsigned loops() const { return m_loops; }
+  bool hugetlb() const { return m_hugetlb; }
+  std::size_t mapped() const { return m_map_len; }
+
+  // 1 = packet, -2 = all loops done. `*data` points into the arena.
+  int next_ex( struct pcap_pkthdr **hdr, const u_char **data )
+  {
+    if ( m_loop == m_loops ) return -2;
+    if ( m_next == m_records.size() )
+    {
+      m_next = 0;
+      if ( ++m_loop == m_loops ) return -2;
+    }
+    const Record &rec = m_records[m_next++];
+    m_hdr = rec.hdr;
+    if ( m_loop )
+    {
+      int64_t frac = m_hdr.ts.tv_usec + m_span * m_loop;
+      m_hdr.ts.tv_sec += frac / ticks_per_sec();
+      m_hdr.ts.tv_usec = frac % ticks_per_sec();
+    }
+    *hdr = &m_hdr;
+    *data = m_base + rec.offset;
+    return 1;
+  }
+
+  // Same contract as pcap_dispatch on a savefile: returns packets handled, 0 when done
+  int dispatch( int cnt, pcap_handler callback, u_char *user )
+  {
+    struct pcap_pkthdr *hdr;
+    const u_char *data;
+    int n = 0;
+    while ( ( cnt <= 0 || n < cnt ) && next_ex( &hdr, &data ) == 1 )
+    {
+      callback( user, hdr, data );
+      ++n;
+    }
+    return n;
+  }
+
+private:
+  static constexpr std::size_t CACHE_LINE = 64;
+
+  struct Record
+  {
+    struct pcap_pkthdr hdr;
+    std::size_t offset;
+  };
+
+  static std::size_t align( std::size_t n ) { return ( n + CACHE_LINE - 1 ) & ~( CACHE_LINE - 1 ); }
+
+  int64_t ticks_per_sec() const
+  {
+    return m_precision == PCAP_TSTAMP_PRECISION_NANO ? 1000000000 : 1000000;
+  }
+
+  void allocate( std::size_t size, bool hugepages )
+  {
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+    void *map = MAP_FAILED;
+    if ( hugepages )
+    {
+      m_map_len = ( size + HUGEPAGE_SIZE - 1 ) & ~( HUGEPAGE_SIZE - 1 );
+      map = ::mmap( nullptr, m_map_len, prot, flags | MAP_HUGETLB, -1, 0 );
+      m_hugetlb = map != MAP_FAILED;
+    }
+    if ( map == MAP_FAILED )
+    {
+      // no reserved hugepages (vm.nr_hugepages): fall back to THP on a normal mapping
+      m_map_len = size;
+      map = ::mmap( nullptr, m_map_len, prot, flags, -1, 0 );
+      if ( map == MAP_FAILED )
+        throw std::runtime_error( std::string( "arena mmap: " ) + std::strerror( errno ) );
+      if ( hugepages ) ::madvise( map, m_map_len, MADV_HUGEPAGE );
+    }
+    m_base = static_cast<uint8_t *>( map );
+  }
+
+  uint8_t *m_base = nullptr;
+  std::size_t m_map_len = 0;
+  bool m_hugetlb = false;
+  std::vector<Record> m_records;
+  uint64_t m_bytes = 0;
+  int64_t m_span = 1; // capture duration in ts.tv_usec units, plus one
+  int m_precision = PCAP_TSTAMP_PRECISION_MICRO;
+  int m_linktype = 0;
+  int m_snaplen = 0;
+
+  unsigned m_loops;
+  unsigned m_loop = 0;
+  std::size_t m_next = 0;
+  struct pcap_pkthdr m_hdr{};
+};
+
+//! @brief Per-loop throughput of an arena replay, fed by the egress thread.
+//
+// start() is called as the first batch is taken off the queue, before it is sent, and add() once
+// each batch has been sent; each time the running count crosses a multiple of the loop size the
+// loop's wall time is recorded. Both run on the egress thread.
+//
+class ReplayMeter
+{
+public:
+  struct Loop
+  {
+    double seconds;
+    double pps;
+    double gbps;
+  };
+
+  ReplayMeter( uint64_t packets_per_loop, uint64_t bytes_per_loop )
+      : m_packets_per_loop( packets_per_loop ? packets_per_loop : 1 ),
+        m_bytes_per_loop( bytes_per_loop )
+  {
+  }
+
+  // Opens the window, so the first batch's send time is counted. Later calls do nothing.
+  void start()
+  {
+    if ( m_started ) return;
+    m_started = true;
+    m_loop_start = m_start = m_last = Clock::now();
+  }
+
+  void add( uint64_t n )
+  {
+    start();
+    Clock::time_point now = Clock::now();
+    m_count += n;
+    while ( m_count >= ( m_loops.size() + 1 ) * m_packets_per_loop )
+    {
+      double secs = std::chrono::duration<double>( now - m_loop_start ).count();
+      m_loops.push_back( rate( secs, 1 ) );
+      m_loop_start = now;
+    }
+    m_last = now;
+  }
+
+  // Only consistent once the egress thread has stopped
+  const std::vector<Loop> &loops() const { return m_loops; }
+
+  Loop total() const
+  {
+    return rate( std::chrono::duration<double>( m_last - m_start ).count(), m_loops.size() );
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  Loop rate( double secs, std::size_t loops ) const
+  {
+    Loop out{ secs, 0, 0 };
+    if ( secs > 0 )
+    {
+      out.pps = m_packets_per_loop * loops / secs;
+      out.gbps = m_bytes_per_loop * loops * 8 / secs / 1e9;
+    }
+    return out;
+  }
+
+  uint64_t m_packets_per_loop;
+  uint64_t m_bytes_per_loop;
+  uint64_t m_count = 0;
+  bool m_started = false;
+  Clock::time_point m_start, m_loop_start, m_last;
+  std::vector<Loop> m_loops;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_PACKETARENA_HPP
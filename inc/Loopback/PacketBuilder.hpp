@@ -0,0 +1,304 @@
+#ifndef LOOPBACK_PACKETBUILDER_HPP
+#define LOOPBACK_PACKETBUILDER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Usage:
+//
+// #include <Loopback/PacketBuilder.hpp>
+// Loopback::PacketBuilder<Loopback::IPv4, Loopback::Udp> builder( dst_mac, src_mac, {}, ip, udp );
+// builder.build( frame, 60 );                 // once per frame size: headers, payload, checksums
+// builder.patch( frame, flow, id, seq );      // per packet: O(1) incremental checksum update
+
+namespace Loopback {
+
+using MacAddress = std::array<uint8_t, 6>;
+
+inline void put16( uint8_t *p, uint16_t v )
+{
+  p[0] = static_cast<uint8_t>( v >> 8 );
+  p[1] = static_cast<uint8_t>( v );
+}
+
+inline uint16_t get16( const uint8_t *p ) { return static_cast<uint16_t>( p[0] << 8 | p[1] ); }
+
+inline void put32( uint8_t *p, uint32_t v )
+{
+  put16( p, static_cast<uint16_t>( v >> 16 ) );
+  put16( p + 2, static_cast<uint16_t>( v ) );
+}
+
+inline uint32_t get32( const uint8_t *p ) { return uint32_t( get16( p ) ) << 16 | get16( p + 2 ); }
+
+// Internet checksum (RFC 1071) helpers on big-endian 16-bit words
+namespace Checksum {
+
+// One's complement sum of `len` bytes, not yet folded
+inline uint32_t add( const uint8_t *data, std::size_t len, uint32_t sum = 0 )
+{
+  uint64_t acc = sum;
+  for ( ; len > 1; data += 2, len -= 2 )
+    acc += get16( data );
+  if ( len ) acc += uint32_t( data[0] ) << 8;
+  while ( acc >> 16 )
+    acc = ( acc & 0xffff ) + ( acc >> 16 );
+  return static_cast<uint32_t>( acc );
+}
+
+inline uint16_t finish( uint32_t sum )
+{
+  while ( sum >> 16 )
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+  return static_cast<uint16_t>( ~sum );
+}
+
+// RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m') for one 16-bit word changing from m to m'
+inline void update( uint8_t *check, uint16_t from, uint16_t to )
+{
+  uint32_t sum = uint16_t( ~get16( check ) ) + uint16_t( ~from ) + uint32_t( to );
+  put16( check, finish( sum ) );
+}
+
+// Writes `to` over the 16-bit field at `field` and updates every checksum covering it
+template <typename... Checks> void patch16( uint8_t *field, uint16_t to, Checks... checks )
+{
+  const uint16_t from = get16( field );
+  if ( from == to ) return;
+  put16( field, to );
+  ( update( checks, from, to ), ... );
+}
+
+template <typename... Checks> void patch32( uint8_t *field, uint32_t to, Checks... checks )
+{
+  patch16( field, static_cast<uint16_t>( to >> 16 ), checks... );
+  patch16( field + 2, static_cast<uint16_t>( to ), checks... );
+}
+
+} // namespace Checksum
+
+// --- Layers -------------------------------------------------------------------------------------
+//
+// Each layer describes its own header: SIZE, where its variable fields sit and how to write it.
+// PacketBuilder stacks them at compile-time offsets.
+
+struct NoVlan
+{
+  static constexpr std::size_t SIZE = 0;
+  void write( uint8_t * ) const {}
+};
+
+//! @brief 802.1Q tag
+struct Vlan
+{
+  static constexpr std::size_t SIZE = 4;
+  static constexpr uint16_t TPID = 0x8100;
+
+  uint16_t vid = 1;
+  uint8_t pcp = 0;
+
+  void write( uint8_t *p ) const
+  {
+    put16( p, TPID );
+    put16( p + 2, static_cast<uint16_t>( pcp << 13 | ( vid & 0x0fff ) ) );
+  }
+};
+
+struct IPv4
+{
+  static constexpr std::size_t SIZE = 20;
+  static constexpr uint16_t ETHERTYPE = 0x0800;
+  static constexpr bool HAS_CHECKSUM = true;
+  static constexpr std::size_t CHECKSUM = 10;
+  static constexpr std::size_t ID = 4;
+  static constexpr std::size_t SRC_LOW = 12; // low 32 bits of the source address
+
+  std::array<uint8_t, 4> src = { 10, 0, 0, 1 };
+  std::array<uint8_t, 4> dst = { 10, 0, 0, 2 };
+  uint8_t ttl = 64;
+
+  void write( uint8_t *p, uint8_t proto, std::size_t payload ) const
+  {
+    std::memset( p, 0, SIZE );
+    p[0] = 0x45;
+    put16( p + 2, static_cast<uint16_t>( SIZE + payload ) );
+    put16( p + 6, 0x4000 ); // DF
+    p[8] = ttl;
+    p[9] = proto;
+    std::memcpy( p + 12, src.data(), 4 );
+    std::memcpy( p + 16, dst.data(), 4 );
+    put16( p + CHECKSUM, Checksum::finish( Checksum::add( p, SIZE ) ) );
+  }
+
+  uint32_t pseudo_sum( uint8_t proto, std::size_t len ) const
+  {
+    uint32_t sum = Checksum::add( src.data(), 4 );
+    sum = Checksum::add( dst.data(), 4, sum );
+    return sum + proto + static_cast<uint32_t>( len );
+  }
+};
+
+struct IPv6
+{
+  static constexpr std::size_t SIZE = 40;
+  static constexpr uint16_t ETHERTYPE = 0x86dd;
+  static constexpr bool HAS_CHECKSUM = false;
+  static constexpr std::size_t SRC_LOW = 20;
+
+  std::array<uint8_t, 16> src = { 0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+  std::array<uint8_t, 16> dst = { 0xfd, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2 };
+  uint8_t hop_limit = 64;
+
+  void write( uint8_t *p, uint8_t proto, std::size_t payload ) const
+  {
+    std::memset( p, 0, SIZE );
+    p[0] = 0x60;
+    put16( p + 4, static_cast<uint16_t>( payload ) );
+    p[6] = proto;
+    p[7] = hop_limit;
+    std::memcpy( p + 8, src.data(), 16 );
+    std::memcpy( p + 24, dst.data(), 16 );
+  }
+
+  uint32_t pseudo_sum( uint8_t proto, std::size_t len ) const
+  {
+    uint32_t sum = Checksum::add( src.data(), 16 );
+    sum = Checksum::add( dst.data(), 16, sum );
+    return sum + proto + static_cast<uint32_t>( len );
+  }
+};
+
+struct Udp
+{
+  static constexpr std::size_t SIZE = 8;
+  static constexpr uint8_t PROTO = 17;
+  static constexpr std::size_t CHECKSUM = 6;
+
+  uint16_t sport = 1024;
+  uint16_t dport = 9;
+
+  void write( uint8_t *p, std::size_t len ) const
+  {
+    put16( p, sport );
+    put16( p + 2, dport );
+    put16( p + 4, static_cast<uint16_t>( len ) );
+    put16( p + CHECKSUM, 0 );
+  }
+};
+
+struct Tcp
+{
+  static constexpr std::size_t SIZE = 20;
+  static constexpr uint8_t PROTO = 6;
+  static constexpr std::size_t CHECKSUM = 16;
+  static constexpr std::size_t SEQ = 4;
+
+  uint16_t sport = 1024;
+  uint16_t dport = 80;
+  uint32_t seq = 1;
+  uint8_t flags = 0x18; // PSH | ACK
+
+  void write( uint8_t *p, std::size_t ) const
+  {
+    std::memset( p, 0, SIZE );
+    put16( p, sport );
+    put16( p + 2, dport );
+    put32( p + SEQ, seq );
+    p[12] = ( SIZE / 4 ) << 4;
+    p[13] = flags;
+    put16( p + 14, 65535 ); // window
+  }
+};
+
+//! @brief Ethernet [/ 802.1Q] / IPv4|IPv6 / UDP|TCP frames with compile-time header offsets.
+//
+// build() writes a whole frame once, payload and checksums included. patch() then turns it into
+// any flow and packet of the same size by rewriting only the fields that vary, and fixes the IPv4
+// header and L4 checksums incrementally (RFC 1624), so the per-packet cost does not depend on the
+// payload length.
+//
+// Flow `n` uses source port `l4.sport + n % 65536` and adds `n / 65536` to the low 32 bits of the
+// source address.
+//
+template <typename L3, typename L4, typename Tag = NoVlan> class PacketBuilder
+{
+public:
+  static constexpr std::size_t ETH_SIZE = 14;
+  static constexpr std::size_t L3_OFFSET = ETH_SIZE + Tag::SIZE;
+  static constexpr std::size_t L4_OFFSET = L3_OFFSET + L3::SIZE;
+  static constexpr std::size_t HEADER_SIZE = L4_OFFSET + L4::SIZE;
+
+  PacketBuilder( const MacAddress &dst, const MacAddress &src, Tag tag, L3 l3, L4 l4 )
+      : m_dst( dst ),
+        m_src( src ),
+        m_tag( tag ),
+        m_l3( l3 ),
+        m_l4( l4 )
+  {
+  }
+
+  // Writes a complete `len`-byte frame (no FCS) for flow 0; `len` must be at least HEADER_SIZE
+  void build( uint8_t *frame, std::size_t len ) const
+  {
+    std::memcpy( frame, m_dst.data(), 6 );
+    std::memcpy( frame + 6, m_src.data(), 6 );
+    m_tag.write( frame + 12 );
+    put16( frame + 12 + Tag::SIZE, L3::ETHERTYPE );
+
+    const std::size_t l4_len = len - L4_OFFSET;
+    uint8_t *l4 = frame + L4_OFFSET;
+    for ( std::size_t i = HEADER_SIZE; i < len; ++i )
+      frame[i] = static_cast<uint8_t>( i );
+    m_l3.write( frame + L3_OFFSET, L4::PROTO, l4_len );
+    m_l4.write( l4, l4_len );
+
+    uint32_t sum = Checksum::add( l4, l4_len, m_l3.pseudo_sum( L4::PROTO, l4_len ) );
+    uint16_t check = Checksum::finish( sum );
+    if ( check == 0 && std::is_same<L4, Udp>::value ) check = 0xffff; // 0 means "no checksum"
+    put16( l4 + L4::CHECKSUM, check );
+  }
+
+  // Rewrites a frame from build() (or an earlier patch()) as packet `id` of `flow`. `seq` is the
+  // TCP sequence number and ignored for UDP.
+  void patch( uint8_t *frame, uint32_t flow, uint16_t id, uint32_t seq ) const
+  {
+    uint8_t *l3 = frame + L3_OFFSET;
+    uint8_t *l4 = frame + L4_OFFSET;
+    uint8_t *l4_check = l4 + L4::CHECKSUM;
+    const uint32_t src_low = get32( m_l3.src.data() + m_l3.src.size() - 4 ) + ( flow >> 16 );
+
+    Checksum::patch16( l4, static_cast<uint16_t>( m_l4.sport + flow ), l4_check );
+    if constexpr ( L3::HAS_CHECKSUM )
+    {
+      uint8_t *l3_check = l3 + L3::CHECKSUM;
+      Checksum::patch32( l3 + L3::SRC_LOW, src_low, l3_check, l4_check ); // pseudo-header too
+      Checksum::patch16( l3 + L3::ID, id, l3_check );
+    }
+    else
+    {
+      Checksum::patch32( l3 + L3::SRC_LOW, src_low, l4_check );
+      (void)id;
+    }
+    if constexpr ( std::is_same<L4, Tcp>::value )
+      Checksum::patch32( l4 + Tcp::SEQ, seq, l4_check );
+    else
+    {
+      if ( get16( l4_check ) == 0 ) put16( l4_check, 0xffff );
+      (void)seq;
+    }
+  }
+
+private:
+  MacAddress m_dst;
+  MacAddress m_src;
+  Tag m_tag;
+  L3 m_l3;
+  L4 m_l4;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_PACKETBUILDER_HPP
@@ -0,0 +1,172 @@
+#ifndef LOOPBACK_PACKETPIPELINE_HPP
+#define LOOPBACK_PACKETPIPELINE_HPP
+
+#include <Loopback/BoundedQueue.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Usage:
+//
+// #include <Loopback/PacketPipeline.hpp>
+// RxSource source( ... );                                  // see "Source" below
+// Loopback::BoundedQueue<RxSource::Item> queue( 4096, Loopback::OverflowPolicy::Block );
+// TxSink sink( ... );                                      // see "Sink" below
+// using Pipeline = Loopback::PacketPipeline<RxSource, decltype( queue ), TxSink>;
+// Pipeline pipeline( source, queue, sink, 64 );            // batches of up to 64
+// std::thread rx( [&] { pipeline.ingress(); } ), tx( [&] { pipeline.egress(); } );
+
+namespace Loopback {
+
+//! @brief Probe that observes nothing; every hook inlines away.
+struct NullProbe
+{
+  template <typename Item> void received( Item *, std::size_t ) {}
+  template <typename Item> void dropped( Item & ) {}
+  template <typename Item> void dequeued( Item *, std::size_t ) {}
+  void sent( std::size_t ) {}
+};
+
+namespace detail {
+
+template <typename Queue, typename Item, typename = void> struct HasPushBulk : std::false_type
+{
+};
+
+template <typename Queue, typename Item>
+struct HasPushBulk<
+    Queue,
+    Item,
+    std::void_t<decltype( std::declval<Queue &>().push_bulk( std::declval<Item *>(), 0 ) )>>
+    : std::true_type
+{
+};
+
+} // namespace detail
+
+//! @brief ingress -> bounded queue -> egress loop shared by every Loopback app.
+//
+// The backends are template parameters, so each combination is its own instantiation: no
+// virtual calls, and no per-packet test of which backend is in use. Front-ends pick the
+// combination once at startup and run ingress() and egress() on threads of their choice.
+//
+// Source   using Item = ...;
+//          std::size_t receive( Item *items, std::size_t max )  fill up to `max`, 0 is fine
+//          bool done() const              true once exhausted or stopped (checked after a push)
+//          void reject( Item &item )      an item the queue did not keep (free it, recycle it)
+// Queue    item-wise, like BoundedQueue:   Push push( Item & ), bool pop( Item & ),
+//                                          bool try_pop( Item & ), void stop()
+//          or batch-wise, like SpscRing:  std::size_t push_bulk( Item *, n ) returning the
+//                                          number dropped, which are the last ones of the batch;
+//                                          pop_bulk( Item *, max ), try_pop_bulk( Item *, max ),
+//                                          void stop()
+// Sink     void send( Item *items, std::size_t n )  consumes a batch
+//          void flush()                   egress is about to block on an empty queue
+//          void close()                   the queue is closed and drained
+// Probe    received( items, n ) before the push, dropped( item ) per item the queue did not
+//          keep (still valid: called before Source::reject() frees or recycles it),
+//          dequeued( items, n ) before send(), sent( n ) after it; see NullProbe
+//
+template <typename Source, typename Queue, typename Sink, typename Probe = NullProbe>
+class PacketPipeline
+{
+public:
+  using Item = typename Source::Item;
+
+  PacketPipeline( Source &source, Queue &queue, Sink &sink, std::size_t batch, Probe probe = {} )
+      : m_source( source ),
+        m_queue( queue ),
+        m_sink( sink ),
+        m_batch( batch ? batch : 1 ),
+        m_probe( std::move( probe ) )
+  {
+  }
+
+  // Ingress thread: runs until the source is done, then stops the queue
+  void ingress()
+  {
+    std::vector<Item> items( m_batch );
+    do
+    {
+      std::size_t n = m_source.receive( items.data(), items.size() );
+      if ( n ) push( items.data(), n );
+    } while ( !m_source.done() );
+    m_queue.stop();
+  }
+
+  // Egress thread: runs until the queue is stopped and drained
+  void egress()
+  {
+    std::vector<Item> items( m_batch );
+    while ( std::size_t n = pop( items.data(), items.size() ) )
+    {
+      m_probe.dequeued( items.data(), n );
+      m_sink.send( items.data(), n );
+      m_probe.sent( n );
+    }
+    m_sink.close();
+  }
+
+  Probe &probe() { return m_probe; }
+
+private:
+  static constexpr bool BATCH_QUEUE = detail::HasPushBulk<Queue, Item>::value;
+
+  void push( Item *items, std::size_t n )
+  {
+    m_probe.received( items, n );
+    if constexpr ( BATCH_QUEUE )
+    {
+      for ( std::size_t i = n - m_queue.push_bulk( items, n ); i < n; ++i )
+        reject( items[i] );
+    }
+    else
+    {
+      // with swap semantics a dropped or evicted item comes back in items[i]
+      for ( std::size_t i = 0; i < n; ++i )
+        if ( m_queue.push( items[i] ) != Push::Queued ) reject( items[i] );
+    }
+  }
+
+  void reject( Item &item )
+  {
+    m_probe.dropped( item ); // first: the source may free the item
+    m_source.reject( item );
+  }
+
+  // Whatever is queued, up to `max`; flushes the sink before blocking on an empty queue
+  std::size_t pop( Item *items, std::size_t max )
+  {
+    if constexpr ( BATCH_QUEUE )
+    {
+      std::size_t n = m_queue.try_pop_bulk( items, max );
+      if ( n ) return n;
+      m_sink.flush();
+      return m_queue.pop_bulk( items, max );
+    }
+    else
+    {
+      if ( !m_queue.try_pop( items[0] ) )
+      {
+        m_sink.flush();
+        if ( !m_queue.pop( items[0] ) ) return 0;
+      }
+      std::size_t n = 1;
+      while ( n < max && m_queue.try_pop( items[n] ) )
+        ++n;
+      return n;
+    }
+  }
+
+  Source &m_source;
+  Queue &m_queue;
+  Sink &m_sink;
+  const std::size_t m_batch;
+  Probe m_probe;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_PACKETPIPELINE_HPP
@@ -0,0 +1,113 @@
+#ifndef LOOPBACK_PACKETPOOL_HPP
+#define LOOPBACK_PACKETPOOL_HPP
+
+#include <Loopback/SpscRing.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Usage:
+//
+// #include <Loopback/PacketPool.hpp>
+// Loopback::PacketPool<pcap_pkthdr> pool( 4096, snaplen );
+//
+// ingress: auto h = pool.acquire();  memcpy( pool.data( h ), pkt, len );  queue.push( h );
+// egress:  queue.pop( h );  send( pool.data( h ) );  pool.release( h );
+
+namespace Loopback {
+
+//! @brief Fixed-size slab of packet buffers recycled through a free list.
+//
+// One contiguous arena holds `slots` cache-line aligned slots, each a `Header` followed by
+// `slot_size` bytes of packet data. Only 32-bit handles are passed around, so a packet is copied
+// once into its slot and never again until it is released.
+//
+// The free list is an SpscRing of handles: exactly one thread acquires (ingress) and exactly one
+// thread releases (egress). High-water and exhaustion counters are only written by the acquiring
+// thread.
+//
+template <typename Header> class PacketPool
+{
+public:
+  using Handle = uint32_t;
+
+  struct Stats
+  {
+    uint32_t slots;
+    uint32_t high_water; // most slots in use at once
+    uint64_t exhausted;  // times acquire() found the free list empty
+  };
+
+  PacketPool( uint32_t slots, uint32_t slot_size, WaitStrategy wait = WaitStrategy{} )
+      : m_slots( slots ),
+        m_slot_size( slot_size ),
+        m_stride( stride_for( slot_size ) ),
+        m_free( slots, wait )
+  {
+    // pages are only touched as slots are written, so small packets don't fault in the full slab
+    m_arena = static_cast<uint8_t *>( std::aligned_alloc( CACHE_LINE_SIZE, m_stride * slots ) );
+    if ( !m_arena ) throw std::bad_alloc();
+
+    std::vector<Handle> all( slots );
+    for ( Handle h = 0; h < slots; ++h )
+      all[h] = h;
+    m_free.try_push_bulk( all.data(), all.size() );
+  }
+
+  ~PacketPool() { std::free( m_arena ); }
+
+  PacketPool( const PacketPool & ) = delete;
+  PacketPool &operator=( const PacketPool & ) = delete;
+
+  uint32_t slot_size() const { return m_slot_size; }
+
+  Header &header( Handle h ) { return *reinterpret_cast<Header *>( slot( h ) ); }
+  uint8_t *data( Handle h ) { return slot( h ) + sizeof( Header ); }
+
+  // Acquiring thread: blocks while the pool is exhausted. Returns false once the pool is closed.
+  bool acquire( Handle &h )
+  {
+    if ( m_free.try_pop_bulk( &h, 1 ) == 0 )
+    {
+      ++m_exhausted;
+      if ( m_free.pop_bulk( &h, 1 ) == 0 ) return false;
+    }
+    uint32_t in_use = m_slots - static_cast<uint32_t>( m_free.size_approx() );
+    if ( in_use > m_high_water ) m_high_water = in_use;
+    return true;
+  }
+
+  // Releasing thread: hand a slot back to the free list
+  void release( Handle h ) { m_free.try_push_bulk( &h, 1 ); }
+
+  // Wake an acquirer blocked on an empty free list
+  void close() { m_free.close(); }
+
+  // Only consistent once both threads have stopped
+  Stats stats() const { return Stats{ m_slots, m_high_water, m_exhausted }; }
+
+private:
+  static std::size_t stride_for( uint32_t slot_size )
+  {
+    std::size_t raw = sizeof( Header ) + slot_size;
+    return ( raw + CACHE_LINE_SIZE - 1 ) & ~( CACHE_LINE_SIZE - 1 );
+  }
+
+  uint8_t *slot( Handle h ) { return m_arena + static_cast<std::size_t>( h ) * m_stride; }
+
+  uint32_t m_slots;
+  uint32_t m_slot_size;
+  std::size_t m_stride;
+  uint8_t *m_arena = nullptr;
+  SpscRing<Handle> m_free;
+
+  // acquiring thread only
+  uint32_t m_high_water = 0;
+  uint64_t m_exhausted = 0;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_PACKETPOOL_HPP
@@ -0,0 +1,330 @@
+#ifndef LOOPBACK_PACKETSENDER_HPP
+#define LOOPBACK_PACKETSENDER_HPP
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// Usage:
+//
+// #include <Loopback/PacketSender.hpp>
+// Loopback::PacketSender tx( "veth1", Loopback::PacketSender::Options{} );
+// tx.send( data, len );   // queued, sent when the batch fills or the flush deadline passes
+// tx.flush();             // push out whatever is pending (e.g. before blocking on an empty queue)
+
+namespace Loopback {
+
+//! @brief Batched live egress over an AF_PACKET socket.
+//
+// Packets are copied into the sender's own frames, so callers may reuse their buffers as soon as
+// send() returns. A batch goes out when `batch` packets are pending, when flush_if_due() finds
+// the oldest pending packet older than `flush_deadline`, or on an explicit flush().
+//
+// - Mode::Sendmmsg: one sendmmsg(2) per batch.
+// - Mode::TxRing: frames are written into a PACKET_TX_RING (TPACKET_V2) mapping and one
+//   sendto(2) kicks the kernel to transmit every pending frame.
+//
+// Failures are counted per batch instead of being reported per packet.
+//
+class PacketSender
+{
+public:
+  enum class Mode
+  {
+    Sendmmsg,
+    TxRing
+  };
+
+  struct Options
+  {
+    Mode mode = Mode::Sendmmsg;
+    uint32_t batch = 64;
+    uint32_t frame_size = 2048; // largest packet sent; bigger ones are counted as oversize
+    uint32_t ring_frames = 4096;
+    std::chrono::microseconds flush_deadline{ 100 };
+    bool qdisc_bypass = false; // PACKET_QDISC_BYPASS: skip the qdisc layer
+  };
+
+  struct Stats
+  {
+    uint64_t packets = 0;         // handed to the kernel successfully
+    uint64_t bytes = 0;
+    uint64_t batches = 0;         // sendmmsg/sendto kicks
+    uint64_t partial_batches = 0; // batches where at least one packet failed
+    uint64_t failed = 0;          // packets rejected by the kernel
+    uint64_t oversize = 0;        // packets larger than frame_size, never sent
+    int last_errno = 0;
+  };
+
+  PacketSender( const std::string &ifname, const Options &opts )
+      : m_opts( opts )
+  {
+    if ( m_opts.batch == 0 ) m_opts.batch = 1;
+    m_fd = ::socket( AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons( ETH_P_ALL ) );
+    if ( m_fd < 0 ) fail( "socket(AF_PACKET)" );
+
+    if ( m_opts.qdisc_bypass )
+    {
+      int one = 1;
+      if ( ::setsockopt( m_fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof( one ) ) != 0 )
+        fail( "PACKET_QDISC_BYPASS" );
+    }
+
+    if ( m_opts.mode == Mode::TxRing )
+      setup_tx_ring();
+    else
+      setup_sendmmsg();
+
+    struct sockaddr_ll addr;
+    std::memset( &addr, 0, sizeof( addr ) );
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons( ETH_P_ALL );
+    addr.sll_ifindex = static_cast<int>( ::if_nametoindex( ifname.c_str() ) );
+    if ( addr.sll_ifindex == 0 ) fail( ifname.c_str() ); // errno is ENODEV
+    if ( ::bind( m_fd, reinterpret_cast<struct sockaddr *>( &addr ), sizeof( addr ) ) != 0 )
+      fail( "bind" );
+  }
+
+  ~PacketSender()
+  {
+    if ( m_fd >= 0 ) flush();
+    release();
+  }
+
+  PacketSender( const PacketSender & ) = delete;
+  PacketSender &operator=( const PacketSender & ) = delete;
+
+  void send( const uint8_t *data, uint32_t len )
+  {
+    if ( len > m_max_len )
+    {
+      ++m_stats.oversize;
+      return;
+    }
+    if ( m_pending == 0 ) m_first_pending = Clock::now();
+
+    if ( m_opts.mode == Mode::TxRing )
+      queue_tx_ring( data, len );
+    else
+    {
+      std::memcpy( m_iov[m_pending].iov_base, data, len );
+      m_iov[m_pending].iov_len = len;
+    }
+
+    if ( ++m_pending >= m_opts.batch ) flush();
+  }
+
+  void flush_if_due()
+  {
+    if ( m_pending && Clock::now() - m_first_pending >= m_opts.flush_deadline ) flush();
+  }
+
+  void flush()
+  {
+    if ( m_pending == 0 ) return;
+    if ( m_opts.mode == Mode::TxRing )
+      flush_tx_ring();
+    else
+      flush_sendmmsg();
+    m_pending = 0;
+  }
+
+  // Only consistent once the sending thread has stopped
+  const Stats &stats() const { return m_stats; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  void setup_sendmmsg()
+  {
+    m_max_len = m_opts.frame_size;
+    m_slab.resize( static_cast<std::size_t>( m_opts.batch ) * m_opts.frame_size );
+    m_iov.resize( m_opts.batch );
+    m_msgs.resize( m_opts.batch );
+    for ( uint32_t i = 0; i < m_opts.batch; ++i )
+    {
+      m_iov[i].iov_base = m_slab.data() + static_cast<std::size_t>( i ) * m_opts.frame_size;
+      std::memset( &m_msgs[i], 0, sizeof( m_msgs[i] ) );
+      m_msgs[i].msg_hdr.msg_iov = &m_iov[i];
+      m_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+  }
+
+  void setup_tx_ring()
+  {
+    int version = TPACKET_V2;
+    if ( ::setsockopt( m_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof( version ) ) != 0 )
+      fail( "PACKET_VERSION" );
+
+    // frames must be TPACKET_ALIGNMENT aligned and a block must hold a whole number of them
+    m_data_offset = TPACKET2_HDRLEN - sizeof( struct sockaddr_ll );
+    uint32_t frame = 1;
+    while ( frame < m_opts.frame_size + m_data_offset )
+      frame <<= 1;
+    long page = ::sysconf( _SC_PAGESIZE );
+    uint32_t block = std::max<uint32_t>( frame, page > 0 ? static_cast<uint32_t>( page ) : 4096 );
+    uint32_t per_block = block / frame;
+
+    struct tpacket_req req;
+    std::memset( &req, 0, sizeof( req ) );
+    req.tp_block_size = block;
+    req.tp_block_nr = ( std::max( m_opts.ring_frames, m_opts.batch ) + per_block - 1 ) / per_block;
+    req.tp_frame_size = frame;
+    req.tp_frame_nr = req.tp_block_nr * per_block;
+    if ( ::setsockopt( m_fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof( req ) ) != 0 )
+      fail( "PACKET_TX_RING" );
+
+    m_frame_size = frame;
+    m_frame_count = req.tp_frame_nr;
+    m_max_len = m_opts.frame_size;
+    m_map_len = static_cast<std::size_t>( block ) * req.tp_block_nr;
+    void *map = ::mmap( nullptr, m_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+    if ( map == MAP_FAILED ) fail( "mmap(PACKET_TX_RING)" );
+    m_ring = static_cast<uint8_t *>( map );
+  }
+
+  struct tpacket2_hdr *frame( uint32_t index )
+  {
+    return reinterpret_cast<struct tpacket2_hdr *>(
+        m_ring + static_cast<std::size_t>( index ) * m_frame_size );
+  }
+
+  static uint32_t frame_status( struct tpacket2_hdr *hdr )
+  {
+    return __atomic_load_n( &hdr->tp_status, __ATOMIC_ACQUIRE );
+  }
+
+  void queue_tx_ring( const uint8_t *data, uint32_t len )
+  {
+    struct tpacket2_hdr *hdr = frame( m_tx_index );
+    uint32_t status = frame_status( hdr );
+    if ( status == TP_STATUS_SEND_REQUEST || status == TP_STATUS_SENDING )
+    {
+      // ring wrapped onto frames the kernel still owns: kick them out and wait for space
+      flush();
+      m_first_pending = Clock::now();
+      struct pollfd pfd = { m_fd, POLLOUT, 0 };
+      while ( ( status = frame_status( hdr ) ) == TP_STATUS_SEND_REQUEST ||
+              status == TP_STATUS_SENDING )
+        ::poll( &pfd, 1, 1 );
+    }
+    if ( status == TP_STATUS_WRONG_FORMAT )
+    {
+      ++m_stats.failed;
+      m_tx_failed_in_batch = true;
+    }
+
+    std::memcpy( reinterpret_cast<uint8_t *>( hdr ) + m_data_offset, data, len );
+    hdr->tp_len = len;
+    hdr->tp_snaplen = len;
+    __atomic_store_n( &hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE );
+    m_tx_bytes += len;
+    m_tx_index = ( m_tx_index + 1 ) % m_frame_count;
+  }
+
+  void flush_tx_ring()
+  {
+    ++m_stats.batches;
+    ssize_t ret;
+    do
+    {
+      ret = ::sendto( m_fd, nullptr, 0, 0, nullptr, 0 ); // blocks until pending frames are sent
+    } while ( ret < 0 && errno == EINTR );
+
+    if ( ret < 0 )
+    {
+      m_stats.last_errno = errno;
+      m_stats.failed += m_pending;
+      m_tx_failed_in_batch = true;
+    }
+    else
+    {
+      m_stats.packets += m_pending;
+      m_stats.bytes += m_tx_bytes;
+    }
+    if ( m_tx_failed_in_batch ) ++m_stats.partial_batches;
+    m_tx_failed_in_batch = false;
+    m_tx_bytes = 0;
+  }
+
+  void flush_sendmmsg()
+  {
+    ++m_stats.batches;
+    bool partial = false;
+    uint32_t off = 0;
+    while ( off < m_pending )
+    {
+      int ret = ::sendmmsg( m_fd, &m_msgs[off], m_pending - off, 0 );
+      if ( ret < 0 )
+      {
+        if ( errno == EINTR ) continue;
+        // the first remaining packet was rejected: count it and carry on with the rest
+        m_stats.last_errno = errno;
+        ++m_stats.failed;
+        ++off;
+        partial = true;
+        continue;
+      }
+      for ( int i = 0; i < ret; ++i )
+        m_stats.bytes += m_iov[off + i].iov_len;
+      m_stats.packets += ret;
+      off += ret;
+    }
+    if ( partial ) ++m_stats.partial_batches;
+  }
+
+  [[noreturn]] void fail( const char *what )
+  {
+    std::string msg = std::string( what ) + ": " + std::strerror( errno );
+    release();
+    throw std::runtime_error( msg );
+  }
+
+  void release()
+  {
+    if ( m_ring ) ::munmap( m_ring, m_map_len );
+    if ( m_fd >= 0 ) ::close( m_fd );
+    m_ring = nullptr;
+    m_fd = -1;
+  }
+
+  Options m_opts;
+  int m_fd = -1;
+  uint32_t m_max_len = 0;
+  uint32_t m_pending = 0;
+  Clock::time_point m_first_pending;
+  Stats m_stats;
+
+  // Mode::Sendmmsg
+  std::vector<uint8_t> m_slab;
+  std::vector<struct iovec> m_iov;
+  std::vector<struct mmsghdr> m_msgs;
+
+  // Mode::TxRing
+  uint8_t *m_ring = nullptr;
+  std::size_t m_map_len = 0;
+  uint32_t m_frame_size = 0;
+  uint32_t m_frame_count = 0;
+  uint32_t m_data_offset = 0;
+  uint32_t m_tx_index = 0;
+  uint64_t m_tx_bytes = 0;
+  bool m_tx_failed_in_batch = false;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_PACKETSENDER_HPP
@@ -0,0 +1,251 @@
+#ifndef LOOPBACK_PCAPSINKS_HPP
+#define LOOPBACK_PCAPSINKS_HPP
+
+#include <Logging/BasicLogController.hpp>
+#include <Logging/EventLog.hpp>
+#include <Loopback/Pacer.hpp>
+#include <Loopback/PacketSender.hpp>
+#include <Loopback/Telemetry.hpp>
+#include <Loopback/UringPcapWriter.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <pcap/pcap.h>
+#include <string>
+#include <utility>
+
+// Usage:
+//
+// #include <Loopback/PcapSinks.hpp>
+// Loopback::PcapEgress egress{ handle, dumper, writer, sender, pacer, stage };
+// Loopback::with_pcap_sink( egress, access, [&]( auto &sink ) {
+//   Loopback::PacketPipeline<Source, Queue, std::decay_t<decltype( sink )>> p( src, q, sink, 64 );
+//   ...
+// } );
+
+namespace Loopback {
+
+// Egress sinks for Loopback::PacketPipeline, one type per backend. `Access` maps the pipeline's
+// item type onto a pcap record and says what happens to an item once it has been written:
+//
+//   const struct pcap_pkthdr &header( const Item & )
+//   const u_char *data( const Item & )
+//   void done( Item & )                 e.g. release a pool slot, nothing for owning packets
+
+//! @brief pcap file via libpcap (--writer libpcap)
+template <typename Access> class PcapDumpSink
+{
+public:
+  PcapDumpSink( pcap_dumper_t *dumper, Access access )
+      : m_dumper( dumper ),
+        m_access( std::move( access ) )
+  {
+  }
+
+  template <typename Item> void send( Item *items, std::size_t n )
+  {
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+      pcap_dump( (u_char *)m_dumper, &m_access.header( items[i] ), m_access.data( items[i] ) );
+      m_access.done( items[i] );
+    }
+  }
+
+  void flush() {}
+  void close() {}
+
+private:
+  pcap_dumper_t *m_dumper;
+  Access m_access;
+};
+
+//! @brief pcap file via io_uring. A failed write is reported once, later packets are discarded
+//! so the pipeline keeps draining.
+template <typename Access> class UringSink
+{
+public:
+  UringSink( UringPcapWriter &writer, Access access )
+      : m_writer( writer ),
+        m_access( std::move( access ) )
+  {
+  }
+
+  template <typename Item> void send( Item *items, std::size_t n )
+  {
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+      if ( !m_failed && !m_writer.write( m_access.header( items[i] ), m_access.data( items[i] ) ) )
+      {
+        std::cerr << "Egress write error: " << m_writer.error() << std::endl;
+        m_failed = true;
+      }
+      m_access.done( items[i] );
+    }
+  }
+
+  void flush() {}
+  void close() {}
+
+private:
+  UringPcapWriter &m_writer;
+  Access m_access;
+  bool m_failed = false;
+};
+
+//! @brief live device via sendmmsg / PACKET_TX_RING (PacketSender copies, items are done at once)
+template <typename Access> class SenderSink
+{
+public:
+  SenderSink( PacketSender &sender, Access access )
+      : m_sender( sender ),
+        m_access( std::move( access ) )
+  {
+  }
+
+  template <typename Item> void send( Item *items, std::size_t n )
+  {
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+      m_sender.send( m_access.data( items[i] ), m_access.header( items[i] ).caplen );
+      m_access.done( items[i] );
+    }
+    m_sender.flush_if_due();
+  }
+
+  void flush() { m_sender.flush(); }
+  void close() { m_sender.flush(); }
+
+private:
+  PacketSender &m_sender;
+  Access m_access;
+};
+
+//! @brief live device via pcap_sendpacket (--egress-backend libpcap). Failed sends are counted
+//! as drops of the egress telemetry stage, logged at most 10 times a second and summarised on
+//! close().
+template <typename Access> class PcapSendSink
+{
+public:
+  PcapSendSink( pcap_t *handle, Access access, Telemetry::Stage *stage )
+      : m_handle( handle ),
+        m_access( std::move( access ) ),
+        m_stage( stage )
+  {
+  }
+
+  template <typename Item> void send( Item *items, std::size_t n )
+  {
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+      const struct pcap_pkthdr &hdr = m_access.header( items[i] );
+      if ( pcap_sendpacket( m_handle, m_access.data( items[i] ), hdr.caplen ) != 0 )
+      {
+        ++m_errors;
+        m_last_error = pcap_geterr( m_handle );
+        if ( m_stage ) m_stage->add_drops( 1 );
+        EVENTLOG( "egress send failed len={}", hdr.caplen );
+        LOGGING_WARN_RATE_LIMITED(
+            spdlog::default_logger_raw(), 10, "Egress send failed: {}", m_last_error );
+      }
+      m_access.done( items[i] );
+    }
+  }
+
+  void flush() {}
+
+  void close()
+  {
+    if ( m_errors )
+    {
+      std::cerr << "Egress send errors: " << m_errors << " (last: " << m_last_error << ")"
+                << std::endl;
+    }
+  }
+
+private:
+  pcap_t *m_handle;
+  Access m_access;
+  Telemetry::Stage *m_stage;
+  uint64_t m_errors = 0;
+  std::string m_last_error;
+};
+
+//! @brief Releases every packet at its Pacer deadline, then hands it to `Sink` on its own.
+//
+// Before waiting out a gap the inner sink is flushed, so packets batched by PacketSender leave
+// on time; for the file sinks flush() is empty and compiles away.
+template <typename Sink, typename Access> class PacedSink
+{
+public:
+  PacedSink( Pacer &pacer, Sink sink, Access access )
+      : m_pacer( pacer ),
+        m_sink( std::move( sink ) ),
+        m_access( std::move( access ) )
+  {
+  }
+
+  template <typename Item> void send( Item *items, std::size_t n )
+  {
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+      uint64_t due = m_pacer.schedule( m_access.header( items[i] ) );
+      if ( !m_pacer.reached( due ) ) m_sink.flush(); // earlier packets go out on time
+      m_pacer.wait( due );
+      m_sink.send( &items[i], 1 );
+    }
+  }
+
+  void flush() { m_sink.flush(); }
+  void close() { m_sink.close(); }
+
+private:
+  Pacer &m_pacer;
+  Sink m_sink;
+  Access m_access;
+};
+
+// Where egress packets go: exactly one of handle/dumper/writer/sender is set
+struct PcapEgress
+{
+  pcap_t *handle = nullptr;          // live device via pcap_sendpacket
+  pcap_dumper_t *dumper = nullptr;   // pcap file via libpcap
+  UringPcapWriter *writer = nullptr; // pcap file via io_uring
+  PacketSender *sender = nullptr;    // live device via sendmmsg / PACKET_TX_RING
+  Pacer *pacer = nullptr;            // optional: release packets on a schedule
+  Telemetry::Stage *stage = nullptr; // optional: counts failed pcap_sendpacket calls as drops
+};
+
+template <typename Sink, typename Access, typename Fn>
+void with_pacing( Pacer *pacer, Sink sink, const Access &access, Fn &&fn )
+{
+  if ( pacer )
+  {
+    PacedSink<Sink, Access> paced( *pacer, std::move( sink ), access );
+    fn( paced );
+  }
+  else
+    fn( sink );
+}
+
+// Calls fn( sink ) with the sink type matching `egress`: the backend is picked once here rather
+// than tested for every packet.
+template <typename Access, typename Fn>
+void with_pcap_sink( const PcapEgress &egress, const Access &access, Fn &&fn )
+{
+  if ( egress.writer )
+    with_pacing( egress.pacer, UringSink<Access>( *egress.writer, access ), access, fn );
+  else if ( egress.dumper )
+    with_pacing( egress.pacer, PcapDumpSink<Access>( egress.dumper, access ), access, fn );
+  else if ( egress.sender )
+    with_pacing( egress.pacer, SenderSink<Access>( *egress.sender, access ), access, fn );
+  else
+  {
+    with_pacing(
+        egress.pacer, PcapSendSink<Access>( egress.handle, access, egress.stage ), access, fn );
+  }
+}
+
+} // namespace Loopback
+
+#endif // LOOPBACK_PCAPSINKS_HPP
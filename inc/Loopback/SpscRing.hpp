@@ -0,0 +1,252 @@
+#ifndef LOOPBACK_SPSCRING_HPP
+#define LOOPBACK_SPSCRING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#endif
+
+// Usage:
+//
+// #include <Loopback/SpscRing.hpp>
+// Loopback::SpscRing<Packet> ring( 4096, Loopback::WaitStrategy{} );
+//
+// producer: ring.push_bulk( batch.data(), n );   ring.close();
+// consumer: while ( ( n = ring.pop_bulk( batch.data(), batch.size() ) ) ) { ... }
+
+namespace Loopback {
+
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+inline void cpu_relax()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+  _mm_pause();
+#endif
+}
+
+//! @brief How a blocked producer/consumer waits: busy-spin, then yield, then park.
+//
+// Parking sleeps on a condition variable until the other side signals or `park_timeout` elapses,
+// so a stalled peer costs at most one timeout of latency.
+struct WaitStrategy
+{
+  uint32_t spin_iterations = 1024;
+  uint32_t yield_iterations = 64;
+  std::chrono::microseconds park_timeout{ 100 };
+};
+
+//! @brief Sleep/wake handshake for one waiting thread.
+//
+// The waker only touches the mutex when the waiter has announced itself, so the common
+// (nobody parked) path is a fence plus one relaxed load.
+class Parker
+{
+public:
+  template <typename Ready> void park( Ready ready, std::chrono::microseconds timeout )
+  {
+    std::unique_lock<std::mutex> lock( m_mutex );
+    m_waiting.store( true, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( !ready() ) m_cond.wait_for( lock, timeout );
+    m_waiting.store( false, std::memory_order_relaxed );
+  }
+
+  void unpark()
+  {
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( m_waiting.load( std::memory_order_relaxed ) )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      m_cond.notify_one();
+    }
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::atomic<bool> m_waiting{ false };
+};
+
+template <typename Ready> void wait_until( Ready ready, Parker &parker, const WaitStrategy &ws )
+{
+  for ( uint32_t i = 0; i < ws.spin_iterations; ++i )
+  {
+    if ( ready() ) return;
+    cpu_relax();
+  }
+  for ( uint32_t i = 0; i < ws.yield_iterations; ++i )
+  {
+    if ( ready() ) return;
+    std::this_thread::yield();
+  }
+  while ( !ready() )
+    parker.park( ready, ws.park_timeout );
+}
+
+//! @brief Bounded lock-free single-producer/single-consumer ring.
+//
+// - Capacity is rounded up to a power of two so indices wrap with a mask.
+// - Producer and consumer indices live on separate cache lines, each side keeps a cached copy
+//   of the other's index and only reloads it when the ring looks full/empty.
+// - Elements are exchanged with the slot contents (std::swap) rather than copied, so heap
+//   storage owned by `T` (e.g. a packet's std::vector) circulates between the two threads
+//   instead of being reallocated per packet.
+//
+template <typename T> class SpscRing
+{
+public:
+  explicit SpscRing( std::size_t capacity, WaitStrategy wait = WaitStrategy{} )
+      : m_wait( wait )
+  {
+    std::size_t size = 2;
+    while ( size < capacity )
+      size <<= 1;
+    m_slots.resize( size );
+    m_mask = size - 1;
+  }
+
+  SpscRing( const SpscRing & ) = delete;
+  SpscRing &operator=( const SpscRing & ) = delete;
+
+  std::size_t capacity() const { return m_mask + 1; }
+
+  std::size_t size_approx() const
+  {
+    return m_head.value.load( std::memory_order_acquire ) -
+           m_tail.value.load( std::memory_order_acquire );
+  }
+
+  bool closed() const { return m_closed.load( std::memory_order_acquire ); }
+
+  // Producer: push up to `n` items without blocking, returns the number pushed
+  std::size_t try_push_bulk( T *items, std::size_t n )
+  {
+    const std::size_t head = m_head.value.load( std::memory_order_relaxed );
+    std::size_t free_slots = capacity() - ( head - m_producer.cached_tail );
+    if ( free_slots < n )
+    {
+      m_producer.cached_tail = m_tail.value.load( std::memory_order_acquire );
+      free_slots = capacity() - ( head - m_producer.cached_tail );
+    }
+    if ( n > free_slots ) n = free_slots;
+    if ( n == 0 ) return 0;
+
+    for ( std::size_t i = 0; i < n; ++i )
+      std::swap( m_slots[( head + i ) & m_mask], items[i] );
+    m_head.value.store( head + n, std::memory_order_release );
+    m_not_empty.unpark();
+    return n;
+  }
+
+  // Producer: push all `n` items, waiting for space. Returns less than `n` only if closed.
+  std::size_t push_bulk( T *items, std::size_t n )
+  {
+    std::size_t done = 0;
+    while ( done < n )
+    {
+      done += try_push_bulk( items + done, n - done );
+      if ( done == n || closed() ) break;
+      wait_until( [this] { return has_space() || closed(); }, m_not_full, m_wait );
+    }
+    return done;
+  }
+
+  // Consumer: pop up to `max` items without blocking, returns the number popped
+  std::size_t try_pop_bulk( T *out, std::size_t max )
+  {
+    const std::size_t tail = m_tail.value.load( std::memory_order_relaxed );
+    std::size_t avail = m_consumer.cached_head - tail;
+    if ( avail < max )
+    {
+      m_consumer.cached_head = m_head.value.load( std::memory_order_acquire );
+      avail = m_consumer.cached_head - tail;
+    }
+    if ( max > avail ) max = avail;
+    if ( max == 0 ) return 0;
+
+    for ( std::size_t i = 0; i < max; ++i )
+      std::swap( out[i], m_slots[( tail + i ) & m_mask] );
+    m_tail.value.store( tail + max, std::memory_order_release );
+    m_not_full.unpark();
+    return max;
+  }
+
+  // Consumer: wait for at least one item. Returns 0 once the ring is closed and drained.
+  std::size_t pop_bulk( T *out, std::size_t max )
+  {
+    while ( true )
+    {
+      std::size_t n = try_pop_bulk( out, max );
+      if ( n ) return n;
+      if ( closed() )
+      {
+        // pick up anything published between the failed pop and the close
+        return try_pop_bulk( out, max );
+      }
+      wait_until( [this] { return has_items() || closed(); }, m_not_empty, m_wait );
+    }
+  }
+
+  // Either side: no more items will be pushed, wake anybody parked
+  void close()
+  {
+    m_closed.store( true, std::memory_order_release );
+    m_not_empty.unpark();
+    m_not_full.unpark();
+  }
+
+private:
+  struct alignas( CACHE_LINE_SIZE ) PaddedIndex
+  {
+    std::atomic<std::size_t> value{ 0 };
+  };
+
+  struct alignas( CACHE_LINE_SIZE ) ProducerCache
+  {
+    std::size_t cached_tail = 0;
+  };
+
+  struct alignas( CACHE_LINE_SIZE ) ConsumerCache
+  {
+    std::size_t cached_head = 0;
+  };
+
+  bool has_space() const
+  {
+    return m_head.value.load( std::memory_order_relaxed ) -
+               m_tail.value.load( std::memory_order_acquire ) <
+           capacity();
+  }
+
+  bool has_items() const
+  {
+    return m_head.value.load( std::memory_order_acquire ) !=
+           m_tail.value.load( std::memory_order_relaxed );
+  }
+
+  PaddedIndex m_head;        // written by producer
+  ProducerCache m_producer;  // producer-private
+  PaddedIndex m_tail;        // written by consumer
+  ConsumerCache m_consumer;  // consumer-private
+  alignas( CACHE_LINE_SIZE ) std::atomic<bool> m_closed{ false };
+
+  std::vector<T> m_slots;
+  std::size_t m_mask = 0;
+  WaitStrategy m_wait;
+  Parker m_not_empty;
+  Parker m_not_full;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_SPSCRING_HPP
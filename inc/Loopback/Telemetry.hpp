@@ -0,0 +1,308 @@
+#ifndef LOOPBACK_TELEMETRY_HPP
+#define LOOPBACK_TELEMETRY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Usage:
+//
+// #include <Loopback/Telemetry.hpp>
+// Loopback::Telemetry telemetry;
+// auto &rx = telemetry.stage( "ingress", Loopback::Telemetry::Role::Ingress );
+// rx.add_packets( n, bytes );                         // owning thread only
+// Loopback::TelemetryReporter reporter( telemetry, std::chrono::seconds( 1 ),
+//                                       []( const std::string &json ) { publish( json ); } );
+
+namespace Loopback {
+
+//! @brief HDR-style latency histogram: 16 linear sub-buckets per power of two (<= 6.25% error).
+//
+// Values below 16 ns are exact, the largest bucket ends at 2^40 ns (about 18 minutes). Written by
+// exactly one thread with relaxed load+store (no locked read-modify-write), read concurrently by
+// the reporter; a snapshot may be a few samples behind, but never torn.
+//
+class LatencyHistogram
+{
+public:
+  static constexpr int SUB_BITS = 4;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+  static constexpr int MAX_EXPONENT = 40;
+  static constexpr int BUCKETS = SUB_BUCKETS + ( MAX_EXPONENT - SUB_BITS ) * SUB_BUCKETS;
+
+  struct Summary
+  {
+    uint64_t count = 0;
+    uint64_t p50 = 0; // upper bound of the bucket, in ns
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0; // upper bound of the highest non-empty bucket
+  };
+
+  using Counts = std::vector<uint64_t>;
+
+  // Owning thread only
+  void record( uint64_t ns ) { bump( m_counts[index( ns )], 1 ); }
+
+  Counts snapshot() const
+  {
+    Counts out( BUCKETS );
+    for ( int i = 0; i < BUCKETS; ++i )
+      out[i] = m_counts[i].load( std::memory_order_relaxed );
+    return out;
+  }
+
+  // Percentiles of the samples recorded between two snapshots
+  static Summary summarize( const Counts &now, const Counts &before )
+  {
+    Summary out;
+    for ( int i = 0; i < BUCKETS; ++i )
+      out.count += now[i] - before[i];
+    if ( out.count == 0 ) return out;
+    out.p50 = percentile( now, before, out.count, 0.5 );
+    out.p99 = percentile( now, before, out.count, 0.99 );
+    out.p999 = percentile( now, before, out.count, 0.999 );
+    for ( int i = BUCKETS - 1; i >= 0; --i )
+    {
+      if ( now[i] != before[i] )
+      {
+        out.max = upper( i );
+        break;
+      }
+    }
+    return out;
+  }
+
+  static int index( uint64_t ns )
+  {
+    if ( ns < SUB_BUCKETS ) return static_cast<int>( ns );
+    int exponent = 63 - __builtin_clzll( ns );
+    if ( exponent >= MAX_EXPONENT ) return BUCKETS - 1;
+    int sub = static_cast<int>( ( ns >> ( exponent - SUB_BITS ) ) & ( SUB_BUCKETS - 1 ) );
+    return SUB_BUCKETS + ( exponent - SUB_BITS ) * SUB_BUCKETS + sub;
+  }
+
+  static uint64_t upper( int index )
+  {
+    if ( index < SUB_BUCKETS ) return index;
+    int exponent = ( index - SUB_BUCKETS ) / SUB_BUCKETS + SUB_BITS;
+    uint64_t sub = ( index - SUB_BUCKETS ) % SUB_BUCKETS;
+    uint64_t width = 1ull << ( exponent - SUB_BITS );
+    return ( SUB_BUCKETS + sub ) * width + width - 1;
+  }
+
+  static void bump( std::atomic<uint64_t> &counter, uint64_t n )
+  {
+    counter.store( counter.load( std::memory_order_relaxed ) + n, std::memory_order_relaxed );
+  }
+
+private:
+  static uint64_t percentile( const Counts &now, const Counts &before, uint64_t count, double p )
+  {
+    uint64_t rank = static_cast<uint64_t>( p * count );
+    uint64_t seen = 0;
+    for ( int i = 0; i < BUCKETS; ++i )
+    {
+      seen += now[i] - before[i];
+      if ( seen > rank ) return upper( i );
+    }
+    return upper( BUCKETS - 1 );
+  }
+
+  std::atomic<uint64_t> m_counts[BUCKETS] = {};
+};
+
+//! @brief Registry of per-thread pipeline counters.
+//
+// Every thread gets its own Stage, each on its own cache lines, and is the only writer of it, so
+// the hot path never writes a line another thread writes. Counters are bumped with relaxed
+// load+store; the reporter reads them without stopping anybody.
+//
+// Queue depth is not sampled on the hot path: it is derived by the reporter as packets queued by
+// ingress stages (received - dropped) minus packets taken off by egress stages.
+//
+class Telemetry
+{
+public:
+  enum class Role
+  {
+    Ingress,
+    Egress
+  };
+
+  struct alignas( 64 ) Stage
+  {
+    Stage( const std::string &stage_name, Role stage_role )
+        : name( stage_name ),
+          role( stage_role )
+    {
+    }
+
+    // Owning thread only
+    void add_packets( uint64_t n, uint64_t nbytes )
+    {
+      LatencyHistogram::bump( packets, n );
+      LatencyHistogram::bump( bytes, nbytes );
+    }
+
+    void add_drops( uint64_t n ) { LatencyHistogram::bump( drops, n ); }
+
+    const std::string name;
+    const Role role;
+    std::atomic<uint64_t> packets{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    std::atomic<uint64_t> drops{ 0 };
+    LatencyHistogram latency; // egress: time packets spent in the queue
+  };
+
+  // Register a stage before its thread starts. The reference stays valid for the registry's life.
+  Stage &stage( const std::string &name, Role role )
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_stages.push_back( std::make_unique<Stage>( name, role ) );
+    return *m_stages.back();
+  }
+
+  template <typename Fn> void for_each( Fn fn ) const
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for ( const auto &s : m_stages )
+      fn( *s );
+  }
+
+private:
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<Stage>> m_stages;
+};
+
+//! @brief Background thread that publishes a Telemetry snapshot as one JSON line per interval.
+//
+// Rates and latency percentiles cover the last interval, counters are totals since start. A last
+// report is published when the reporter is stopped (or destroyed), so short runs still get one.
+//
+class TelemetryReporter
+{
+public:
+  using Publish = std::function<void( const std::string & )>;
+
+  TelemetryReporter( const Telemetry &telemetry,
+                     std::chrono::milliseconds interval,
+                     Publish publish )
+      : m_telemetry( telemetry ),
+        m_interval( interval ),
+        m_publish( std::move( publish ) ),
+        m_start( Clock::now() ),
+        m_last( m_start )
+  {
+    m_thread = std::thread( [this] { run(); } );
+  }
+
+  ~TelemetryReporter() { stop(); }
+
+  TelemetryReporter( const TelemetryReporter & ) = delete;
+  TelemetryReporter &operator=( const TelemetryReporter & ) = delete;
+
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      if ( m_stopped ) return;
+      m_stopped = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Previous
+  {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    LatencyHistogram::Counts latency = LatencyHistogram::Counts( LatencyHistogram::BUCKETS );
+  };
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock( m_mutex );
+    while ( !m_cond.wait_for( lock, m_interval, [this] { return m_stopped; } ) )
+    {
+      lock.unlock();
+      m_publish( report() );
+      lock.lock();
+    }
+    lock.unlock();
+    m_publish( report() );
+  }
+
+  std::string report()
+  {
+    Clock::time_point now = Clock::now();
+    double secs = std::chrono::duration<double>( now - m_last ).count();
+    m_last = now;
+
+    std::ostringstream out;
+    out << "{\"uptime_ms\":"
+        << std::chrono::duration_cast<std::chrono::milliseconds>( now - m_start ).count()
+        << ",\"interval_ms\":" << static_cast<uint64_t>( secs * 1000 ) << ",\"stages\":[";
+    int64_t depth = 0;
+    size_t i = 0;
+    m_telemetry.for_each( [&]( const Telemetry::Stage &s ) {
+      if ( i == m_previous.size() ) m_previous.emplace_back();
+      Previous &prev = m_previous[i];
+      uint64_t packets = s.packets.load( std::memory_order_relaxed );
+      uint64_t bytes = s.bytes.load( std::memory_order_relaxed );
+      uint64_t drops = s.drops.load( std::memory_order_relaxed );
+      depth += s.role == Telemetry::Role::Ingress ? static_cast<int64_t>( packets - drops )
+                                                  : -static_cast<int64_t>( packets );
+
+      out << ( i++ ? "," : "" ) << "{\"name\":\"" << s.name << "\",\"packets\":" << packets
+          << ",\"bytes\":" << bytes << ",\"drops\":" << drops;
+      if ( secs >= 0.001 ) // the final report can follow the last one by microseconds
+      {
+        out << ",\"pps\":" << static_cast<uint64_t>( ( packets - prev.packets ) / secs )
+            << ",\"mbps\":" << ( bytes - prev.bytes ) * 8 / secs / 1e6;
+      }
+      LatencyHistogram::Counts latency = s.latency.snapshot();
+      LatencyHistogram::Summary sum = LatencyHistogram::summarize( latency, prev.latency );
+      if ( sum.count )
+      {
+        out << ",\"latency_ns\":{\"count\":" << sum.count << ",\"p50\":" << sum.p50
+            << ",\"p99\":" << sum.p99 << ",\"p999\":" << sum.p999 << ",\"max\":" << sum.max
+            << "}";
+      }
+      out << "}";
+      prev.packets = packets;
+      prev.bytes = bytes;
+      prev.latency = std::move( latency );
+    } );
+    out << "],\"queue_depth\":" << std::max<int64_t>( depth, 0 ) << "}";
+    return out.str();
+  }
+
+  const Telemetry &m_telemetry;
+  std::chrono::milliseconds m_interval;
+  Publish m_publish;
+  Clock::time_point m_start, m_last;
+  std::vector<Previous> m_previous;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  bool m_stopped = false;
+  std::thread m_thread;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_TELEMETRY_HPP
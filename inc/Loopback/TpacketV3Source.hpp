@@ -0,0 +1,254 @@
+#ifndef LOOPBACK_TPACKETV3SOURCE_HPP
+#define LOOPBACK_TPACKETV3SOURCE_HPP
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <pcap/pcap.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Usage:
+//
+// #include <Loopback/TpacketV3Source.hpp>
+// Loopback::TpacketV3Source rx( "veth0", Loopback::TpacketV3Source::Options{} );
+// rx.dispatch( 64, callback, user );   // same return codes as pcap_dispatch on a live handle
+
+namespace Loopback {
+
+//! @brief Live ingress from an AF_PACKET TPACKET_V3 (PACKET_MMAP) receive ring.
+//
+// The kernel fills `block_count` blocks of `block_size` bytes and hands a block to userspace when
+// it is full or `retire_timeout_ms` has passed. Packets are read in place from the current block
+// and the block is returned to the kernel only once every packet in it has been consumed, so a
+// block turns into one batch for the queue. Packet views stay valid until the next call to
+// `next_ex`/`dispatch`.
+//
+class TpacketV3Source
+{
+public:
+  struct Options
+  {
+    uint32_t block_size = 1 << 20; // multiple of the page size
+    uint32_t block_count = 64;
+    uint32_t frame_size = 2048; // only used by the kernel for sanity checks in V3
+    uint32_t retire_timeout_ms = 10;
+    int poll_timeout_ms = 1000; // same as the libpcap read timeout used elsewhere
+    bool promisc = true;
+  };
+
+  struct Stats
+  {
+    uint64_t packets = 0; // seen by the socket
+    uint64_t drops = 0;   // dropped because the ring was full
+    uint64_t freezes = 0; // times the kernel froze the queue waiting for a block
+  };
+
+  TpacketV3Source( const std::string &ifname, const Options &opts )
+      : m_opts( opts )
+  {
+    m_fd = ::socket( AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons( ETH_P_ALL ) );
+    if ( m_fd < 0 ) fail( "socket(AF_PACKET)" );
+
+    int version = TPACKET_V3;
+    if ( ::setsockopt( m_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof( version ) ) != 0 )
+      fail( "PACKET_VERSION" );
+
+    struct tpacket_req3 req;
+    std::memset( &req, 0, sizeof( req ) );
+    req.tp_block_size = opts.block_size;
+    req.tp_block_nr = opts.block_count;
+    req.tp_frame_size = opts.frame_size;
+    req.tp_frame_nr = ( opts.block_size / opts.frame_size ) * opts.block_count;
+    req.tp_retire_blk_tov = opts.retire_timeout_ms;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if ( ::setsockopt( m_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof( req ) ) != 0 )
+      fail( "PACKET_RX_RING" );
+
+    m_map_len = static_cast<std::size_t>( opts.block_size ) * opts.block_count;
+    void *map =
+        ::mmap( nullptr, m_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, m_fd, 0 );
+    if ( map == MAP_FAILED )
+      map = ::mmap( nullptr, m_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+    if ( map == MAP_FAILED ) fail( "mmap(PACKET_RX_RING)" );
+    m_ring = static_cast<uint8_t *>( map );
+
+    struct sockaddr_ll addr;
+    std::memset( &addr, 0, sizeof( addr ) );
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons( ETH_P_ALL );
+    addr.sll_ifindex = static_cast<int>( ::if_nametoindex( ifname.c_str() ) );
+    if ( addr.sll_ifindex == 0 ) fail( ifname.c_str() ); // errno is ENODEV
+    if ( ::bind( m_fd, reinterpret_cast<struct sockaddr *>( &addr ), sizeof( addr ) ) != 0 )
+      fail( "bind" );
+
+    if ( opts.promisc )
+    {
+      struct packet_mreq mreq;
+      std::memset( &mreq, 0, sizeof( mreq ) );
+      mreq.mr_ifindex = addr.sll_ifindex;
+      mreq.mr_type = PACKET_MR_PROMISC;
+      if ( ::setsockopt( m_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof( mreq ) ) != 0 )
+        fail( "PACKET_MR_PROMISC" );
+    }
+  }
+
+  ~TpacketV3Source() { release(); }
+
+  TpacketV3Source( const TpacketV3Source & ) = delete;
+  TpacketV3Source &operator=( const TpacketV3Source & ) = delete;
+
+  int fd() const { return m_fd; }
+  const char *geterr() const { return m_err.c_str(); }
+
+  // 1 = packet, 0 = poll timeout, -1 = error (see geterr)
+  int next_ex( struct pcap_pkthdr **hdr, const u_char **data )
+  {
+    if ( m_release_pending ) release_block();
+    if ( !m_pkt )
+    {
+      int ret = wait_block();
+      if ( ret <= 0 ) return ret;
+    }
+
+    const struct tpacket3_hdr *pkt = m_pkt;
+    m_hdr.ts.tv_sec = pkt->tp_sec;
+    m_hdr.ts.tv_usec = pkt->tp_nsec / 1000;
+    m_hdr.caplen = pkt->tp_snaplen;
+    m_hdr.len = pkt->tp_len;
+    *hdr = &m_hdr;
+    *data = reinterpret_cast<const u_char *>( pkt ) + pkt->tp_mac;
+
+    if ( --m_remaining )
+    {
+      m_pkt = reinterpret_cast<const struct tpacket3_hdr *>(
+          reinterpret_cast<const uint8_t *>( pkt ) + pkt->tp_next_offset );
+    }
+    else
+    {
+      m_pkt = nullptr;
+      m_release_pending = true; // caller may still be reading the last packet
+    }
+    return 1;
+  }
+
+  // Hands out up to `cnt` packets but never crosses into the next block, so one retired block
+  // becomes (at most a few) queue batches. Returns packets handled, 0 on timeout, -1 on error.
+  int dispatch( int cnt, pcap_handler callback, u_char *user )
+  {
+    struct pcap_pkthdr *hdr;
+    const u_char *data;
+    int n = 0;
+    while ( cnt <= 0 || n < cnt )
+    {
+      if ( n && !m_pkt ) break; // end of block
+      int ret = next_ex( &hdr, &data );
+      if ( ret <= 0 ) return n ? n : ret;
+      callback( user, hdr, data );
+      ++n;
+    }
+    return n;
+  }
+
+  // Counters since the last call (the kernel resets them on read)
+  Stats stats()
+  {
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof( st );
+    std::memset( &st, 0, sizeof( st ) );
+    if ( ::getsockopt( m_fd, SOL_PACKET, PACKET_STATISTICS, &st, &len ) == 0 )
+    {
+      m_stats.packets += st.tp_packets;
+      m_stats.drops += st.tp_drops;
+      m_stats.freezes += st.tp_freeze_q_cnt;
+    }
+    return m_stats;
+  }
+
+private:
+  struct tpacket_block_desc *block( uint32_t index )
+  {
+    return reinterpret_cast<struct tpacket_block_desc *>(
+        m_ring + static_cast<std::size_t>( index ) * m_opts.block_size );
+  }
+
+  static bool block_ready( struct tpacket_block_desc *desc )
+  {
+    return __atomic_load_n( &desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE ) & TP_STATUS_USER;
+  }
+
+  int wait_block()
+  {
+    struct tpacket_block_desc *desc = block( m_block );
+    if ( !block_ready( desc ) )
+    {
+      struct pollfd pfd = { m_fd, POLLIN | POLLERR, 0 };
+      int ret = ::poll( &pfd, 1, m_opts.poll_timeout_ms );
+      if ( ret < 0 && errno != EINTR )
+      {
+        m_err = std::string( "poll: " ) + std::strerror( errno );
+        return -1;
+      }
+      if ( !block_ready( desc ) ) return 0;
+    }
+
+    m_remaining = desc->hdr.bh1.num_pkts;
+    if ( m_remaining == 0 )
+    {
+      release_block();
+      return 0;
+    }
+    m_pkt = reinterpret_cast<const struct tpacket3_hdr *>(
+        reinterpret_cast<const uint8_t *>( desc ) + desc->hdr.bh1.offset_to_first_pkt );
+    return 1;
+  }
+
+  void release_block()
+  {
+    struct tpacket_block_desc *desc = block( m_block );
+    __atomic_store_n( &desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE );
+    m_block = ( m_block + 1 ) % m_opts.block_count;
+    m_release_pending = false;
+  }
+
+  [[noreturn]] void fail( const char *what )
+  {
+    std::string msg = std::string( what ) + ": " + std::strerror( errno );
+    release();
+    throw std::runtime_error( msg );
+  }
+
+  void release()
+  {
+    if ( m_ring ) ::munmap( m_ring, m_map_len );
+    if ( m_fd >= 0 ) ::close( m_fd );
+    m_ring = nullptr;
+    m_fd = -1;
+  }
+
+  Options m_opts;
+  int m_fd = -1;
+  uint8_t *m_ring = nullptr;
+  std::size_t m_map_len = 0;
+
+  uint32_t m_block = 0;
+  uint32_t m_remaining = 0;
+  const struct tpacket3_hdr *m_pkt = nullptr;
+  bool m_release_pending = false;
+
+  struct pcap_pkthdr m_hdr{};
+  std::string m_err;
+  Stats m_stats;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_TPACKETV3SOURCE_HPP
@@ -0,0 +1,317 @@
+#ifndef LOOPBACK_URINGPCAPWRITER_HPP
+#define LOOPBACK_URINGPCAPWRITER_HPP
+
+#include <Loopback/IoUring.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <pcap/pcap.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Usage:
+//
+// #include <Loopback/UringPcapWriter.hpp>
+// Loopback::UringPcapWriter writer( "out.pcap", DLT_EN10MB, 65535 );
+// writer.write( hdr, data );   // per packet, never waits on the disk unless all buffers are busy
+// writer.close();              // flush + wait for outstanding writes
+
+namespace Loopback {
+
+//! @brief pcap file writer that batches records into large aligned buffers written via io_uring.
+//
+// Records are appended into one of `buffers` aligned buffers. A full buffer is submitted as a
+// single IORING_OP_WRITE and filling continues in the next one, so the egress thread only waits
+// on the disk when every buffer is still in flight. Records are split across buffer boundaries,
+// which keeps every write except the last a whole buffer at a buffer-aligned file offset — the
+// requirement for O_DIRECT. With O_DIRECT the final write is zero-padded to the block size and
+// the file is truncated back to its real length on close().
+//
+class UringPcapWriter
+{
+public:
+  static constexpr std::size_t ALIGNMENT = 4096;
+
+  struct Options
+  {
+    std::size_t buffer_size = 4 * 1024 * 1024;
+    unsigned buffers = 2;
+    bool direct = false; // open with O_DIRECT, bypassing the page cache
+    bool nanosecond = false; // ts.tv_usec holds nanoseconds, written with the nanosecond magic
+  };
+
+  struct Stats
+  {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;  // bytes completed on disk
+    uint64_t writes = 0; // io_uring writes completed
+    uint64_t stalls = 0; // times the egress thread had to wait for a free buffer
+    double latency_avg_us = 0;
+    double latency_max_us = 0;
+    double bytes_per_sec = 0;
+  };
+
+  UringPcapWriter( const std::string &path, int linktype, int snaplen )
+      : UringPcapWriter( path, linktype, snaplen, Options{} )
+  {
+  }
+
+  UringPcapWriter( const std::string &path, int linktype, int snaplen, Options opts )
+      : m_opts( opts ),
+        m_ring( std::max( 2u, opts.buffers ) )
+  {
+    m_opts.buffers = std::max( 2u, opts.buffers );
+    m_opts.buffer_size = std::max( opts.buffer_size, ALIGNMENT );
+    m_opts.buffer_size = ( m_opts.buffer_size + ALIGNMENT - 1 ) & ~( ALIGNMENT - 1 );
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | ( m_opts.direct ? O_DIRECT : 0 );
+    m_fd = ::open( path.c_str(), flags, 0644 );
+    if ( m_fd < 0 ) throw std::runtime_error( path + ": " + std::strerror( errno ) );
+
+    m_buffers.resize( m_opts.buffers );
+    for ( Buffer &buf : m_buffers )
+    {
+      buf.data = static_cast<uint8_t *>( std::aligned_alloc( ALIGNMENT, m_opts.buffer_size ) );
+      if ( !buf.data )
+      {
+        release();
+        throw std::runtime_error( "cannot allocate pcap write buffers" );
+      }
+    }
+
+    uint32_t global[6] = { 0xa1b2c3d4, 2 | ( 4u << 16 ), 0, 0, 0, 0 }; // magic, v2.4
+    if ( m_opts.nanosecond ) global[0] = 0xa1b23c4d;
+    global[4] = static_cast<uint32_t>( snaplen );
+    global[5] = static_cast<uint32_t>( linktype );
+    append( global, sizeof( global ) );
+    m_opened = std::chrono::steady_clock::now();
+  }
+
+  ~UringPcapWriter()
+  {
+    close();
+    release();
+  }
+
+  UringPcapWriter( const UringPcapWriter & ) = delete;
+  UringPcapWriter &operator=( const UringPcapWriter & ) = delete;
+
+  // Returns false once an I/O error has occurred (see error())
+  bool write( const struct pcap_pkthdr &hdr, const u_char *data )
+  {
+    uint32_t rec[4] = { static_cast<uint32_t>( hdr.ts.tv_sec ),
+                        static_cast<uint32_t>( hdr.ts.tv_usec ),
+                        hdr.caplen,
+                        hdr.len };
+    append( rec, sizeof( rec ) );
+    append( data, hdr.caplen );
+    ++m_stats.packets;
+    return m_err.empty();
+  }
+
+  // Flush the partially filled buffer and wait for every write. Idempotent.
+  bool close()
+  {
+    if ( m_fd < 0 || m_closed ) return m_err.empty();
+    m_closed = true;
+
+    Buffer &buf = m_buffers[m_current];
+    if ( buf.fill && m_err.empty() )
+    {
+      std::size_t len = buf.fill;
+      if ( m_opts.direct )
+      {
+        len = ( buf.fill + ALIGNMENT - 1 ) & ~( ALIGNMENT - 1 );
+        std::memset( buf.data + buf.fill, 0, len - buf.fill );
+      }
+      submit( m_current, len );
+    }
+    drain();
+
+    if ( m_opts.direct && ::ftruncate( m_fd, m_logical_size ) != 0 )
+      m_err = std::string( "ftruncate: " ) + std::strerror( errno );
+    ::close( m_fd );
+    m_fd = -1;
+    return m_err.empty();
+  }
+
+  const std::string &error() const { return m_err; }
+
+  Stats stats() const
+  {
+    Stats out = m_stats;
+    if ( m_stats.writes ) out.latency_avg_us = m_latency_sum_us / m_stats.writes;
+    double secs = std::chrono::duration<double>( m_last_completion - m_opened ).count();
+    if ( secs > 0 ) out.bytes_per_sec = m_stats.bytes / secs;
+    return out;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Buffer
+  {
+    uint8_t *data = nullptr;
+    std::size_t fill = 0;
+    bool in_flight = false;
+    uint64_t offset = 0;   // file offset of data[0]
+    std::size_t len = 0;   // bytes submitted
+    std::size_t done = 0;  // bytes completed (short writes are resubmitted)
+    Clock::time_point submitted;
+  };
+
+  void append( const void *src, std::size_t n )
+  {
+    if ( !m_err.empty() ) return; // output is unusable after an I/O error
+    auto *p = static_cast<const uint8_t *>( src );
+    m_logical_size += n;
+    while ( n )
+    {
+      Buffer &buf = m_buffers[m_current];
+      std::size_t chunk = std::min( n, m_opts.buffer_size - buf.fill );
+      std::memcpy( buf.data + buf.fill, p, chunk );
+      buf.fill += chunk;
+      p += chunk;
+      n -= chunk;
+      if ( buf.fill == m_opts.buffer_size )
+      {
+        submit( m_current, buf.fill );
+        m_current = ( m_current + 1 ) % m_buffers.size();
+        acquire( m_buffers[m_current] );
+        if ( !m_err.empty() ) return;
+      }
+    }
+  }
+
+  void submit( unsigned index, std::size_t len )
+  {
+    Buffer &buf = m_buffers[index];
+    buf.offset = m_file_offset;
+    buf.len = len;
+    buf.done = 0;
+    buf.in_flight = true;
+    buf.submitted = Clock::now();
+    m_file_offset += len;
+
+    int ret = m_ring.write( m_fd, buf.data, len, buf.offset, index );
+    if ( ret < 0 )
+    {
+      // the kernel did not take the SQE, and nothing submits again after an error
+      buf.in_flight = false;
+      fail( "io_uring submit", ret );
+    }
+
+    // pick up anything that already finished so buffers are free before they are needed
+    while ( reap( false ) )
+      ;
+  }
+
+  void acquire( Buffer &buf )
+  {
+    if ( buf.in_flight ) ++m_stats.stalls;
+    while ( buf.in_flight )
+      if ( !reap( true ) ) return;
+    buf.fill = 0;
+  }
+
+  // Waits for every outstanding write, errors included, so no buffer is freed or refilled while
+  // the kernel may still read it. False only if the ring itself failed.
+  bool drain()
+  {
+    for ( const Buffer &buf : m_buffers )
+      while ( buf.in_flight )
+        if ( !reap( true ) ) return false;
+    return true;
+  }
+
+  bool reap( bool block )
+  {
+    struct io_uring_cqe cqe;
+    if ( block )
+    {
+      int ret = m_ring.wait( cqe );
+      if ( ret < 0 )
+      {
+        fail( "io_uring wait", ret );
+        return false;
+      }
+    }
+    else if ( !m_ring.peek( cqe ) )
+      return false;
+
+    Buffer &buf = m_buffers[cqe.user_data];
+    if ( cqe.res < 0 )
+    {
+      buf.in_flight = false;
+      fail( "pcap write", cqe.res );
+      return true;
+    }
+
+    // O_DIRECT needs block-aligned offsets: resubmit from the last whole block, rewriting the
+    // same bytes of a partial one
+    std::size_t done = buf.done + static_cast<std::size_t>( cqe.res );
+    if ( m_opts.direct && done < buf.len ) done &= ~( ALIGNMENT - 1 );
+    const bool progress = done > buf.done;
+    buf.done = done;
+    if ( progress && buf.done < buf.len && m_err.empty() )
+    {
+      int ret = m_ring.write(
+          m_fd, buf.data + buf.done, buf.len - buf.done, buf.offset + buf.done, cqe.user_data );
+      if ( ret >= 0 ) return true;
+      fail( "io_uring submit", ret );
+    }
+
+    m_last_completion = Clock::now();
+    double us =
+        std::chrono::duration<double, std::micro>( m_last_completion - buf.submitted ).count();
+    m_latency_sum_us += us;
+    m_stats.latency_max_us = std::max( m_stats.latency_max_us, us );
+    m_stats.bytes += buf.done;
+    ++m_stats.writes;
+    buf.in_flight = false;
+    if ( buf.done < buf.len ) fail( "pcap write", -EIO );
+    return true;
+  }
+
+  void fail( const char *what, int neg_errno )
+  {
+    if ( m_err.empty() ) m_err = std::string( what ) + ": " + std::strerror( -neg_errno );
+  }
+
+  void release()
+  {
+    // a buffer still in flight (the ring failed while draining) is leaked rather than freed
+    // under the kernel
+    drain();
+    for ( Buffer &buf : m_buffers )
+      if ( !buf.in_flight ) std::free( buf.data );
+    m_buffers.clear();
+    if ( m_fd >= 0 ) ::close( m_fd );
+    m_fd = -1;
+  }
+
+  Options m_opts;
+  IoUring m_ring;
+  int m_fd = -1;
+  bool m_closed = false;
+  std::vector<Buffer> m_buffers;
+  unsigned m_current = 0;
+  uint64_t m_file_offset = 0;  // next aligned write offset
+  uint64_t m_logical_size = 0; // pcap bytes produced, excluding O_DIRECT padding
+  std::string m_err;
+
+  Stats m_stats;
+  double m_latency_sum_us = 0;
+  Clock::time_point m_opened;
+  Clock::time_point m_last_completion;
+};
+
+} // namespace Loopback
+
+#endif // LOOPBACK_URINGPCAPWRITER_HPP
@@ -1,6 +1,15 @@
 #!/bin/bash
+# Usage: ./afxdp_host.sh <ingress-if> <egress-if> [LoopbackAFXDP options]
 set -e
 
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <ingress-if> <egress-if> [LoopbackAFXDP options]"
+  exit 1
+fi
+INGRESS=$1
+EGRESS=$2
+shift 2
+
 # 1️⃣ Create a hugepages mount
 sudo mkdir -p /mnt/huge || true
 sudo mount -t hugetlbfs nodev /mnt/huge
@@ -19,6 +28,7 @@ docker run -it --rm \
     --mount type=bind,source=/mnt/huge,target=/mnt/huge \
     --mount type=bind,source=/sys/fs/bpf,target=/sys/fs/bpf \
     --mount type=bind,source=$(pwd)/build-x86_64-linux-gnu/bin/LoopbackAFXDP,target=/usr/local/bin/LoopbackAFXDP \
+    --mount type=bind,source=$(pwd)/build-x86_64-linux-gnu/bin/loopback_xdp.bpf.o,target=/usr/local/bin/loopback_xdp.bpf.o \
     debian:trixie-slim \
-    bash -c "apt update && apt install -y libbpf-dev libxdp-dev iproute2 && /usr/local/bin/LoopbackAFXDP --umem-dir /mnt/huge"
+    bash -c "apt update && apt install -y libbpf-dev libxdp-dev iproute2 && /usr/local/bin/LoopbackAFXDP --umem-dir /mnt/huge $* $INGRESS $EGRESS"
 
@@ -0,0 +1,116 @@
+#!/bin/bash
+# File: bench_e2e.sh
+# Usage: sudo ./bench_e2e.sh -p <LoopbackPerf> [-b <LoopbackBoost>] [-c <LoopbackPOCO>]
+#                            [-x <LoopbackAFXDP>] [-d <LoopbackDPDK>] [-v af_packet|pcap]
+#                            [-s "64 512 1500"] [-t seconds] [-r pps] [-o report]
+#
+# Runs every given Loopback binary between two veth pairs in a private network namespace:
+#
+#   LoopbackPerf --tx gen0 -> in0 [ Loopback app ] out0 -> sink0 --rx LoopbackPerf
+#
+# and drives it with LoopbackPerf once per packet size. Each run appends one line to
+# <report>.jsonl and one row to <report>.csv: sent, received, loss, pps, Gbps and
+# p50/p99/p99.9 latency. The app's own output goes to <report>-<app>-<size>.log.
+
+if [ "$EUID" -ne 0 ]; then
+  echo "Please run as root."
+  exit 1
+fi
+
+PERF=
+declare -A APPS
+VDEV=af_packet
+SIZES="64 512 1500"
+DURATION=10
+PPS=0
+REPORT=loopback-e2e
+
+while getopts "p:b:c:x:d:v:s:t:r:o:" opt; do
+  case $opt in
+    p) PERF=$(realpath "$OPTARG") ;;
+    b) APPS[boost]=$(realpath "$OPTARG") ;;
+    c) APPS[poco]=$(realpath "$OPTARG") ;;
+    x) APPS[afxdp]=$(realpath "$OPTARG") ;;
+    d) APPS[dpdk]=$(realpath "$OPTARG") ;;
+    v) VDEV=$OPTARG ;;
+    s) SIZES=$OPTARG ;;
+    t) DURATION=$OPTARG ;;
+    r) PPS=$OPTARG ;;
+    o) REPORT=$OPTARG ;;
+    *) exit 1 ;;
+  esac
+done
+
+if [ -z "$PERF" ] || [ ${#APPS[@]} -eq 0 ]; then
+  echo "Usage: $0 -p <LoopbackPerf> [-b <LoopbackBoost>] [-c <LoopbackPOCO>] [-x <LoopbackAFXDP>]"
+  echo "       [-d <LoopbackDPDK>] [-v af_packet|pcap] [-s \"64 512 1500\"] [-t seconds] [-r pps]"
+  echo "       [-o report]"
+  exit 1
+fi
+
+NS=loopback-bench
+INGRESS=in0
+EGRESS=out0
+
+cleanup() {
+  ip netns pids $NS 2>/dev/null | xargs -r kill 2>/dev/null
+  ip netns delete $NS 2>/dev/null
+}
+trap cleanup EXIT
+
+echo "Creating namespace $NS with veth pairs gen0-$INGRESS and $EGRESS-sink0..."
+cleanup
+ip netns add $NS
+ip -n $NS link add gen0 type veth peer name $INGRESS
+ip -n $NS link add $EGRESS type veth peer name sink0
+for dev in lo gen0 $INGRESS $EGRESS sink0; do
+  ip -n $NS link set $dev up
+done
+# Keep the kernel from adding its own traffic, and offloads off for AF_XDP
+ip netns exec $NS sysctl -qw net.ipv6.conf.all.disable_ipv6=1
+for dev in gen0 $INGRESS $EGRESS sink0; do
+  ip netns exec $NS ethtool -K $dev tx off rx off >/dev/null 2>&1
+done
+
+app_command() {
+  case $1 in
+    boost) echo "${APPS[boost]} --ingress $INGRESS --egress $EGRESS" ;;
+    poco) echo "${APPS[poco]} --ingress $INGRESS --egress $EGRESS" ;;
+    afxdp) echo "${APPS[afxdp]} $INGRESS $EGRESS" ;;
+    dpdk) echo "${APPS[dpdk]} --no-pci --no-huge -m 512 --vdev=net_${VDEV}0,iface=$INGRESS" \
+                "--vdev=net_${VDEV}1,iface=$EGRESS" ;;
+  esac
+}
+
+rm -f "$REPORT.jsonl" "$REPORT.csv"
+for app in boost poco afxdp dpdk; do
+  [ -n "${APPS[$app]}" ] || continue
+  label=$app
+  [ $app = dpdk ] && label=dpdk-$VDEV
+  for size in $SIZES; do
+    echo "Running $label with $size byte frames..."
+    ip netns exec $NS $(app_command $app) >"$REPORT-$label-$size.log" 2>&1 &
+    APP_PID=$!
+
+    # Give it a moment to open its devices
+    sleep 2
+    if ! kill -0 $APP_PID 2>/dev/null; then
+      echo "$label exited early, see $REPORT-$label-$size.log"
+      continue
+    fi
+
+    ip netns exec $NS "$PERF" --tx gen0 --rx sink0 --size $size --duration $DURATION --pps $PPS \
+      --label $label --json "$REPORT.jsonl" --csv "$REPORT.csv"
+
+    # SIGINT as from a terminal; force it if the app does not stop within 5 seconds
+    kill -INT $APP_PID
+    for _ in $(seq 50); do
+      kill -0 $APP_PID 2>/dev/null || break
+      sleep 0.1
+    done
+    kill -KILL $APP_PID 2>/dev/null
+    wait $APP_PID 2>/dev/null
+  done
+done
+
+echo "Report: $REPORT.jsonl $REPORT.csv"
@@ -1,6 +1,9 @@
 #!/bin/bash
 # File: test_afxdp.sh
-# Usage: sudo ./test_loopback.sh ./LoopbackAFXDP
+# Usage: sudo ./test_loopback.sh ./LoopbackAFXDP [queues]
+#
+# With [queues] > 1 the veth pair gets that many RX and TX queues and the app serves each of
+# them with its own worker (--queues).
 
 if [ "$EUID" -ne 0 ]; then
   echo "Please run as root."
@@ -8,8 +11,9 @@ if [ "$EUID" -ne 0 ]; then
 fi
 
 APP="$1"
+QUEUES="${2:-1}"
 if [ -z "$APP" ]; then
-  echo "Usage: $0 <path-to-LoopbackAFXDP>"
+  echo "Usage: $0 <path-to-LoopbackAFXDP> [queues]"
   exit 1
 fi
 
@@ -18,8 +22,9 @@ EGRESS=veth1
 IP1=192.168.100.1
 IP2=192.168.100.2
 
-echo "Creating veth pair..."
-ip link add $INGRESS type veth peer name $EGRESS
+echo "Creating veth pair with $QUEUES queue(s)..."
+ip link add $INGRESS numtxqueues $QUEUES numrxqueues $QUEUES type veth \
+  peer name $EGRESS numtxqueues $QUEUES numrxqueues $QUEUES
 ip addr add $IP1/24 dev $INGRESS
 ip addr add $IP2/24 dev $EGRESS
 ip link set $INGRESS up
@@ -30,7 +35,7 @@ ethtool -K $INGRESS tx off rx off
 ethtool -K $EGRESS tx off rx off
 
 echo "Starting AF_XDP loopback app..."
-$APP $INGRESS $EGRESS &
+$APP --queues $QUEUES $INGRESS $EGRESS &
 APP_PID=$!
 
 # Give it a moment to start
@@ -1,49 +1,52 @@
+#include <Logging/EventLog.hpp>
+#include <Loopback/BoundedQueue.hpp>
+#include <Loopback/FrameAllocator.hpp>
+#include <Loopback/PacketPipeline.hpp>
+
 #include <linux/if_link.h>
 #include <linux/if_xdp.h>
 #include <bpf/libbpf.h>
 #include <xdp/xsk.h>
+#include <poll.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
 #include <iostream>
 #include <vector>
-#include <queue>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <cstring>
+#include <cstdlib>
 
-constexpr int FRAME_SIZE = 2048;
-constexpr int NUM_FRAMES = 4096;
-constexpr int BATCH_SIZE = 64;
+constexpr uint32_t FRAME_SIZE = 2048;
+constexpr uint32_t NUM_FRAMES = 8192;  // fill ring + RX ring + queue + TX ring in flight
+constexpr uint32_t RING_SIZE = 4096;
+constexpr uint32_t BATCH_SIZE = 64;
+constexpr int POLL_TIMEOUT_MS = 100;   // how long an idle ingress waits before checking for SIGINT
+constexpr int TX_STALL_MS = 100;       // no TX progress for this long and egress gives up
+constexpr int TX_POLL_MS = 1;          // one wait for room on the TX ring
 
+// A received frame, handed from RX to TX by its UMEM address: the payload is never copied
 struct Packet {
-    size_t len;
-    char data[FRAME_SIZE];
+    uint64_t addr;
+    uint32_t len;
 };
 
-// Thread-safe queue
-class PacketQueue {
-public:
-    void push(Packet pkt) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        queue_.push(pkt);
-        cv_.notify_one();
-    }
+constexpr size_t QUEUE_DEPTH = 2048;
 
-    Packet pop() {
-        std::unique_lock<std::mutex> lock(mutex_);
-        cv_.wait(lock, [this]{ return !queue_.empty(); });
-        Packet pkt = queue_.front();
-        queue_.pop();
-        return pkt;
-    }
+// Bounded queue of frame addresses; the frames themselves stay in the UMEM
+using PacketQueue = Loopback::BoundedQueue<Packet>;
+using FrameCache = Loopback::FrameAllocator::Cache;
 
-private:
-    std::queue<Packet> queue_;
-    std::mutex mutex_;
-    std::condition_variable cv_;
-};
+// Cleared by SIGINT/SIGTERM so both threads wind down and the stats get printed
+static std::atomic<bool> running{true};
+
+static void on_signal(int) { running = false; }
 
 // Setup ulimit for locked memory (required for XDP)
 bool set_memlock_rlimit() {
@@ -51,127 +54,313 @@ bool set_memlock_rlimit() {
     return setrlimit(RLIMIT_MEMLOCK, &rlim) == 0;
 }
 
-// Simple UMEM wrapper
+// UMEM with its fill and completion rings. libxdp on RHEL 9.6 has no accessors for the rings,
+// the caller owns them and xsk_umem__create() maps them in place.
 struct UMEM {
     struct xsk_umem* umem = nullptr;
+    struct xsk_ring_prod fq{};   // ingress thread
+    struct xsk_ring_cons cq{};   // egress thread
     void* buffer = nullptr;
-    size_t size = FRAME_SIZE * NUM_FRAMES;
+    size_t size = size_t(FRAME_SIZE) * NUM_FRAMES;
 };
 
-// Simple XDP socket wrapper
+// XDP socket with its RX and TX rings
 struct XDP_Socket {
     struct xsk_socket* xsk = nullptr;
+    struct xsk_ring_cons rx{};   // ingress thread
+    struct xsk_ring_prod tx{};   // egress thread
     std::string ifname;
     uint32_t queue_id = 0;
 };
 
-// Populate fill ring
-void populate_fill_ring(XDP_Socket& xsk, UMEM& umem) {
-    struct xsk_ring_prod* fr = xsk_umem__fill_ring(umem.umem);
-    uint32_t idx;
-    for (uint32_t i = 0; i < NUM_FRAMES; ++i) {
-        xsk_ring_prod__reserve(fr, 1, &idx);
-        *xsk_ring_prod__fill_addr(fr, idx) = i * FRAME_SIZE;
-        xsk_ring_prod__submit(fr, 1);
+// Whether the kernel bound the socket in zero-copy or copy mode
+const char* xdp_mode(const XDP_Socket& xsk) {
+    struct xdp_options opts{};
+    socklen_t len = sizeof(opts);
+    if (getsockopt(xsk_socket__fd(xsk.xsk), SOL_XDP, XDP_OPTIONS, &opts, &len))
+        return "unknown";
+    return (opts.flags & XDP_OPTIONS_ZEROCOPY) ? "zero-copy" : "copy";
+}
+
+// Hands free frames to the kernel until the fill ring is full or the allocator runs dry.
+// xsk_ring_prod__reserve() is all-or-nothing, so ask for exactly what is free.
+uint32_t refill_fill_ring(UMEM& umem, FrameCache& frames) {
+    uint64_t addrs[BATCH_SIZE];
+    uint32_t total = 0;
+    while (true) {
+        uint32_t n = xsk_prod_nb_free(&umem.fq, BATCH_SIZE);
+        if (n > BATCH_SIZE)
+            n = BATCH_SIZE;
+        n = static_cast<uint32_t>(frames.alloc(addrs, n));
+        if (n == 0)
+            break;
+
+        uint32_t idx;
+        xsk_ring_prod__reserve(&umem.fq, n, &idx);
+        for (uint32_t i = 0; i < n; ++i)
+            *xsk_ring_prod__fill_addr(&umem.fq, idx + i) = addrs[i];
+        xsk_ring_prod__submit(&umem.fq, n);
+        total += n;
+        if (n < BATCH_SIZE)
+            break;
     }
+    return total;
 }
 
-// Ingress thread
-void ingress_thread(XDP_Socket& xsk, UMEM& umem, PacketQueue& queue) {
-    struct xsk_ring_cons* rx = xsk_socket__rx_ring(xsk.xsk);
-    struct xsk_ring_prod* fq = xsk_umem__fill_ring(umem.umem);
+// Ingress: passes each received frame on by address and refills the fill ring from the allocator
+struct RxRingSource {
+    using Item = Packet;
 
-    struct xdp_desc descs[BATCH_SIZE];
-    uint32_t idx[BATCH_SIZE];
+    XDP_Socket& xsk;
+    UMEM& umem;
+    FrameCache& frames;   // the ingress thread's cache
 
-    while (true) {
-        int nb = xsk_ring_cons__peek(rx, BATCH_SIZE, &idx[0]);
-        for (int i = 0; i < nb; ++i) {
-            struct xdp_desc* d = xsk_ring_cons__rx_desc(rx, idx[i]);
-            Packet pkt;
-            pkt.len = d->len;
-            std::memcpy(pkt.data, (char*)umem.buffer + d->addr, d->len);
-            queue.push(pkt);
-
-            // Refill
-            xsk_ring_prod__reserve(fq, 1, &idx[i]);
-            *xsk_ring_prod__fill_addr(fq, idx[i]) = d->addr;
-            xsk_ring_prod__submit(fq, 1);
+    size_t receive(Packet* pkts, size_t max) {
+        uint32_t idx;
+        uint32_t nb = xsk_ring_cons__peek(&xsk.rx, max, &idx);
+        if (nb == 0) {
+            // frames completed meanwhile may have come back while the fill ring ran empty
+            refill_fill_ring(umem, frames);
+            wait();
+            return 0;
         }
-        xsk_ring_cons__release(rx, nb);
+        for (uint32_t i = 0; i < nb; ++i) {
+            const struct xdp_desc* d = xsk_ring_cons__rx_desc(&xsk.rx, idx + i);
+            pkts[i].addr = d->addr;
+            pkts[i].len = d->len;
+            EVENTLOG("ingress rx addr={} len={}", d->addr, d->len);
+        }
+        xsk_ring_cons__release(&xsk.rx, nb);
+        refill_fill_ring(umem, frames);
+        return nb;
     }
-}
 
-// Egress thread
-void egress_thread(XDP_Socket& xsk, PacketQueue& queue) {
-    struct xsk_ring_prod* tx = xsk_socket__tx_ring(xsk.xsk);
+    // poll() also wakes the driver when it flagged the fill ring (XDP_USE_NEED_WAKEUP)
+    void wait() {
+        struct pollfd pfd{xsk_socket__fd(xsk.xsk), POLLIN, 0};
+        poll(&pfd, 1, POLL_TIMEOUT_MS);
+    }
 
-    uint32_t idx[BATCH_SIZE];
-    Packet pkts[BATCH_SIZE];
+    bool done() const { return !running; }
 
-    while (true) {
-        for (int i = 0; i < BATCH_SIZE; ++i)
-            pkts[i] = queue.pop();
+    // a frame the queue did not keep goes straight back to the allocator
+    void reject(Packet& pkt) { frames.free(pkt.addr); }
+};
+
+// Egress: writes a TX descriptor per frame, kicks the kernel and frees completed frames
+struct TxRingSink {
+    XDP_Socket& xsk;
+    UMEM& umem;
+    FrameCache& frames;   // the egress thread's cache
+
+    uint32_t outstanding = 0;   // submitted to the TX ring, not yet on the completion ring
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+
+    using Clock = std::chrono::steady_clock;
+
+    void send(Packet* pkts, size_t n) {
+        complete();
 
-        int nb = xsk_ring_prod__reserve(tx, BATCH_SIZE, &idx[0]);
-        for (int i = 0; i < nb; ++i) {
-            // In real mode you'd copy data to UMEM; here we just simulate
-            (void)pkts[i];
+        // Bounded in time, not iterations: kick() costs nothing unless the kernel asked for a
+        // wakeup, so a count of them would only measure how fast this loop spins
+        uint32_t idx;
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(TX_STALL_MS);
+        while (xsk_ring_prod__reserve(&xsk.tx, n, &idx) < n) {
+            kick();
+            if (complete() > 0) {
+                deadline = Clock::now() + std::chrono::milliseconds(TX_STALL_MS);
+                continue;
+            }
+            if (Clock::now() >= deadline) {
+                EVENTLOG("egress tx ring full, dropped={}", n);
+                for (size_t i = 0; i < n; ++i)
+                    frames.free(pkts[i].addr);
+                dropped += n;
+                return;
+            }
+            wait();
         }
-        xsk_ring_prod__submit(tx, nb);
+        for (size_t i = 0; i < n; ++i) {
+            struct xdp_desc* d = xsk_ring_prod__tx_desc(&xsk.tx, idx + i);
+            d->addr = pkts[i].addr;
+            d->len = pkts[i].len;
+            EVENTLOG("egress tx addr={} len={}", d->addr, d->len);
+        }
+        xsk_ring_prod__submit(&xsk.tx, n);
+        outstanding += n;
+        sent += n;
+        kick();
     }
-}
+
+    // Queue is empty: push out what is on the TX ring and take back its frames, giving up after
+    // TX_STALL_MS without a completion (e.g. the device went down at shutdown)
+    void flush() {
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(TX_STALL_MS);
+        while (outstanding > 0) {
+            kick();
+            if (complete() > 0) {
+                deadline = Clock::now() + std::chrono::milliseconds(TX_STALL_MS);
+                continue;
+            }
+            if (Clock::now() >= deadline) {
+                EVENTLOG("egress tx flush gave up, outstanding={}", outstanding);
+                break;
+            }
+            wait();
+        }
+    }
+
+    void close() { flush(); }
+
+    // Frees every frame the kernel has finished transmitting
+    uint32_t complete() {
+        uint32_t idx;
+        uint32_t nb = xsk_ring_cons__peek(&umem.cq, RING_SIZE, &idx);
+        for (uint32_t i = 0; i < nb; ++i)
+            frames.free(*xsk_ring_cons__comp_addr(&umem.cq, idx + i));
+        xsk_ring_cons__release(&umem.cq, nb);
+        outstanding -= nb;
+        return nb;
+    }
+
+    // Sleeps until the TX ring has room, for at most TX_POLL_MS; poll() on an XDP socket also
+    // drives transmission
+    void wait() {
+        struct pollfd pfd{xsk_socket__fd(xsk.xsk), POLLOUT, 0};
+        poll(&pfd, 1, TX_POLL_MS);
+    }
+
+    // In copy mode, and in zero-copy mode when the driver asks for it, transmission only starts
+    // with a syscall
+    void kick() {
+        if (!xsk_ring_prod__needs_wakeup(&xsk.tx))
+            return;
+        if (sendto(xsk_socket__fd(xsk.xsk), nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0 &&
+            errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN)
+            EVENTLOG("egress sendto errno={}", errno);
+    }
+};
+
+// Event trace of the queue's decisions (see LOOPBACK_EVENT_LOG); RxRingSource traces every
+// received frame, so only drops are added here
+struct TraceProbe : Loopback::NullProbe {
+    void dropped(const Packet& pkt) { EVENTLOG("ingress drop addr={} len={}", pkt.addr, pkt.len); }
+};
+
+using Pipeline = Loopback::PacketPipeline<RxRingSource, PacketQueue, TxRingSink, TraceProbe>;
 
 int main(int argc, char* argv[]) {
+    // [queue-depth] [block|drop-newest|drop-oldest] [device]
+    const char* usage = " [queue-depth] [block|drop-newest|drop-oldest] [device]";
+    size_t queue_depth = QUEUE_DEPTH;
+    try {
+        if (argc > 1) queue_depth = std::stoul(argv[1]);
+    } catch (const std::exception&) {
+        queue_depth = 0;
+    }
+    if (queue_depth == 0) {
+        std::cerr << "Invalid queue depth: " << argv[1] << std::endl;
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+    Loopback::OverflowPolicy overflow = Loopback::OverflowPolicy::Block;
+    if (argc > 2 && !Loopback::parse_overflow_policy(argv[2], overflow)) {
+        std::cerr << "Usage: " << argv[0] << usage << std::endl;
+        return 1;
+    }
+
     if (!set_memlock_rlimit()) {
         std::cerr << "Failed to set RLIMIT_MEMLOCK" << std::endl;
         return 1;
     }
 
+    // The kernel only registers a page-aligned UMEM
     UMEM umem;
-    umem.buffer = aligned_alloc(FRAME_SIZE, umem.size);
+    umem.buffer = mmap(nullptr, umem.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+    if (umem.buffer == MAP_FAILED) {
+        std::cerr << "Failed to allocate UMEM: " << strerror(errno) << std::endl;
+        return 1;
+    }
 
-    // For real NIC use argv[1], for simulation hardcode "veth0"
+    // A real NIC is named on the command line, the simulation defaults to "veth0"
     XDP_Socket xsk;
-    xsk.ifname = "veth0";
+    xsk.ifname = argc > 3 ? argv[3] : "veth0";
     xsk.queue_id = 0;
 
     // Create UMEM
     struct xsk_umem_config cfg{};
     cfg.frame_size = FRAME_SIZE;
     cfg.frame_headroom = 0;
-    cfg.fill_size = 4096;
-    cfg.comp_size = 4096;
+    cfg.fill_size = RING_SIZE;
+    cfg.comp_size = RING_SIZE;
 
-    if (xsk_umem__create(&umem.umem, umem.buffer, umem.size, nullptr, nullptr, &cfg)) {
-        std::cerr << "Failed to create UMEM" << std::endl;
+    int ret = xsk_umem__create(&umem.umem, umem.buffer, umem.size, &umem.fq, &umem.cq, &cfg);
+    if (ret) {
+        std::cerr << "Failed to create UMEM: " << strerror(-ret) << std::endl;
         return 1;
     }
 
-    // Create XSK socket
+    // Create XSK socket; the kernel picks zero-copy when the driver supports it
     struct xsk_socket_config scfg{};
-    scfg.rx_size = 4096;
-    scfg.tx_size = 4096;
+    scfg.rx_size = RING_SIZE;
+    scfg.tx_size = RING_SIZE;
     scfg.libbpf_flags = 0;
     scfg.xdp_flags = XDP_FLAGS_UPDATE_IF_NOEXIST;
+    scfg.bind_flags = XDP_USE_NEED_WAKEUP;
 
-    if (xsk_socket__create(&xsk.xsk, xsk.ifname.c_str(), xsk.queue_id, umem.umem, nullptr, nullptr, &scfg)) {
-        std::cerr << "Failed to create XSK socket" << std::endl;
+    ret = xsk_socket__create(&xsk.xsk, xsk.ifname.c_str(), xsk.queue_id, umem.umem, &xsk.rx,
+                             &xsk.tx, &scfg);
+    if (ret) {
+        std::cerr << "Failed to create XSK socket: " << strerror(-ret) << std::endl;
         return 1;
     }
+    std::cout << "AF_XDP: " << xsk.ifname << " queue " << xsk.queue_id << " " << xdp_mode(xsk)
+              << std::endl;
 
-    populate_fill_ring(xsk, umem);
+    // Every frame of the UMEM is owned by exactly one of: the allocator, a thread's cache, the
+    // fill/RX rings (kernel), the queue, or the TX/completion rings (kernel)
+    Loopback::FrameAllocator allocator(NUM_FRAMES, FRAME_SIZE, BATCH_SIZE);
+    FrameCache rx_frames(allocator);
+    FrameCache tx_frames(allocator);
+    refill_fill_ring(umem, rx_frames);
 
-    PacketQueue queue;
-    std::thread ingress(ingress_thread, std::ref(xsk), std::ref(umem), std::ref(queue));
-    std::thread egress(egress_thread, std::ref(xsk), std::ref(queue));
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    // Optional binary event trace, rendered offline by EventLogDecoder
+    if (const char* event_log = std::getenv("LOOPBACK_EVENT_LOG")) {
+        try {
+            Logging::EventLog::start(event_log);
+        } catch (const std::exception& ex) {
+            std::cerr << "Cannot open event log: " << ex.what() << std::endl;
+            return 1;
+        }
+    }
+
+    PacketQueue queue(queue_depth, overflow);
+    RxRingSource source{xsk, umem, rx_frames};
+    TxRingSink sink{xsk, umem, tx_frames};
+    Pipeline pipeline(source, queue, sink, BATCH_SIZE);
+
+    std::thread ingress([&pipeline] { pipeline.ingress(); });
+    std::thread egress([&pipeline] { pipeline.egress(); });
 
     ingress.join();
     egress.join();
+    Logging::EventLog::stop();
+
+    Loopback::FrameAllocator::Stats frames = allocator.stats();
+    std::cout << "Forwarded " << sink.sent << " frames, dropped " << sink.dropped
+              << " on a full TX ring" << std::endl;
+    std::cout << "Frames: " << frames.frames << " of " << FRAME_SIZE << " bytes, refills="
+              << frames.refills << " spills=" << frames.spills
+              << " exhausted=" << frames.exhausted << std::endl;
 
     xsk_socket__delete(xsk.xsk);
     xsk_umem__delete(umem.umem);
-    free(umem.buffer);
+    munmap(umem.buffer, umem.size);
 
     return 0;
 }
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0
+//
+// XDP program for LoopbackAFXDP. Settles what it can in the driver and only redirects packets
+// that need userspace to their queue's AF_XDP socket:
+//
+//   rules[{proto, dport}] -> pass | drop | tx (bounce back) | redirect (egress device) | xsk
+//
+// Build: clang -O2 -g -target bpf -c loopback_xdp.bpf.c -o loopback_xdp.bpf.o
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/udp.h>
+
+#include <bpf/bpf_endian.h>
+#include <bpf/bpf_helpers.h>
+
+#include "loopback_xdp.h"
+
+struct
+{
+  __uint( type, BPF_MAP_TYPE_XSKMAP );
+  __uint( max_entries, LOOPBACK_XDP_MAX_QUEUES );
+  __type( key, __u32 );
+  __type( value, __u32 );
+} xsks_map SEC( ".maps" );
+
+struct
+{
+  __uint( type, BPF_MAP_TYPE_HASH );
+  __uint( max_entries, LOOPBACK_XDP_MAX_RULES );
+  __type( key, struct loopback_rule_key );
+  __type( value, __u32 );
+} rules SEC( ".maps" );
+
+// Slot 0: the egress device, for LOOPBACK_ACT_REDIRECT
+struct
+{
+  __uint( type, BPF_MAP_TYPE_DEVMAP );
+  __uint( max_entries, 1 );
+  __type( key, __u32 );
+  __type( value, __u32 );
+} tx_port SEC( ".maps" );
+
+struct
+{
+  __uint( type, BPF_MAP_TYPE_PERCPU_ARRAY );
+  __uint( max_entries, LOOPBACK_ACT_COUNT );
+  __type( key, __u32 );
+  __type( value, struct loopback_counter );
+} stats SEC( ".maps" );
+
+struct vlan_hdr
+{
+  __be16 tci;
+  __be16 proto;
+};
+
+// Fills in the rule key for the packet; non-IP packets and fragments keep the wildcard fields
+static __always_inline void parse( void *data, void *data_end, struct loopback_rule_key *key )
+{
+  struct ethhdr *eth = data;
+  if ( (void *)( eth + 1 ) > data_end ) return;
+
+  __be16 proto = eth->h_proto;
+  void *l3 = eth + 1;
+  if ( proto == bpf_htons( ETH_P_8021Q ) || proto == bpf_htons( ETH_P_8021AD ) )
+  {
+    struct vlan_hdr *vlan = l3;
+    if ( (void *)( vlan + 1 ) > data_end ) return;
+    proto = vlan->proto;
+    l3 = vlan + 1;
+  }
+
+  void *l4;
+  if ( proto == bpf_htons( ETH_P_IP ) )
+  {
+    struct iphdr *ip = l3;
+    if ( (void *)( ip + 1 ) > data_end || ip->ihl < 5 ) return;
+    key->proto = ip->protocol;
+    if ( ip->frag_off & bpf_htons( 0x1fff ) ) return; // no L4 header in later fragments
+    l4 = (void *)ip + ip->ihl * 4;
+  }
+  else if ( proto == bpf_htons( ETH_P_IPV6 ) )
+  {
+    struct ipv6hdr *ip6 = l3;
+    if ( (void *)( ip6 + 1 ) > data_end ) return;
+    key->proto = ip6->nexthdr; // extension headers are not walked
+    l4 = ip6 + 1;
+  }
+  else
+    return;
+
+  // The destination port sits at the same offset in TCP and UDP
+  struct udphdr *udp = l4;
+  if ( key->proto != IPPROTO_TCP && key->proto != IPPROTO_UDP ) return;
+  if ( (void *)( udp + 1 ) > data_end ) return;
+  key->dport = udp->dest;
+}
+
+static __always_inline __u32 lookup( struct loopback_rule_key *key )
+{
+  __u32 *action = bpf_map_lookup_elem( &rules, key );
+  if ( action ) return *action;
+  key->dport = 0;
+  action = bpf_map_lookup_elem( &rules, key );
+  if ( action ) return *action;
+  key->proto = 0;
+  action = bpf_map_lookup_elem( &rules, key );
+  return action ? *action : LOOPBACK_ACT_XSK;
+}
+
+static __always_inline void swap_macs( void *data )
+{
+  __u8 tmp[ETH_ALEN];
+  struct ethhdr *eth = data;
+  __builtin_memcpy( tmp, eth->h_dest, ETH_ALEN );
+  __builtin_memcpy( eth->h_dest, eth->h_source, ETH_ALEN );
+  __builtin_memcpy( eth->h_source, tmp, ETH_ALEN );
+}
+
+SEC( "xdp" )
+int loopback_xdp( struct xdp_md *ctx )
+{
+  void *data = (void *)(long)ctx->data;
+  void *data_end = (void *)(long)ctx->data_end;
+
+  struct loopback_rule_key key = {};
+  parse( data, data_end, &key );
+  __u32 action = lookup( &key );
+  if ( action >= LOOPBACK_ACT_COUNT ) action = LOOPBACK_ACT_XSK;
+
+  struct loopback_counter *counter = bpf_map_lookup_elem( &stats, &action );
+  if ( counter )
+  {
+    counter->packets++;
+    counter->bytes += data_end - data;
+  }
+
+  switch ( action )
+  {
+  case LOOPBACK_ACT_PASS:
+    return XDP_PASS;
+  case LOOPBACK_ACT_DROP:
+    return XDP_DROP;
+  case LOOPBACK_ACT_TX:
+    if ( data + sizeof( struct ethhdr ) > data_end ) return XDP_DROP;
+    swap_macs( data );
+    return XDP_TX;
+  case LOOPBACK_ACT_REDIRECT:
+    return bpf_redirect_map( &tx_port, 0, XDP_DROP );
+  default:
+    // no socket on this queue (yet): let the kernel have it
+    return bpf_redirect_map( &xsks_map, ctx->rx_queue_index, XDP_PASS );
+  }
+}
+
+char _license[] SEC( "license" ) = "GPL";
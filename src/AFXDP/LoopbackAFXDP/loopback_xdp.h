@@ -0,0 +1,39 @@
+#ifndef LOOPBACK_XDP_H
+#define LOOPBACK_XDP_H
+
+// Types shared by the XDP program (loopback_xdp.bpf.c) and LoopbackAFXDP, which fills its maps
+
+#include <linux/types.h>
+
+#define LOOPBACK_XDP_MAX_QUEUES 64
+#define LOOPBACK_XDP_MAX_RULES 1024
+
+// What the program does with a packet; also the index into the `stats` map
+enum loopback_action
+{
+  LOOPBACK_ACT_XSK = 0,  // to the AF_XDP socket of the RX queue (`xsks_map`), the default
+  LOOPBACK_ACT_PASS,     // on to the kernel stack
+  LOOPBACK_ACT_DROP,     // dropped in the driver
+  LOOPBACK_ACT_TX,       // back out of the ingress device with the MACs swapped (XDP_TX)
+  LOOPBACK_ACT_REDIRECT, // out of the egress device unchanged, without userspace (`tx_port`)
+  LOOPBACK_ACT_COUNT
+};
+
+// `rules` key: IP protocol and destination port (network byte order), 0 matching anything. A
+// packet is looked up as {proto, port}, then {proto, 0}, then {0, 0}; with no match it goes to
+// LOOPBACK_ACT_XSK.
+struct loopback_rule_key
+{
+  __u8 proto;
+  __u8 pad;
+  __be16 dport;
+};
+
+// `stats` value, one per action and CPU
+struct loopback_counter
+{
+  __u64 packets;
+  __u64 bytes;
+};
+
+#endif // LOOPBACK_XDP_H
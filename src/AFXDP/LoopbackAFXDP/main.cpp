@@ -1,62 +1,101 @@
-#include <condition_variable>
+#include <Logging/EventLog.hpp>
+#include <Loopback/BoundedQueue.hpp>
+#include <Loopback/PacketPipeline.hpp>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <getopt.h>
+#include <cstring>
 #include <iostream>
 #include <linux/if_xdp.h>
-#include <mutex>
+#include <linux/magic.h>
 #include <net/if.h>
-#include <queue>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/vfs.h>
 #include <thread>
 #include <unistd.h>
+#include <vector>
+#include <xdp/libxdp.h>
 #include <xdp/xsk.h>
 
-#define NUM_FRAMES 4096
-#define FRAME_SIZE 2048
+#include "loopback_xdp.h"
+
+#define NUM_FRAMES 4096 // per queue, default for --frames
+#define FRAME_SIZE 2048 // default for --frame-size
+#define HUGEPAGE_SIZE ( 2UL << 20 )
 #define BATCH_SIZE 64
+#define QUEUE_DEPTH 2048
 
 #ifndef XDP_FLAGS_UPDATE_IF_NOEXIST
 #define XDP_FLAGS_UPDATE_IF_NOEXIST 0
 #endif
 
-// Thread-safe packet queue
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+// A received frame, forwarded by address: the payload never leaves the UMEM
 struct Packet
 {
   uint64_t addr;
   uint32_t len;
 };
 
-class PacketQueue
-{
-public:
-  void push( Packet pkt )
-  {
-    std::unique_lock<std::mutex> lock( mutex );
-    queue.push( pkt );
-    cond.notify_one();
-  }
+// Bounded packet queue: a full queue blocks ingress or drops, see the [overflow] argument
+using PacketQueue = Loopback::BoundedQueue<Packet>;
 
-  bool pop( Packet &pkt )
-  {
-    std::unique_lock<std::mutex> lock( mutex );
-    while ( queue.empty() && running )
-      cond.wait( lock );
-    if ( !running && queue.empty() ) return false;
-    pkt = queue.front();
-    queue.pop();
-    return true;
-  }
+// Cleared by SIGINT/SIGTERM so both threads wind down and the queue stats get printed
+static std::atomic<bool> running{ true };
 
-  void stop()
-  {
-    std::unique_lock<std::mutex> lock( mutex );
-    running = false;
-    cond.notify_all();
-  }
+static void on_signal( int ) { running = false; }
 
-private:
-  std::queue<Packet> queue;
-  std::mutex mutex;
-  std::condition_variable cond;
-  bool running = true;
+// Names of the loopback_action values, as --rule takes them
+static const char *const ACTION_NAMES[LOOPBACK_ACT_COUNT] = {
+    "xsk", "pass", "drop", "tx", "redirect" };
+
+// One entry for the XDP program's `rules` map
+struct XdpRule
+{
+  struct loopback_rule_key key;
+  uint32_t action;
+};
+
+// How the app waits for work, see usage()
+struct XdpOptions
+{
+  bool run_to_completion = false; // one thread, no queue
+  bool need_wakeup = false;       // XDP_USE_NEED_WAKEUP: syscalls only when the kernel asks
+  int poll_ms = 0;                // when idle, sleep in poll() for up to this long; 0 spins
+  int busy_poll_us = 0;           // SO_BUSY_POLL with SO_PREFER_BUSY_POLL; 0 is off
+  int busy_poll_budget = BATCH_SIZE;
+  uint32_t queues = 1; // RX queues served, one worker each
+  int cpu = -1;        // pin the worker threads to consecutive CPUs from here; -1 leaves them be
+  uint32_t frames = NUM_FRAMES;         // per queue, and the size of every ring
+  uint32_t frame_size = FRAME_SIZE;     // UMEM chunk size
+  std::string umem_dir;                 // hugetlbfs mount to back the UMEM with
+  size_t hugepage_size = HUGEPAGE_SIZE; // for MAP_HUGETLB; 0 uses normal pages
+  std::string xdp_obj;                  // our XDP program; "default" for libxdp's redirect-all
+  std::vector<XdpRule> rules;
 };
 
 // UMEM wrapper
@@ -67,31 +106,165 @@ struct UMEM
   size_t size;
   struct xsk_ring_prod *fq; // Fill queue
   struct xsk_ring_cons *cq; // Completion queue
+  size_t page_size;         // of the pages backing `area`
+  const char *backing;      // "hugetlbfs", "MAP_HUGETLB" or "normal pages"
 };
 
-// AF_XDP socket wrapper
+// AF_XDP socket wrapper; every socket on the UMEM has its own fill and completion ring
 struct XDP_Socket
 {
   struct xsk_socket *xsk;
   struct xsk_umem *umem;
   struct xsk_ring_cons *rx;
   struct xsk_ring_prod *tx;
+  struct xsk_ring_prod *fq; // Fill queue
+  struct xsk_ring_cons *cq; // Completion queue
   int ifindex;
   uint32_t queue_id;
 };
 
-// Setup UMEM
-bool setup_umem( UMEM &umem )
+// Who owns a UMEM frame. Every frame cycles Fill -> Rx -> Tx -> Fill, or Rx -> Fill when the queue
+// drops it. A frame only goes back to the fill ring after the completion ring has returned it, so
+// the kernel never receives into a frame that is still waiting to be transmitted.
+enum class FrameState : uint8_t
+{
+  Fill, // fill ring or RX ring: the kernel's
+  Rx,   // received: in an ingress batch, the queue or an egress batch
+  Tx    // on the TX ring until it shows up on the completion ring
+};
+
+// Per-frame FrameState, checked on every transition. A frame is only ever touched by the thread
+// that owns it; the handoffs go through the queue and the kernel rings.
+class FrameTable
+{
+public:
+  // `frame_size` is a power of two, as the UMEM's aligned chunk mode requires
+  FrameTable( size_t frames, uint32_t frame_size )
+      : m_state( frames ),
+        m_shift( __builtin_ctz( frame_size ) )
+  {
+  }
+
+  // Start of the UMEM frame holding `addr` (RX descriptors point past the headroom)
+  uint64_t frame_of( uint64_t addr ) const { return addr >> m_shift << m_shift; }
+
+  void move( uint64_t addr, FrameState from, FrameState to )
+  {
+    std::atomic<FrameState> &state = m_state[addr >> m_shift];
+    FrameState was = state.load( std::memory_order_relaxed );
+    if ( was != from )
+    {
+      m_violations.fetch_add( 1, std::memory_order_relaxed );
+      EVENTLOG( "frame state violation addr={} expected={} found={}", addr, from, was );
+    }
+    state.store( to, std::memory_order_relaxed );
+  }
+
+  size_t count( FrameState state ) const
+  {
+    size_t n = 0;
+    for ( const std::atomic<FrameState> &s : m_state )
+      n += s.load( std::memory_order_relaxed ) == state;
+    return n;
+  }
+
+  uint64_t violations() const { return m_violations.load( std::memory_order_relaxed ); }
+
+private:
+  std::vector<std::atomic<FrameState>> m_state;
+  const unsigned m_shift;
+  std::atomic<uint64_t> m_violations{ 0 };
+};
+
+// Maps the UMEM area, on hugepages where possible: one 2 MiB page covers 1024 2 KiB frames, so
+// the per-frame RX/TX path stops missing the TLB. Tries a file on the hugetlbfs --umem-dir, then
+// anonymous MAP_HUGETLB pages of --hugepages size, then normal pages advised for THP.
+void *map_umem_area( UMEM &umem, size_t size, const XdpOptions &opts )
+{
+  const int prot = PROT_READ | PROT_WRITE;
+  if ( !opts.umem_dir.empty() )
+  {
+    std::string path = opts.umem_dir + "/loopback-umem-XXXXXX";
+    int fd = mkstemp( &path[0] );
+    struct statfs fs;
+    if ( fd < 0 || fstatfs( fd, &fs ) || fs.f_type != HUGETLBFS_MAGIC )
+      std::cerr << opts.umem_dir << " is not a usable hugetlbfs mount\n";
+    else
+    {
+      unlink( path.c_str() ); // the pages go when the mapping does
+      umem.page_size = fs.f_bsize;
+      umem.size = ( size + umem.page_size - 1 ) & ~( umem.page_size - 1 );
+      void *area = MAP_FAILED;
+      if ( ftruncate( fd, umem.size ) == 0 )
+        area = mmap( nullptr, umem.size, prot, MAP_SHARED | MAP_POPULATE, fd, 0 );
+      if ( area != MAP_FAILED )
+      {
+        close( fd );
+        umem.backing = "hugetlbfs";
+        return area;
+      }
+      std::cerr << "Cannot map " << umem.size << " bytes of hugepages from " << opts.umem_dir
+                << ": " << std::strerror( errno ) << "\n";
+    }
+    if ( fd >= 0 )
+    {
+      unlink( path.c_str() );
+      close( fd );
+    }
+  }
+
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+  if ( opts.hugepage_size )
+  {
+    umem.page_size = opts.hugepage_size;
+    umem.size = ( size + umem.page_size - 1 ) & ~( umem.page_size - 1 );
+    const int huge = MAP_HUGETLB | __builtin_ctzl( umem.page_size ) << MAP_HUGE_SHIFT;
+    void *area = mmap( nullptr, umem.size, prot, flags | huge, -1, 0 );
+    if ( area != MAP_FAILED )
+    {
+      umem.backing = "MAP_HUGETLB";
+      return area;
+    }
+    // no pages of that size reserved (vm.nr_hugepages or hugepages= on the kernel command line)
+  }
+
+  umem.page_size = sysconf( _SC_PAGESIZE );
+  umem.size = size;
+  umem.backing = "normal pages";
+  if ( !opts.hugepage_size ) return mmap( nullptr, size, prot, flags, -1, 0 );
+
+  // THP advice only applies to pages faulted in after it: map, advise, then populate
+  void *area = mmap( nullptr, size, prot, flags & ~MAP_POPULATE, -1, 0 );
+  if ( area == MAP_FAILED ) return area;
+  madvise( area, size, MADV_HUGEPAGE );
+#ifdef MADV_POPULATE_WRITE
+  if ( madvise( area, size, MADV_POPULATE_WRITE ) == 0 ) return area; // Linux 5.14+
+#endif
+  for ( size_t offset = 0; offset < size; offset += umem.page_size )
+    static_cast<volatile uint8_t *>( area )[offset] = 0;
+  return area;
+}
+
+// Setup UMEM: opts.frames frames for each queue
+bool setup_umem( UMEM &umem, const XdpOptions &opts )
 {
-  size_t size = NUM_FRAMES * FRAME_SIZE;
-  void *area = mmap(
-      nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0 );
+  size_t size = size_t( opts.queues ) * opts.frames * opts.frame_size;
+  void *area = map_umem_area( umem, size, opts );
   if ( area == MAP_FAILED ) return false;
+  if ( opts.frame_size > umem.page_size )
+  {
+    // frames larger than a page need hugetlb backing and Linux 6.6+
+    std::cerr << "--frame-size " << opts.frame_size << " is larger than the UMEM's "
+              << umem.page_size << " byte pages (" << umem.backing
+              << "), use --umem-dir or --hugepages\n";
+    munmap( area, umem.size );
+    return false;
+  }
 
   struct xsk_umem_config cfg = {};
-  cfg.fill_size = NUM_FRAMES;
-  cfg.comp_size = NUM_FRAMES;
-  cfg.frame_size = FRAME_SIZE;
+  cfg.fill_size = opts.frames;
+  cfg.comp_size = opts.frames;
+  cfg.frame_size = opts.frame_size;
   cfg.frame_headroom = 0;
 
   struct xsk_umem *xu;
@@ -100,7 +273,7 @@ bool setup_umem( UMEM &umem )
 
   if ( xsk_umem__create( &xu, area, size, umem.fq, umem.cq, &cfg ) )
   {
-    munmap( area, size );
+    munmap( area, umem.size );
     delete umem.fq;
     delete umem.cq;
     return false;
@@ -108,30 +281,58 @@ bool setup_umem( UMEM &umem )
 
   umem.umem = xu;
   umem.area = area;
-  umem.size = size;
   return true;
 }
 
-// Setup AF_XDP socket (classic API)
-bool setup_xdp_socket( XDP_Socket &xsk, const char *ifname, UMEM &umem )
+// Setup AF_XDP socket (classic API). All sockets share the UMEM, so an egress socket transmits
+// straight from the frame its ingress socket received into. Ingress sockets are RX-only; with
+// --xdp-obj default they load libxdp's redirect-all program, otherwise main() adds them to our
+// program's xsks_map. Egress sockets are TX-only and load no program. The first socket uses the
+// UMEM's own fill and completion rings; every other one is bound with XDP_SHARED_UMEM and gets a
+// pair of its own (of which egress only uses the completion ring).
+bool setup_xdp_socket( XDP_Socket &xsk,
+                       const char *ifname,
+                       uint32_t queue_id,
+                       UMEM &umem,
+                       bool ingress,
+                       const XdpOptions &opts )
 {
   xsk.ifindex = if_nametoindex( ifname );
-  xsk.queue_id = 0;
+  xsk.queue_id = queue_id;
+  const bool first = ingress && queue_id == 0;
 
   struct xsk_socket_config cfg = {};
-  cfg.rx_size = NUM_FRAMES;
-  cfg.tx_size = NUM_FRAMES;
-  cfg.libbpf_flags = 0;
+  cfg.rx_size = opts.frames;
+  cfg.tx_size = opts.frames;
+  cfg.libbpf_flags =
+      ingress && opts.xdp_obj == "default" ? 0 : XSK_LIBBPF_FLAGS__INHIBIT_PROG_LOAD;
   cfg.xdp_flags = XDP_FLAGS_UPDATE_IF_NOEXIST;
+  // zero-copy where the driver supports it, copy mode otherwise
+  cfg.bind_flags = opts.need_wakeup ? XDP_USE_NEED_WAKEUP : 0;
 
-  xsk.rx = new xsk_ring_cons;
-  xsk.tx = new xsk_ring_prod;
+  xsk.rx = ingress ? new xsk_ring_cons : nullptr;
+  xsk.tx = ingress ? nullptr : new xsk_ring_prod;
+  xsk.fq = first ? umem.fq : new xsk_ring_prod;
+  xsk.cq = first ? umem.cq : new xsk_ring_cons;
 
-  if ( xsk_socket__create( &xsk.xsk, ifname, xsk.queue_id, umem.umem, xsk.rx, xsk.tx, &cfg ) )
+  int err;
+  if ( first )
+    err = xsk_socket__create( &xsk.xsk, ifname, queue_id, umem.umem, xsk.rx, nullptr, &cfg );
+  else
+    err = xsk_socket__create_shared(
+        &xsk.xsk, ifname, queue_id, umem.umem, xsk.rx, xsk.tx, xsk.fq, xsk.cq, &cfg );
+
+  if ( err )
   {
-    std::cerr << "Failed to create XSK socket on " << ifname << "\n";
+    std::cerr << "Failed to create XSK socket on " << ifname << " queue " << queue_id << "\n";
     delete xsk.rx;
     delete xsk.tx;
+    if ( !first )
+    {
+      delete xsk.fq;
+      delete xsk.cq;
+    }
+    xsk.xsk = nullptr;
     return false;
   }
 
@@ -139,96 +340,730 @@ bool setup_xdp_socket( XDP_Socket &xsk, const char *ifname, UMEM &umem )
   return true;
 }
 
-// Fill UMEM fill queue
-void populate_fill_ring( UMEM &umem )
+// "zero-copy" or "copy", whichever the driver agreed to at bind time
+const char *xdp_mode( const XDP_Socket &xsk )
 {
-  uint32_t idx;
-  for ( uint32_t i = 0; i < NUM_FRAMES; ++i )
+  struct xdp_options opts = {};
+  socklen_t len = sizeof( opts );
+  if ( getsockopt( xsk_socket__fd( xsk.xsk ), SOL_XDP, XDP_OPTIONS, &opts, &len ) )
+    return "unknown";
+  return ( opts.flags & XDP_OPTIONS_ZEROCOPY ) ? "zero-copy" : "copy";
+}
+
+// Deletes the socket and whatever rings setup_xdp_socket() allocated for it
+void close_xdp_socket( XDP_Socket &xsk, const UMEM &umem )
+{
+  if ( !xsk.xsk ) return;
+  xsk_socket__delete( xsk.xsk );
+  delete xsk.rx;
+  delete xsk.tx;
+  if ( xsk.fq != umem.fq ) delete xsk.fq;
+  if ( xsk.cq != umem.cq ) delete xsk.cq;
+}
+
+// Preferred busy polling (Linux 5.11+): the app's own syscalls run the driver's NAPI loop and the
+// device's interrupts stay off while it keeps up. Only takes effect with the device's
+// napi_defer_hard_irqs and gro_flush_timeout set, see the README.
+bool enable_busy_poll( const XDP_Socket &xsk, const XdpOptions &opts )
+{
+  const int fd = xsk_socket__fd( xsk.xsk );
+  const int on = 1;
+  const int usecs = opts.busy_poll_us;
+  const int budget = opts.busy_poll_budget;
+  return setsockopt( fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on, sizeof( on ) ) == 0 &&
+         setsockopt( fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof( usecs ) ) == 0 &&
+         setsockopt( fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof( budget ) ) == 0;
+}
+
+// Our XDP program (loopback_xdp.bpf.c) on the ingress device and its maps. Detached again on
+// destruction: libxdp attaches through netlink, so the program would otherwise outlive the app.
+struct XdpProgram
+{
+  struct xdp_program *prog = nullptr;
+  int ifindex = 0;
+  int xsks_map = -1;
+  int rules = -1;
+  int tx_port = -1;
+  int stats = -1;
+
+  XdpProgram() = default;
+  XdpProgram( const XdpProgram & ) = delete;
+  XdpProgram &operator=( const XdpProgram & ) = delete;
+
+  ~XdpProgram()
+  {
+    if ( !prog ) return;
+    xdp_program__detach( prog, ifindex, xdp_program__is_attached( prog, ifindex ), 0 );
+    xdp_program__close( prog );
+  }
+};
+
+// Attaches opts.xdp_obj to `ifname` (native mode where the driver has it, generic otherwise),
+// installs the rules and points LOOPBACK_ACT_REDIRECT at `egress`
+bool load_xdp_program( XdpProgram &xdp,
+                       const XdpOptions &opts,
+                       const char *ifname,
+                       const char *egress )
+{
+  struct xdp_program *prog = xdp_program__open_file( opts.xdp_obj.c_str(), "xdp", nullptr );
+  if ( long err = libxdp_get_error( prog ) )
   {
-    if ( xsk_ring_prod__reserve( umem.fq, 1, &idx ) )
+    std::cerr << "Cannot open XDP program " << opts.xdp_obj << ": " << std::strerror( -err )
+              << "\n";
+    return false;
+  }
+  const int ifindex = if_nametoindex( ifname );
+  if ( int err = xdp_program__attach( prog, ifindex, XDP_MODE_UNSPEC, 0 ) )
+  {
+    std::cerr << "Cannot attach XDP program to " << ifname << ": " << std::strerror( -err ) << "\n";
+    xdp_program__close( prog );
+    return false;
+  }
+  xdp.prog = prog;
+  xdp.ifindex = ifindex;
+
+  const struct bpf_object *obj = xdp_program__bpf_obj( prog );
+  xdp.xsks_map = bpf_object__find_map_fd_by_name( obj, "xsks_map" );
+  xdp.rules = bpf_object__find_map_fd_by_name( obj, "rules" );
+  xdp.tx_port = bpf_object__find_map_fd_by_name( obj, "tx_port" );
+  xdp.stats = bpf_object__find_map_fd_by_name( obj, "stats" );
+  if ( xdp.xsks_map < 0 || xdp.rules < 0 || xdp.tx_port < 0 || xdp.stats < 0 )
+  {
+    std::cerr << opts.xdp_obj << " lacks the xsks_map, rules, tx_port and stats maps\n";
+    return false;
+  }
+
+  for ( const XdpRule &rule : opts.rules )
+  {
+    if ( bpf_map_update_elem( xdp.rules, &rule.key, &rule.action, BPF_ANY ) )
+    {
+      std::cerr << "Cannot add XDP rule: " << std::strerror( errno ) << "\n";
+      return false;
+    }
+  }
+
+  // Only needed by the redirect action, and the egress driver may not take XDP redirects
+  const uint32_t slot = 0;
+  const uint32_t egressIndex = if_nametoindex( egress );
+  if ( bpf_map_update_elem( xdp.tx_port, &slot, &egressIndex, BPF_ANY ) )
+    std::cerr << "Cannot point XDP redirects at " << egress << ": " << std::strerror( errno )
+              << "\n";
+  return true;
+}
+
+// The per-CPU `stats` counters, summed per action
+std::vector<loopback_counter> read_xdp_stats( const XdpProgram &xdp )
+{
+  std::vector<loopback_counter> totals( LOOPBACK_ACT_COUNT );
+  const int cpus = libbpf_num_possible_cpus();
+  if ( !xdp.prog || cpus <= 0 ) return totals;
+  std::vector<loopback_counter> perCpu( cpus );
+  for ( uint32_t action = 0; action < LOOPBACK_ACT_COUNT; ++action )
+  {
+    if ( bpf_map_lookup_elem( xdp.stats, &action, perCpu.data() ) ) continue;
+    for ( const loopback_counter &c : perCpu )
     {
-      *xsk_ring_prod__fill_addr( umem.fq, idx ) = i * FRAME_SIZE;
+      totals[action].packets += c.packets;
+      totals[action].bytes += c.bytes;
     }
   }
-  xsk_ring_prod__submit( umem.fq, NUM_FRAMES );
+  return totals;
+}
+
+// Hand the queue's own opts.frames frames to its fill ring in one reservation. Frames never move
+// between queues: completions and drops go back to the fill ring of the queue that received them.
+void populate_fill_ring( XDP_Socket &xsk, const XdpOptions &opts )
+{
+  uint32_t idx;
+  if ( xsk_ring_prod__reserve( xsk.fq, opts.frames, &idx ) != opts.frames ) return;
+  const uint64_t base = uint64_t( xsk.queue_id ) * opts.frames;
+  for ( uint32_t i = 0; i < opts.frames; ++i )
+    *xsk_ring_prod__fill_addr( xsk.fq, idx + i ) = ( base + i ) * opts.frame_size;
+  xsk_ring_prod__submit( xsk.fq, opts.frames );
 }
 
-// Ingress thread: RX -> queue
-void ingress_thread( XDP_Socket &xsk, UMEM &umem, PacketQueue &queue )
+// Ingress: per receive(), recycles the frames egress has finished with into the fill ring, then
+// peeks one batch off the RX ring, and waits when there is none, until SIGINT/SIGTERM. This thread
+// is the only producer on the fill ring and the only consumer of the egress completion ring.
+struct RxRingSource
 {
-  uint32_t idxs[BATCH_SIZE];
+  using Item = Packet;
 
-  while ( true )
+  XDP_Socket &xsk;
+  XDP_Socket &egress;
+  FrameTable &frames;
+  const XdpOptions &opts;
+  std::vector<uint64_t> recycled; // completed or dropped, not yet back on the fill ring
+
+  size_t receive( Packet *pkts, size_t max )
+  {
+    size_t n = peek( pkts, max );
+    if ( !n ) wait();
+    return n;
+  }
+
+  // receive() without the wait
+  size_t peek( Packet *pkts, size_t max )
   {
-    uint32_t n = xsk_ring_cons__peek( xsk.rx, BATCH_SIZE, idxs );
+    recycle( max );
+
+    uint32_t idx;
+    uint32_t n = xsk_ring_cons__peek( xsk.rx, static_cast<uint32_t>( max ), &idx );
     for ( uint32_t i = 0; i < n; ++i )
     {
-      const struct xdp_desc *desc = xsk_ring_cons__rx_desc( xsk.rx, idxs[i] );
-      queue.push( Packet{ desc->addr, desc->len } );
+      const struct xdp_desc *desc = xsk_ring_cons__rx_desc( xsk.rx, idx + i );
+      frames.move( desc->addr, FrameState::Fill, FrameState::Rx );
+      pkts[i] = Packet{ desc->addr, desc->len };
+    }
+    if ( n ) xsk_ring_cons__release( xsk.rx, n );
+    return n;
+  }
 
-      // Return frame to fill queue
-      uint32_t fidx;
-      if ( xsk_ring_prod__reserve( umem.fq, 1, &fidx ) )
+  // Nothing received. With --poll-ms sleep until a packet arrives; otherwise, when the kernel only
+  // fills the RX ring on request (need_wakeup set on the fill ring, or busy polling), ask it.
+  void wait()
+  {
+    const int fd = xsk_socket__fd( xsk.xsk );
+    if ( opts.poll_ms > 0 )
+    {
+      // poll() does not wake on completions: hand every finished frame to the fill ring first,
+      // or the kernel may have nothing to receive into until the timeout
+      recycle( opts.frames );
+      struct pollfd pfd = { fd, POLLIN, 0 };
+      poll( &pfd, 1, opts.poll_ms );
+    }
+    else if ( opts.busy_poll_us || xsk_ring_prod__needs_wakeup( xsk.fq ) )
+      recvfrom( fd, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr );
+  }
+
+  bool done() const { return !running; }
+
+  // A dropped frame was never put on the TX ring, so it can go straight back to the fill ring
+  void reject( Packet &pkt )
+  {
+    frames.move( pkt.addr, FrameState::Rx, FrameState::Fill );
+    recycled.push_back( frames.frame_of( pkt.addr ) );
+  }
+
+  // Up to `max` completions, plus any dropped frames, onto the fill ring in one reservation
+  void recycle( size_t max )
+  {
+    uint32_t idx;
+    uint32_t n = xsk_ring_cons__peek( egress.cq, static_cast<uint32_t>( max ), &idx );
+    for ( uint32_t i = 0; i < n; ++i )
+    {
+      uint64_t addr = *xsk_ring_cons__comp_addr( egress.cq, idx + i );
+      frames.move( addr, FrameState::Tx, FrameState::Fill );
+      recycled.push_back( frames.frame_of( addr ) );
+    }
+    if ( n ) xsk_ring_cons__release( egress.cq, n );
+
+    // The fill ring has room for every frame, so this only waits on a kernel that is behind
+    const uint32_t count = static_cast<uint32_t>( recycled.size() );
+    if ( !count || xsk_ring_prod__reserve( xsk.fq, count, &idx ) != count ) return;
+    for ( uint32_t i = 0; i < count; ++i )
+      *xsk_ring_prod__fill_addr( xsk.fq, idx + i ) = recycled[i];
+    xsk_ring_prod__submit( xsk.fq, count );
+    recycled.clear();
+  }
+};
+
+// Egress: the whole batch in one TX reservation, then at most one sendto() to have the kernel
+// transmit it. The frames stay off the fill ring until ingress finds them on the completion ring.
+struct TxRingSink
+{
+  XDP_Socket &xsk;
+  FrameTable &frames;
+  const XdpOptions &opts;
+  bool backlog = false; // the last kick left descriptors on the TX ring
+  uint64_t sent = 0;
+
+  void send( Packet *pkts, size_t n )
+  {
+    // The TX ring has a slot for every frame, so it is only short of room while the kernel has
+    // yet to pick up earlier descriptors
+    uint32_t idx;
+    while ( xsk_ring_prod__reserve( xsk.tx, static_cast<uint32_t>( n ), &idx ) != n )
+    {
+      kick();
+      if ( !running )
       {
-        *xsk_ring_prod__fill_addr( umem.fq, fidx ) = desc->addr;
-        xsk_ring_prod__submit( umem.fq, 1 );
+        EVENTLOG( "egress tx ring full at shutdown, dropped {} frames", n );
+        return;
       }
     }
-    xsk_ring_cons__release( xsk.rx, n );
+    for ( size_t i = 0; i < n; ++i )
+    {
+      frames.move( pkts[i].addr, FrameState::Rx, FrameState::Tx );
+      struct xdp_desc *desc = xsk_ring_prod__tx_desc( xsk.tx, idx + i );
+      desc->addr = pkts[i].addr;
+      desc->len = pkts[i].len;
+    }
+    xsk_ring_prod__submit( xsk.tx, static_cast<uint32_t>( n ) );
+    sent += n;
+    kick();
   }
-}
 
-// Egress thread: queue -> TX
-void egress_thread( XDP_Socket &xsk, PacketQueue &queue )
-{
-  uint32_t idx;
-  Packet pkt;
+  // Egress is about to go idle: in copy mode each sendto() transmits only a limited number of
+  // descriptors, so keep kicking until the TX ring is empty. When busy polling, kick at least
+  // once, which also runs the egress NAPI loop that posts completions.
+  void flush()
+  {
+    bool more = backlog || opts.busy_poll_us;
+    for ( uint32_t i = 0; more && i < opts.frames / BATCH_SIZE; ++i )
+    {
+      kick();
+      more = backlog;
+    }
+  }
+
+  void close() { flush(); }
+
+  // sendto() when the kernel needs one: always without need_wakeup, and always when busy polling,
+  // since the syscall is what drives the driver
+  void kick()
+  {
+    backlog = false;
+    if ( opts.need_wakeup && !opts.busy_poll_us && !xsk_ring_prod__needs_wakeup( xsk.tx ) )
+      return;
+    if ( sendto( xsk_socket__fd( xsk.xsk ), nullptr, 0, MSG_DONTWAIT, nullptr, 0 ) >= 0 ) return;
+    if ( errno == EAGAIN || errno == EBUSY )
+      backlog = true;
+    else if ( errno != ENOBUFS && errno != ENETDOWN )
+      EVENTLOG( "egress tx kick failed errno={}", errno );
+  }
+};
 
-  while ( queue.pop( pkt ) )
+// Run-to-completion: one thread takes a batch off the RX ring, puts it straight on the TX ring and
+// recycles the completions, with no queue and no handoff between cores. When idle it flushes TX
+// and then waits as the options say.
+void run_to_completion( RxRingSource &source, TxRingSink &sink )
+{
+  std::vector<Packet> pkts( BATCH_SIZE );
+  while ( running )
   {
-    if ( xsk_ring_prod__reserve( xsk.tx, 1, &idx ) )
+    if ( size_t n = source.peek( pkts.data(), pkts.size() ) )
+      sink.send( pkts.data(), n );
+    else
     {
-      xsk_ring_prod__tx_desc( xsk.tx, idx )->addr = pkt.addr;
-      xsk_ring_prod__tx_desc( xsk.tx, idx )->len = pkt.len;
-      xsk_ring_prod__submit( xsk.tx, 1 );
+      sink.flush();
+      source.wait();
     }
   }
+  sink.close();
+}
+
+// Event trace of the queue's decisions (see LOOPBACK_EVENT_LOG)
+struct TraceProbe : Loopback::NullProbe
+{
+  void received( Packet *pkts, size_t n )
+  {
+    for ( size_t i = 0; i < n; ++i )
+      EVENTLOG( "ingress rx addr={} len={}", pkts[i].addr, pkts[i].len );
+  }
+
+  void dropped( const Packet &pkt )
+  {
+    EVENTLOG( "ingress drop addr={} len={}", pkt.addr, pkt.len );
+  }
+};
+
+using Pipeline = Loopback::PacketPipeline<RxRingSource, PacketQueue, TxRingSink, TraceProbe>;
+
+// One RX queue: its ingress and egress socket and what they moved. --queues N runs N of these side
+// by side on the one UMEM, so they share no ring, no frame and no lock.
+struct Worker
+{
+  XDP_Socket ingress{};
+  XDP_Socket egress{};
+  uint64_t forwarded = 0;
+  Loopback::QueueStats queueStats;
+};
+
+// Deletes every socket created so far, egress ones first and queue 0's ingress socket, which holds
+// the UMEM's own rings, last; then the UMEM. Sockets never created are skipped.
+void teardown( std::vector<Worker> &workers, UMEM &umem )
+{
+  for ( Worker &w : workers )
+    close_xdp_socket( w.egress, umem );
+  for ( auto it = workers.rbegin(); it != workers.rend(); ++it )
+    close_xdp_socket( it->ingress, umem );
+  xsk_umem__delete( umem.umem );
+  munmap( umem.area, umem.size );
+  delete umem.fq;
+  delete umem.cq;
+}
+
+// Pins the calling thread to `cpu`, if one was asked for
+void pin_thread( int cpu )
+{
+  if ( cpu < 0 ) return;
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  CPU_SET( cpu, &set );
+  if ( pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) )
+    std::cerr << "Cannot pin a worker to CPU " << cpu << "\n";
+}
+
+// Runs a worker until SIGINT/SIGTERM: run-to-completion on the calling thread, on CPU `cpu` + q,
+// or ingress and egress on two threads of their own, on CPUs `cpu` + 2q and `cpu` + 2q + 1
+void run_worker( Worker &w,
+                 FrameTable &frames,
+                 const XdpOptions &opts,
+                 size_t queueDepth,
+                 Loopback::OverflowPolicy overflow )
+{
+  const int q = static_cast<int>( w.ingress.queue_id );
+  RxRingSource source{ w.ingress, w.egress, frames, opts, {} };
+  source.recycled.reserve( opts.frames );
+  TxRingSink sink{ w.egress, frames, opts };
+
+  if ( opts.run_to_completion )
+  {
+    pin_thread( opts.cpu < 0 ? -1 : opts.cpu + q );
+    run_to_completion( source, sink );
+  }
+  else
+  {
+    PacketQueue queue( queueDepth, overflow );
+    Pipeline pipeline( source, queue, sink, BATCH_SIZE );
+    const int cpu = opts.cpu < 0 ? -1 : opts.cpu + 2 * q;
+
+    std::thread t_rx( [&pipeline, cpu] {
+      pin_thread( cpu );
+      pipeline.ingress();
+    } );
+    std::thread t_tx( [&pipeline, cpu] {
+      pin_thread( cpu < 0 ? -1 : cpu + 1 );
+      pipeline.egress();
+    } );
+
+    t_rx.join();
+    t_tx.join();
+    w.queueStats = queue.stats();
+  }
+  w.forwarded = sink.sent;
+}
+
+// "2M" or "1G" in bytes; "none" is 0
+size_t parse_hugepage_size( const std::string &s )
+{
+  if ( s == "none" ) return 0;
+  if ( s == "2M" ) return 2UL << 20;
+  if ( s == "1G" ) return 1UL << 30;
+  throw std::invalid_argument( "--hugepages takes 2M, 1G or none" );
+}
+
+bool is_power_of_two( uint32_t n ) { return n && !( n & ( n - 1 ) ); }
+
+// "<proto>[:<port>]=<action>", e.g. udp:53=pass, tcp=drop or *=redirect. The protocol is tcp, udp,
+// icmp, a number or * for any; the destination port a number or *.
+XdpRule parse_rule( const std::string &s )
+{
+  const size_t eq = s.find( '=' );
+  if ( eq == std::string::npos ) throw std::invalid_argument( "--rule " + s + ": missing =action" );
+  const std::string match = s.substr( 0, eq );
+  const std::string action = s.substr( eq + 1 );
+  const size_t colon = match.find( ':' );
+  const std::string proto = match.substr( 0, colon );
+  const std::string port = colon == std::string::npos ? "*" : match.substr( colon + 1 );
+
+  XdpRule rule = {};
+  if ( proto == "tcp" )
+    rule.key.proto = IPPROTO_TCP;
+  else if ( proto == "udp" )
+    rule.key.proto = IPPROTO_UDP;
+  else if ( proto == "icmp" )
+    rule.key.proto = IPPROTO_ICMP;
+  else if ( proto != "*" && proto != "any" )
+  {
+    // 0 is the wildcard in the rules map
+    const unsigned long number = std::stoul( proto );
+    if ( number == 0 || number > 255 )
+      throw std::invalid_argument( "--rule " + s + ": protocol is 1-255" );
+    rule.key.proto = static_cast<uint8_t>( number );
+  }
+  if ( port != "*" )
+  {
+    const unsigned long number = std::stoul( port );
+    if ( number == 0 || number > 65535 )
+      throw std::invalid_argument( "--rule " + s + ": port is 1-65535" );
+    rule.key.dport = htons( static_cast<uint16_t>( number ) );
+  }
+  if ( rule.key.dport && !rule.key.proto )
+    throw std::invalid_argument( "--rule " + s + ": a port needs a protocol" );
+
+  const char *const *name = std::find( ACTION_NAMES, ACTION_NAMES + LOOPBACK_ACT_COUNT, action );
+  if ( name == ACTION_NAMES + LOOPBACK_ACT_COUNT )
+    throw std::invalid_argument( "--rule " + s + ": action is xsk, pass, drop, tx or redirect" );
+  rule.action = static_cast<uint32_t>( name - ACTION_NAMES );
+  return rule;
+}
+
+// loopback_xdp.bpf.o next to the executable, where the build puts it
+std::string default_xdp_obj()
+{
+  char exe[4096];
+  ssize_t n = readlink( "/proc/self/exe", exe, sizeof( exe ) - 1 );
+  if ( n <= 0 ) return "loopback_xdp.bpf.o";
+  std::string path( exe, n );
+  return path.substr( 0, path.rfind( '/' ) + 1 ) + "loopback_xdp.bpf.o";
+}
+
+void usage( const char *argv0 )
+{
+  std::cerr
+      << "Usage: " << argv0
+      << " [options] <ingress-if> <egress-if> [queue-depth] [block|drop-newest|drop-oldest]\n"
+         "  --run-to-completion  one thread from RX to TX, no queue (depth and policy unused)\n"
+         "  --need-wakeup        bind with XDP_USE_NEED_WAKEUP: kick the kernel only on request\n"
+         "  --poll-ms <ms>       when idle, sleep in poll() for up to <ms> instead of spinning\n"
+         "  --busy-poll <us>     SO_PREFER_BUSY_POLL with SO_BUSY_POLL=<us>\n"
+         "  --busy-budget <n>    SO_BUSY_POLL_BUDGET (default "
+      << BATCH_SIZE
+      << ")\n"
+         "  --queues <n>         serve RX queues 0..n-1, one worker each (default 1)\n"
+         "  --cpu <n>            pin the worker threads to consecutive CPUs from <n>\n"
+         "  --frames <n>         UMEM frames per queue, also the ring size (default "
+      << NUM_FRAMES
+      << ")\n"
+         "  --frame-size <n>     UMEM frame size, a power of two from 2048 (default "
+      << FRAME_SIZE
+      << "),\n"
+         "                       above the page size only on hugepages with Linux 6.6+\n"
+         "  --umem-dir <dir>     back the UMEM with a file on this hugetlbfs mount\n"
+         "  --hugepages <size>   2M (default), 1G or none: MAP_HUGETLB page size otherwise\n"
+         "  --xdp-obj <file>     XDP program (default loopback_xdp.bpf.o next to the binary),\n"
+         "                       or \"default\" for libxdp's, which sends everything to AF_XDP\n"
+         "  --rule <p[:port]=a>  XDP rule, repeatable: udp:53=pass, tcp=drop, *=redirect;\n"
+         "                       a is xsk (the default), pass, drop, tx or redirect\n";
 }
 
 int main( int argc, char **argv )
 {
-  if ( argc != 3 )
+  static const struct option longopts[] = {
+      { "run-to-completion", no_argument, nullptr, 'r' },
+      { "need-wakeup", no_argument, nullptr, 'w' },
+      { "poll-ms", required_argument, nullptr, 'p' },
+      { "busy-poll", required_argument, nullptr, 'b' },
+      { "busy-budget", required_argument, nullptr, 'B' },
+      { "queues", required_argument, nullptr, 'q' },
+      { "cpu", required_argument, nullptr, 'c' },
+      { "frames", required_argument, nullptr, 'f' },
+      { "frame-size", required_argument, nullptr, 'F' },
+      { "umem-dir", required_argument, nullptr, 'u' },
+      { "hugepages", required_argument, nullptr, 'H' },
+      { "xdp-obj", required_argument, nullptr, 'x' },
+      { "rule", required_argument, nullptr, 'R' },
+      { nullptr, 0, nullptr, 0 } };
+  XdpOptions opts;
+  Loopback::OverflowPolicy overflow = Loopback::OverflowPolicy::Block;
+  size_t queueDepth = QUEUE_DEPTH;
+  int opt;
+  try
   {
-    std::cerr << "Usage: " << argv[0] << " <ingress-if> <egress-if>\n";
+    while ( ( opt = getopt_long( argc, argv, "rwp:b:q:c:f:u:", longopts, nullptr ) ) != -1 )
+    {
+      switch ( opt )
+      {
+      case 'r':
+        opts.run_to_completion = true;
+        break;
+      case 'w':
+        opts.need_wakeup = true;
+        break;
+      case 'p':
+        opts.poll_ms = std::stoi( optarg );
+        break;
+      case 'b':
+        opts.busy_poll_us = std::stoi( optarg );
+        break;
+      case 'B':
+        opts.busy_poll_budget = std::stoi( optarg );
+        break;
+      case 'q':
+        opts.queues = static_cast<uint32_t>( std::stoul( optarg ) );
+        break;
+      case 'c':
+        opts.cpu = std::stoi( optarg );
+        break;
+      case 'f':
+        opts.frames = static_cast<uint32_t>( std::stoul( optarg ) );
+        break;
+      case 'F':
+        opts.frame_size = static_cast<uint32_t>( std::stoul( optarg ) );
+        break;
+      case 'u':
+        opts.umem_dir = optarg;
+        break;
+      case 'H':
+        opts.hugepage_size = parse_hugepage_size( optarg );
+        break;
+      case 'x':
+        opts.xdp_obj = optarg;
+        break;
+      case 'R':
+        opts.rules.push_back( parse_rule( optarg ) );
+        break;
+      default:
+        usage( argv[0] );
+        return 1;
+      }
+    }
+    if ( argc - optind >= 3 ) queueDepth = std::stoul( argv[optind + 2] );
+  }
+  catch ( const std::exception &ex )
+  {
+    std::cerr << "Invalid argument: " << ex.what() << "\n";
+    return 1;
+  }
+  const int positional = argc - optind;
+  if ( positional < 2 || positional > 4 || opts.queues == 0 || queueDepth == 0 ||
+       ( positional == 4 && !Loopback::parse_overflow_policy( argv[optind + 3], overflow ) ) )
+  {
+    usage( argv[0] );
+    return 1;
+  }
+  if ( !is_power_of_two( opts.frames ) || opts.frames < 2 * BATCH_SIZE ||
+       !is_power_of_two( opts.frame_size ) || opts.frame_size < 2048 )
+  {
+    std::cerr << "--frames must be a power of two from " << 2 * BATCH_SIZE
+              << ", --frame-size a power of two from 2048\n";
     return 1;
   }
+  if ( opts.xdp_obj.empty() ) opts.xdp_obj = default_xdp_obj();
+  if ( opts.xdp_obj != "default" && opts.queues > LOOPBACK_XDP_MAX_QUEUES )
+  {
+    std::cerr << "The XDP program serves at most " << LOOPBACK_XDP_MAX_QUEUES << " queues\n";
+    return 1;
+  }
+  const char *ingress = argv[optind];
+  const char *egress = argv[optind + 1];
 
   UMEM umem{};
-  if ( !setup_umem( umem ) )
+  if ( !setup_umem( umem, opts ) )
   {
     std::cerr << "UMEM setup failed\n";
     return 1;
   }
+  std::cout << "UMEM: " << ( umem.size >> 20 ) << " MiB, " << opts.queues << " x " << opts.frames
+            << " frames of " << opts.frame_size << " bytes, " << ( umem.page_size >> 10 )
+            << " KiB pages (" << umem.backing << ")\n";
 
-  XDP_Socket xsk_ing{}, xsk_eg{};
-  if ( !setup_xdp_socket( xsk_ing, argv[1], umem ) ) return 1;
-  if ( !setup_xdp_socket( xsk_eg, argv[2], umem ) ) return 1;
+  // Attached before the sockets exist: until they are in xsks_map, packets go to the kernel
+  std::vector<Worker> workers( opts.queues );
+  XdpProgram xdp;
+  if ( opts.xdp_obj != "default" )
+  {
+    if ( !load_xdp_program( xdp, opts, ingress, egress ) )
+    {
+      teardown( workers, umem );
+      return 1;
+    }
+    std::cout << "XDP: " << opts.xdp_obj << " on " << ingress << ", " << opts.rules.size()
+              << " rule(s)\n";
+  }
 
-  populate_fill_ring( umem );
+  // Queue 0's ingress socket first: it takes the UMEM's own fill and completion rings
+  for ( uint32_t q = 0; q < opts.queues; ++q )
+  {
+    Worker &w = workers[q];
+    bool ok = setup_xdp_socket( w.ingress, ingress, q, umem, true, opts );
+    if ( ok && xdp.prog && xsk_socket__update_xskmap( w.ingress.xsk, xdp.xsks_map ) )
+    {
+      std::cerr << "Cannot add queue " << q << " to xsks_map\n";
+      ok = false;
+    }
+    ok = ok && setup_xdp_socket( w.egress, egress, q, umem, false, opts );
+    if ( ok && opts.busy_poll_us &&
+         ( !enable_busy_poll( w.ingress, opts ) || !enable_busy_poll( w.egress, opts ) ) )
+    {
+      std::cerr << "Cannot enable busy polling (needs Linux 5.11+ and CAP_NET_ADMIN)\n";
+      ok = false;
+    }
+    if ( !ok )
+    {
+      teardown( workers, umem );
+      return 1;
+    }
+    populate_fill_ring( w.ingress, opts );
+  }
+  std::cout << "AF_XDP: " << ingress << " " << xdp_mode( workers[0].ingress ) << ", " << egress
+            << " " << xdp_mode( workers[0].egress ) << ", " << opts.queues << " queue(s), "
+            << ( opts.run_to_completion ? "run-to-completion" : "pipeline" )
+            << ( opts.need_wakeup ? ", need_wakeup" : "" ) << "\n";
 
-  PacketQueue queue;
-  std::thread t_rx( ingress_thread, std::ref( xsk_ing ), std::ref( umem ), std::ref( queue ) );
-  std::thread t_tx( egress_thread, std::ref( xsk_eg ), std::ref( queue ) );
+  FrameTable frames( size_t( opts.queues ) * opts.frames, opts.frame_size );
 
-  t_rx.join();
-  t_tx.join();
+  std::signal( SIGINT, on_signal );
+  std::signal( SIGTERM, on_signal );
 
-  xsk_socket__delete( xsk_ing.xsk );
-  xsk_socket__delete( xsk_eg.xsk );
-  xsk_umem__delete( umem.umem );
-  munmap( umem.area, umem.size );
-  delete umem.fq;
-  delete umem.cq;
+  // Optional binary event trace, rendered offline by EventLogDecoder
+  if ( const char *eventLog = std::getenv( "LOOPBACK_EVENT_LOG" ) )
+  {
+    try
+    {
+      Logging::EventLog::start( eventLog );
+    }
+    catch ( const std::exception &ex )
+    {
+      std::cerr << "Cannot open event log: " << ex.what() << "\n";
+      teardown( workers, umem );
+      return 1;
+    }
+  }
+
+  // Worker 0 runs on the main thread. Only with --run-to-completion does its poll() run there too
+  // and get cut short by SIGINT; any other poll() sees `running` cleared within --poll-ms
+  std::vector<std::thread> threads;
+  for ( uint32_t q = 1; q < opts.queues; ++q )
+  {
+    threads.emplace_back( [&workers, &frames, &opts, queueDepth, overflow, q] {
+      run_worker( workers[q], frames, opts, queueDepth, overflow );
+    } );
+  }
+  run_worker( workers[0], frames, opts, queueDepth, overflow );
+  for ( std::thread &t : threads )
+    t.join();
+  Logging::EventLog::stop();
+
+  // --- Statistics, summed over queues ---
+  Loopback::QueueStats qs;
+  uint64_t forwarded = 0;
+  std::string perQueue;
+  for ( const Worker &w : workers )
+  {
+    forwarded += w.forwarded;
+    perQueue += " " + std::to_string( w.forwarded );
+    qs.capacity = w.queueStats.capacity;
+    qs.high_water = std::max( qs.high_water, w.queueStats.high_water );
+    qs.queued += w.queueStats.queued;
+    qs.dropped_newest += w.queueStats.dropped_newest;
+    qs.dropped_oldest += w.queueStats.dropped_oldest;
+    qs.blocked += w.queueStats.blocked;
+  }
+  std::cout << "Forwarded: " << forwarded;
+  if ( opts.queues > 1 ) std::cout << " per_queue=" << perQueue.substr( 1 );
+  std::cout << "\n";
+  if ( !opts.run_to_completion )
+  {
+    std::cout << "Queue: capacity=" << qs.capacity
+              << " overflow=" << Loopback::to_string( overflow ) << " high_water=" << qs.high_water
+              << " queued=" << qs.queued << " dropped_newest=" << qs.dropped_newest
+              << " dropped_oldest=" << qs.dropped_oldest << " blocked=" << qs.blocked << "\n";
+  }
+  if ( xdp.prog )
+  {
+    std::vector<loopback_counter> xdpStats = read_xdp_stats( xdp );
+    std::cout << "XDP:";
+    for ( uint32_t action = 0; action < LOOPBACK_ACT_COUNT; ++action )
+      std::cout << " " << ACTION_NAMES[action] << "=" << xdpStats[action].packets;
+    std::cout << "\n";
+  }
+  std::cout << "Frames: fill=" << frames.count( FrameState::Fill )
+            << " rx=" << frames.count( FrameState::Rx ) << " tx=" << frames.count( FrameState::Tx )
+            << " violations=" << frames.violations() << "\n";
 
+  teardown( workers, umem );
   return 0;
 }
@@ -0,0 +1,470 @@
+#include <Loopback/BoundedQueue.hpp>
+#include <Loopback/MmapPcapReader.hpp>
+#include <Loopback/PacketPipeline.hpp>
+#include <Loopback/PacketPool.hpp>
+#include <Loopback/SpscRing.hpp>
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <pcap/pcap.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Microbenchmarks of the hot primitives shared by the Loopback apps: the ingress -> egress
+// handoff through each queue, the packet buffer strategies and pcap record parsing.
+//
+//   LoopbackBench --benchmark_out=results.json --benchmark_out_format=json
+//
+// Arguments are swept over packet size (minimum Ethernet frame to jumbo frame), batch size and
+// thread placement. items_per_second is packets per second.
+
+namespace {
+
+constexpr std::size_t QUEUE_DEPTH = 4096;
+constexpr std::size_t PACKETS_PER_ITERATION = 1 << 16;
+constexpr std::size_t MAX_PACKET = 9000;
+
+const std::vector<int64_t> PACKET_SIZES = { 64, 512, 1500, 9000 };
+const std::vector<int64_t> BATCH_SIZES = { 1, 16, 64 };
+
+// Where the ingress and egress threads run
+enum Placement : int64_t
+{
+  ANY_CPU,  // left to the scheduler
+  SAME_CPU, // both pinned to one CPU: every handoff is a context switch
+  TWO_CPUS  // pinned to two different CPUs: every handoff crosses caches
+};
+
+const char *to_string( Placement p )
+{
+  switch ( p )
+  {
+  case ANY_CPU:
+    return "any-cpu";
+  case SAME_CPU:
+    return "same-cpu";
+  case TWO_CPUS:
+    return "two-cpus";
+  }
+  return "unknown";
+}
+
+// CPUs for ingress and egress under `placement`, -1 for unpinned. False if the process may not
+// use enough CPUs.
+bool placement_cpus( Placement placement, int &ingress, int &egress )
+{
+  ingress = egress = -1;
+  if ( placement == ANY_CPU ) return true;
+
+  cpu_set_t set;
+  if ( sched_getaffinity( 0, sizeof( set ), &set ) != 0 ) return false;
+  std::vector<int> cpus;
+  for ( int cpu = 0; cpu < CPU_SETSIZE && cpus.size() < 2; ++cpu )
+    if ( CPU_ISSET( cpu, &set ) ) cpus.push_back( cpu );
+
+  if ( cpus.empty() || ( placement == TWO_CPUS && cpus.size() < 2 ) ) return false;
+  ingress = cpus[0];
+  egress = placement == TWO_CPUS ? cpus[1] : cpus[0];
+  return true;
+}
+
+void pin_current_thread( int cpu )
+{
+  if ( cpu < 0 ) return;
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  CPU_SET( cpu, &set );
+  pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+}
+
+// --- Queues -------------------------------------------------------------------------------------
+
+// The mutex + condvar queue (LoopbackBoost --queue mutex, LoopbackPOCO, AF_XDP, DPDK)
+template <typename Item> class MutexQueue : public Loopback::BoundedQueue<Item>
+{
+public:
+  explicit MutexQueue( std::size_t capacity )
+      : Loopback::BoundedQueue<Item>( capacity, Loopback::OverflowPolicy::Block )
+  {
+  }
+};
+
+// The lock-free SPSC ring (LoopbackBoost --queue spsc) with the default wait strategy
+template <typename Item> class RingQueue
+{
+public:
+  explicit RingQueue( std::size_t capacity )
+      : m_ring( capacity )
+  {
+  }
+
+  // Blocks for space, so nothing is dropped unless the ring is closed
+  std::size_t push_bulk( Item *items, std::size_t n ) { return n - m_ring.push_bulk( items, n ); }
+  std::size_t pop_bulk( Item *items, std::size_t max ) { return m_ring.pop_bulk( items, max ); }
+  std::size_t try_pop_bulk( Item *items, std::size_t max )
+  {
+    return m_ring.try_pop_bulk( items, max );
+  }
+  void stop() { m_ring.close(); }
+
+private:
+  Loopback::SpscRing<Item> m_ring;
+};
+
+// --- Buffer strategies --------------------------------------------------------------------------
+//
+// Each strategy is a Source producing `count` copies of `frame` and a Sink that reads them, in
+// the shape Loopback::PacketPipeline expects. The sink touches the first and last byte so the
+// packet's cache lines travel to the egress thread as they would before a send.
+
+struct OwnedPacket
+{
+  std::vector<uint8_t> data;
+};
+
+template <typename Fill> class OwnedSource
+{
+public:
+  using Item = OwnedPacket;
+
+  OwnedSource( const std::vector<uint8_t> &frame, std::size_t count )
+      : m_frame( frame ),
+        m_left( count )
+  {
+  }
+
+  std::size_t receive( OwnedPacket *items, std::size_t max )
+  {
+    std::size_t n = std::min( max, m_left );
+    for ( std::size_t i = 0; i < n; ++i )
+      Fill()( items[i], m_frame );
+    m_left -= n;
+    return n;
+  }
+
+  bool done() const { return m_left == 0; }
+  void reject( OwnedPacket & ) {}
+
+private:
+  const std::vector<uint8_t> &m_frame;
+  std::size_t m_left;
+};
+
+struct OwnedSink
+{
+  void send( OwnedPacket *items, std::size_t n )
+  {
+    for ( std::size_t i = 0; i < n; ++i )
+    {
+      const std::vector<uint8_t> &data = items[i].data;
+      benchmark::DoNotOptimize( data.front() + data.back() );
+    }
+  }
+
+  void flush() {}
+  void close() {}
+};
+
+// A new heap buffer for every packet
+struct FreshBuffers
+{
+  struct Fill
+  {
+    void operator()( OwnedPacket &pkt, const std::vector<uint8_t> &frame ) const
+    {
+      pkt = OwnedPacket{ std::vector<uint8_t>( frame ) };
+    }
+  };
+
+  using Source = OwnedSource<Fill>;
+  using Sink = OwnedSink;
+
+  Source source( const std::vector<uint8_t> &frame, std::size_t count )
+  {
+    return Source( frame, count );
+  }
+  Sink sink() { return Sink(); }
+};
+
+// Owning buffers reused in place (LoopbackBoost): the queues swap items in and out, so the
+// vectors circulate between the threads and reallocate only when a packet outgrows them
+struct RecycledBuffers
+{
+  struct Fill
+  {
+    void operator()( OwnedPacket &pkt, const std::vector<uint8_t> &frame ) const
+    {
+      pkt.data.assign( frame.begin(), frame.end() );
+    }
+  };
+
+  using Source = OwnedSource<Fill>;
+  using Sink = OwnedSink;
+
+  Source source( const std::vector<uint8_t> &frame, std::size_t count )
+  {
+    return Source( frame, count );
+  }
+  Sink sink() { return Sink(); }
+};
+
+// Handles into a fixed slab (LoopbackPOCO): ingress acquires and copies, egress releases
+struct PoolBuffers
+{
+  using Pool = Loopback::PacketPool<uint32_t>; // header: packet length
+
+  class Source
+  {
+  public:
+    using Item = Pool::Handle;
+
+    Source( Pool &pool, const std::vector<uint8_t> &frame, std::size_t count )
+        : m_pool( pool ),
+          m_frame( frame ),
+          m_left( count )
+    {
+    }
+
+    std::size_t receive( Pool::Handle *slots, std::size_t max )
+    {
+      std::size_t n = std::min( max, m_left );
+      for ( std::size_t i = 0; i < n; ++i )
+      {
+        if ( !m_pool.acquire( slots[i] ) )
+        {
+          m_left = 0; // pool closed: stop with what was filled
+          return i;
+        }
+        m_pool.header( slots[i] ) = static_cast<uint32_t>( m_frame.size() );
+        std::memcpy( m_pool.data( slots[i] ), m_frame.data(), m_frame.size() );
+      }
+      m_left -= n;
+      return n;
+    }
+
+    bool done() const { return m_left == 0; }
+
+    // The blocking queues never reject
+    void reject( Pool::Handle ) {}
+
+  private:
+    Pool &m_pool;
+    const std::vector<uint8_t> &m_frame;
+    std::size_t m_left;
+  };
+
+  class Sink
+  {
+  public:
+    explicit Sink( Pool &pool )
+        : m_pool( pool )
+    {
+    }
+
+    void send( Pool::Handle *slots, std::size_t n )
+    {
+      for ( std::size_t i = 0; i < n; ++i )
+      {
+        const uint8_t *data = m_pool.data( slots[i] );
+        benchmark::DoNotOptimize( data[0] + data[m_pool.header( slots[i] ) - 1] );
+        m_pool.release( slots[i] );
+      }
+    }
+
+    void flush() {}
+    void close() {}
+
+  private:
+    Pool &m_pool;
+  };
+
+  // Queue plus one batch in flight at each end
+  Pool pool{ static_cast<uint32_t>( QUEUE_DEPTH + 2 * 64 ), static_cast<uint32_t>( MAX_PACKET ) };
+
+  Source source( const std::vector<uint8_t> &frame, std::size_t count )
+  {
+    return Source( pool, frame, count );
+  }
+  Sink sink() { return Sink( pool ); }
+};
+
+// --- Benchmarks ---------------------------------------------------------------------------------
+
+std::vector<uint8_t> make_frame( std::size_t size )
+{
+  std::vector<uint8_t> frame( size );
+  for ( std::size_t i = 0; i < size; ++i )
+    frame[i] = static_cast<uint8_t>( i );
+  return frame;
+}
+
+// A single thread cycles batches through a buffer strategy: acquire, copy in, read, release
+template <typename Buffers> void BM_BufferCycle( benchmark::State &state )
+{
+  const std::size_t size = state.range( 0 );
+  const std::size_t batch = state.range( 1 );
+  const std::vector<uint8_t> frame = make_frame( size );
+  Buffers buffers;
+  typename Buffers::Sink sink = buffers.sink();
+  std::vector<typename Buffers::Source::Item> items( batch );
+
+  for ( auto _ : state )
+  {
+    typename Buffers::Source source = buffers.source( frame, batch );
+    std::size_t n = source.receive( items.data(), items.size() );
+    sink.send( items.data(), n );
+  }
+  state.SetItemsProcessed( state.iterations() * batch );
+  state.SetBytesProcessed( state.iterations() * batch * size );
+}
+
+// PACKETS_PER_ITERATION packets through Loopback::PacketPipeline on two threads, as in the apps
+template <template <typename> class Queue, typename Buffers>
+void BM_Pipeline( benchmark::State &state )
+{
+  using Source = typename Buffers::Source;
+  using Sink = typename Buffers::Sink;
+  using Pipeline = Loopback::PacketPipeline<Source, Queue<typename Source::Item>, Sink>;
+
+  const std::size_t size = state.range( 0 );
+  const std::size_t batch = state.range( 1 );
+  const Placement placement = static_cast<Placement>( state.range( 2 ) );
+  int ingress_cpu, egress_cpu;
+  if ( !placement_cpus( placement, ingress_cpu, egress_cpu ) )
+  {
+    state.SkipWithError( "not enough CPUs for this placement" );
+    return;
+  }
+  state.SetLabel( to_string( placement ) );
+
+  const std::vector<uint8_t> frame = make_frame( size );
+  Buffers buffers;
+
+  for ( auto _ : state )
+  {
+    state.PauseTiming();
+    Queue<typename Source::Item> queue( QUEUE_DEPTH );
+    Source source = buffers.source( frame, PACKETS_PER_ITERATION );
+    Sink sink = buffers.sink();
+    Pipeline pipeline( source, queue, sink, batch );
+    state.ResumeTiming();
+
+    std::thread rx( [&] {
+      pin_current_thread( ingress_cpu );
+      pipeline.ingress();
+    } );
+    std::thread tx( [&] {
+      pin_current_thread( egress_cpu );
+      pipeline.egress();
+    } );
+    rx.join();
+    tx.join();
+  }
+  state.SetItemsProcessed( state.iterations() * PACKETS_PER_ITERATION );
+  state.SetBytesProcessed( state.iterations() * PACKETS_PER_ITERATION * size );
+}
+
+// A pcap file of `size`-byte packets, about 64 MiB in total, written once per size and removed
+// at exit
+const std::string &pcap_file( std::size_t size )
+{
+  struct TempFiles
+  {
+    std::map<std::size_t, std::string> paths;
+    ~TempFiles()
+    {
+      for ( const auto &p : paths )
+        std::remove( p.second.c_str() );
+    }
+  };
+  static TempFiles files;
+
+  std::string &path = files.paths[size];
+  if ( !path.empty() ) return path;
+
+  const char *dir = std::getenv( "TMPDIR" );
+  path = std::string( dir ? dir : "/tmp" ) + "/loopback-bench-" + std::to_string( getpid() ) + "-" +
+         std::to_string( size ) + ".pcap";
+  std::ofstream out( path, std::ios::binary );
+
+  struct pcap_file_header fh = {};
+  fh.magic = Loopback::MmapPcapReader::MAGIC_USEC;
+  fh.version_major = PCAP_VERSION_MAJOR;
+  fh.version_minor = PCAP_VERSION_MINOR;
+  fh.snaplen = MAX_PACKET;
+  fh.linktype = DLT_EN10MB;
+  out.write( reinterpret_cast<const char *>( &fh ), sizeof( fh ) );
+
+  const std::vector<uint8_t> frame = make_frame( size );
+  for ( std::size_t i = 0, n = ( 64u << 20 ) / size; i < n; ++i )
+  {
+    uint32_t rec[4] = { static_cast<uint32_t>( i / 1000000 ),
+                        static_cast<uint32_t>( i % 1000000 ),
+                        static_cast<uint32_t>( size ),
+                        static_cast<uint32_t>( size ) };
+    out.write( reinterpret_cast<const char *>( rec ), sizeof( rec ) );
+    out.write( reinterpret_cast<const char *>( frame.data() ), frame.size() );
+  }
+  return path;
+}
+
+// Walks every record of a page-cached capture with MmapPcapReader::next_ex, reading the
+// Ethernet type of each packet
+void BM_PcapParse( benchmark::State &state )
+{
+  const std::string &path = pcap_file( state.range( 0 ) );
+  uint64_t packets = 0, bytes = 0;
+
+  for ( auto _ : state )
+  {
+    Loopback::MmapPcapReader reader( path );
+    struct pcap_pkthdr *hdr;
+    const u_char *data;
+    while ( reader.next_ex( &hdr, &data ) == 1 )
+    {
+      benchmark::DoNotOptimize( data[12] << 8 | data[13] );
+      ++packets;
+      bytes += hdr->caplen;
+    }
+  }
+  state.SetItemsProcessed( packets );
+  state.SetBytesProcessed( bytes );
+}
+
+void pipeline_args( benchmark::internal::Benchmark *b )
+{
+  b->ArgNames( { "size", "batch", "placement" } );
+  b->ArgsProduct( { PACKET_SIZES, BATCH_SIZES, { ANY_CPU, SAME_CPU, TWO_CPUS } } );
+  b->UseRealTime();
+  b->Unit( benchmark::kMillisecond );
+}
+
+void buffer_args( benchmark::internal::Benchmark *b )
+{
+  b->ArgNames( { "size", "batch" } );
+  b->ArgsProduct( { PACKET_SIZES, BATCH_SIZES } );
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE( BM_BufferCycle, FreshBuffers )->Apply( buffer_args );
+BENCHMARK_TEMPLATE( BM_BufferCycle, RecycledBuffers )->Apply( buffer_args );
+BENCHMARK_TEMPLATE( BM_BufferCycle, PoolBuffers )->Apply( buffer_args );
+
+BENCHMARK_TEMPLATE( BM_Pipeline, MutexQueue, RecycledBuffers )->Apply( pipeline_args );
+BENCHMARK_TEMPLATE( BM_Pipeline, MutexQueue, PoolBuffers )->Apply( pipeline_args );
+BENCHMARK_TEMPLATE( BM_Pipeline, RingQueue, RecycledBuffers )->Apply( pipeline_args );
+BENCHMARK_TEMPLATE( BM_Pipeline, RingQueue, PoolBuffers )->Apply( pipeline_args );
+
+BENCHMARK( BM_PcapParse )->ArgName( "size" )->ArgsProduct( { PACKET_SIZES } );
+
+BENCHMARK_MAIN();
@@ -0,0 +1,505 @@
+#include <Loopback/PacketBuilder.hpp>
+#include <Loopback/PacketSender.hpp>
+#include <Loopback/Pacer.hpp>
+#include <Loopback/UringPcapWriter.hpp>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <pcap/pcap.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Synthetic traffic generator: Ethernet [/ 802.1Q] / IPv4|IPv6 / UDP|TCP over any number of flows
+// and a fixed, weighted or IMIX size mix, written to a pcap file or sent to a device.
+//
+//   LoopbackGen --out input.pcap --count 10000000 --flows 1024 --imix simple
+//   LoopbackGen --device veth0 --count 0 --tcp --ipv6 --vlan 100 --size 1518 --pps 1000000
+//
+// Sizes are Ethernet frame sizes including the 4-byte FCS, as in RFC 2544 and the IMIX
+// profiles; the frames written or sent are 4 bytes shorter. Every distinct size is built once
+// with its checksums, after which each packet only patches flow, IP ID and TCP sequence fields.
+
+namespace {
+
+constexpr std::size_t FCS = 4;
+
+std::atomic<bool> running{ true };
+
+void on_signal( int ) { running = false; }
+
+struct Options
+{
+  std::string out;
+  std::string device;
+  uint64_t count = 1000000; // 0: until interrupted
+  uint32_t flows = 1;
+  bool ipv6 = false;
+  bool tcp = false;
+  int vlan = -1;
+  std::string sizes = "64";
+  double pps = 0;
+  double mbps = 0;
+  bool tx_ring = false;
+  bool qdisc_bypass = false;
+  uint64_t seed = 1;
+  std::string src_ip;
+  std::string dst_ip;
+  Loopback::MacAddress src_mac = { 0x02, 0, 0, 0, 0, 0x01 };
+  Loopback::MacAddress dst_mac = { 0x02, 0, 0, 0, 0, 0x02 };
+  uint16_t sport = 1024;
+  uint16_t dport = 0; // 0: 9 (discard) for UDP, 80 for TCP
+};
+
+// Named size mixes, "size:weight,..."
+const char *imix_profile( const std::string &name )
+{
+  if ( name == "simple" ) return "64:7,570:4,1518:1";
+  if ( name == "tolly" ) return "64:55,78:5,576:17,1518:23";
+  return nullptr;
+}
+
+//! @brief Frame size mix: "1500", "64:7,570:4,1518:1" or an inclusive range "64-1518"
+struct SizeMix
+{
+  std::vector<std::size_t> sizes; // distinct sizes, including FCS
+  std::vector<uint32_t> table;    // indices into sizes, in proportion to the weights
+};
+
+SizeMix parse_sizes( const std::string &spec )
+{
+  std::vector<std::pair<std::size_t, uint64_t>> weights;
+  std::size_t dash = spec.find( '-' );
+  if ( dash != std::string::npos )
+  {
+    std::size_t lo = std::stoul( spec.substr( 0, dash ) );
+    std::size_t hi = std::stoul( spec.substr( dash + 1 ) );
+    if ( lo > hi ) throw std::invalid_argument( "size range " + spec );
+    for ( std::size_t s = lo; s <= hi; ++s )
+      weights.emplace_back( s, 1 );
+  }
+  else
+  {
+    std::stringstream in( spec );
+    std::string item;
+    while ( std::getline( in, item, ',' ) )
+    {
+      std::size_t colon = item.find( ':' );
+      uint64_t weight = colon == std::string::npos ? 1 : std::stoull( item.substr( colon + 1 ) );
+      if ( weight ) weights.emplace_back( std::stoul( item.substr( 0, colon ) ), weight );
+    }
+  }
+  if ( weights.empty() ) throw std::invalid_argument( "empty size mix" );
+
+  uint64_t total = 0;
+  for ( const auto &w : weights )
+  {
+    if ( w.first < 64 || w.first > 9018 )
+      throw std::invalid_argument( "frame size " + std::to_string( w.first ) + " (64..9018)" );
+    total += w.second;
+  }
+
+  // At most 64 Ki table entries, every size keeps at least one
+  const uint64_t slots = std::min<uint64_t>( total, 1 << 16 );
+  SizeMix mix;
+  for ( const auto &w : weights )
+  {
+    mix.sizes.push_back( w.first );
+    uint64_t n = std::max<uint64_t>( 1, w.second * slots / total );
+    mix.table.insert( mix.table.end(), n, static_cast<uint32_t>( mix.sizes.size() - 1 ) );
+  }
+  return mix;
+}
+
+bool parse_mac( const std::string &text, Loopback::MacAddress &mac )
+{
+  unsigned b[6];
+  char extra;
+  int n = std::sscanf(
+      text.c_str(), "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &extra );
+  if ( n != 6 ) return false;
+  for ( int i = 0; i < 6; ++i )
+    mac[i] = static_cast<uint8_t>( b[i] );
+  return true;
+}
+
+template <typename Address> void parse_ip( int family, const std::string &text, Address &addr )
+{
+  if ( !text.empty() && inet_pton( family, text.c_str(), addr.data() ) != 1 )
+    throw std::invalid_argument( "address " + text );
+}
+
+// xorshift64: size selection must cost next to nothing per packet
+struct Random
+{
+  uint64_t state;
+  uint64_t operator()()
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+};
+
+//! @brief pcap file via io_uring. Timestamps follow --pps / --mbps, 1 Mpps by default.
+class PcapOutput
+{
+public:
+  PcapOutput( const std::string &path, const Options &opts )
+      : m_writer( path, DLT_EN10MB, 65535 ),
+        m_pps( opts.pps > 0 || opts.mbps > 0 ? opts.pps : 1e6 ),
+        m_mbps( opts.mbps )
+  {
+  }
+
+  bool send( const uint8_t *data, uint32_t len )
+  {
+    const uint64_t ns = m_pps > 0 ? static_cast<uint64_t>( m_packets * 1e9 / m_pps )
+                                  : static_cast<uint64_t>( m_bytes * 8 * 1e3 / m_mbps );
+    struct pcap_pkthdr hdr;
+    hdr.ts.tv_sec = static_cast<time_t>( ns / 1000000000 );
+    hdr.ts.tv_usec = static_cast<suseconds_t>( ns % 1000000000 / 1000 );
+    hdr.caplen = hdr.len = len;
+    ++m_packets;
+    m_bytes += len + FCS;
+    if ( m_writer.write( hdr, data ) ) return true;
+    std::cerr << "Write error: " << m_writer.error() << std::endl;
+    return false;
+  }
+
+  void close()
+  {
+    m_writer.close();
+    auto s = m_writer.stats();
+    std::cout << "Writer: MB/s=" << s.bytes_per_sec / 1e6 << " writes=" << s.writes
+              << " stalls=" << s.stalls << std::endl;
+  }
+
+private:
+  Loopback::UringPcapWriter m_writer;
+  double m_pps;
+  double m_mbps;
+  uint64_t m_packets = 0;
+  uint64_t m_bytes = 0;
+};
+
+//! @brief Live device via PacketSender, paced by Pacer when --pps / --mbps is given
+class DeviceOutput
+{
+public:
+  DeviceOutput( const std::string &device, const Options &opts, std::size_t max_frame )
+      : m_sender( device, sender_options( opts, max_frame ) )
+  {
+    if ( opts.pps > 0 || opts.mbps > 0 )
+    {
+      Loopback::Pacer::Options pacing;
+      pacing.pps = opts.pps;
+      pacing.mbps = opts.mbps;
+      m_pacer.reset( new Loopback::Pacer( pacing ) );
+    }
+  }
+
+  bool send( const uint8_t *data, uint32_t len )
+  {
+    if ( m_pacer )
+    {
+      struct pcap_pkthdr hdr = {};
+      hdr.caplen = hdr.len = len + FCS;
+      uint64_t due = m_pacer->schedule( hdr );
+      if ( !m_pacer->reached( due ) ) m_sender.flush(); // earlier packets go out on time
+      m_pacer->wait( due );
+    }
+    m_sender.send( data, len );
+    if ( !m_pacer ) m_sender.flush_if_due();
+    return true;
+  }
+
+  void close()
+  {
+    m_sender.flush();
+    auto s = m_sender.stats();
+    std::cout << "Sender: packets=" << s.packets << " failed=" << s.failed
+              << " batches=" << s.batches;
+    if ( s.last_errno ) std::cout << " last_error=" << std::strerror( s.last_errno );
+    std::cout << std::endl;
+    if ( m_pacer )
+    {
+      auto p = m_pacer->stats();
+      std::cout << "Pacing: target_pps=" << p.target_pps << " achieved_pps=" << p.achieved_pps
+                << " error_p99_ns=" << p.error_p99_ns << " late=" << p.late << std::endl;
+    }
+  }
+
+private:
+  static Loopback::PacketSender::Options sender_options( const Options &opts,
+                                                         std::size_t max_frame )
+  {
+    Loopback::PacketSender::Options out;
+    out.mode = opts.tx_ring ? Loopback::PacketSender::Mode::TxRing
+                            : Loopback::PacketSender::Mode::Sendmmsg;
+    out.frame_size = static_cast<uint32_t>( std::max<std::size_t>( max_frame, 2048 ) );
+    out.qdisc_bypass = opts.qdisc_bypass;
+    return out;
+  }
+
+  Loopback::PacketSender m_sender;
+  std::unique_ptr<Loopback::Pacer> m_pacer;
+};
+
+template <typename Builder, typename Output>
+int generate( const Builder &builder, const SizeMix &mix, const Options &opts, Output &out )
+{
+  // One prebuilt frame per distinct size, patched in place for every packet
+  std::vector<std::vector<uint8_t>> frames;
+  for ( std::size_t size : mix.sizes )
+  {
+    std::size_t len = std::max( size - FCS, Builder::HEADER_SIZE );
+    if ( len != size - FCS )
+    {
+      std::cerr << "Frame size " << size << " is too small for these headers, using "
+                << len + FCS << std::endl;
+    }
+    frames.emplace_back( len );
+    builder.build( frames.back().data(), len );
+  }
+
+  std::vector<uint32_t> seq( opts.flows, 1 ); // TCP sequence number per flow
+  Random random{ opts.seed ? opts.seed : 1 };
+  const bool fixed = mix.sizes.size() == 1;
+  uint64_t packets = 0, bytes = 0;
+  bool ok = true;
+
+  const auto start = std::chrono::steady_clock::now();
+  for ( ; running && ( opts.count == 0 || packets < opts.count ); ++packets )
+  {
+    std::vector<uint8_t> &frame = frames[fixed ? 0 : mix.table[random() % mix.table.size()]];
+    const uint32_t flow = static_cast<uint32_t>( packets % opts.flows );
+    builder.patch( frame.data(), flow, static_cast<uint16_t>( packets ), seq[flow] );
+    seq[flow] += static_cast<uint32_t>( frame.size() - Builder::HEADER_SIZE );
+    if ( !out.send( frame.data(), static_cast<uint32_t>( frame.size() ) ) )
+    {
+      ok = false;
+      break;
+    }
+    bytes += frame.size() + FCS;
+  }
+  out.close();
+  const double secs =
+      std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+  std::cout << "Generated: packets=" << packets << " bytes=" << bytes << " seconds=" << secs
+            << " pps=" << packets / secs << " Gbps=" << bytes * 8 / secs / 1e9 << std::endl;
+  return ok ? 0 : 1;
+}
+
+// Picks the PacketBuilder instantiation once, from --ipv6 / --tcp / --vlan
+template <typename Fn> int with_builder( const Options &opts, Fn &&fn )
+{
+  auto with_l4 = [&]( auto l3 ) {
+    auto with_tag = [&]( auto l4 ) {
+      if ( opts.dport ) l4.dport = opts.dport;
+      l4.sport = opts.sport;
+      if ( opts.vlan >= 0 )
+      {
+        Loopback::Vlan tag;
+        tag.vid = static_cast<uint16_t>( opts.vlan );
+        return fn( Loopback::PacketBuilder<decltype( l3 ), decltype( l4 ), Loopback::Vlan>(
+            opts.dst_mac, opts.src_mac, tag, l3, l4 ) );
+      }
+      return fn( Loopback::PacketBuilder<decltype( l3 ), decltype( l4 )>(
+          opts.dst_mac, opts.src_mac, {}, l3, l4 ) );
+    };
+    return opts.tcp ? with_tag( Loopback::Tcp{} ) : with_tag( Loopback::Udp{} );
+  };
+
+  if ( opts.ipv6 )
+  {
+    Loopback::IPv6 l3;
+    parse_ip( AF_INET6, opts.src_ip, l3.src );
+    parse_ip( AF_INET6, opts.dst_ip, l3.dst );
+    return with_l4( l3 );
+  }
+  Loopback::IPv4 l3;
+  parse_ip( AF_INET, opts.src_ip, l3.src );
+  parse_ip( AF_INET, opts.dst_ip, l3.dst );
+  return with_l4( l3 );
+}
+
+void usage( const char *argv0 )
+{
+  std::cerr
+      << "Usage: " << argv0 << " (--out <file.pcap> | --device <dev>) [options]\n"
+      << "  --count n          packets to generate, 0 = until interrupted (default 1000000)\n"
+      << "  --flows n          flows, round robin over source port/address (default 1)\n"
+      << "  --ipv6 --tcp       IPv6 instead of IPv4, TCP instead of UDP\n"
+      << "  --vlan vid         add an 802.1Q tag\n"
+      << "  --size spec        frame sizes incl. FCS: 1518, 64:7,570:4,1518:1 or 64-1518\n"
+      << "  --imix name        simple (64:7,570:4,1518:1) or tolly (64:55,78:5,576:17,1518:23)\n"
+      << "  --pps n --mbps n   send rate (device) or timestamp spacing (file, default 1 Mpps)\n"
+      << "  --tx-ring          PACKET_TX_RING instead of sendmmsg (device)\n"
+      << "  --qdisc-bypass     skip the qdisc layer (device)\n"
+      << "  --src-ip --dst-ip --src-mac --dst-mac --sport --dport --seed\n";
+}
+
+} // namespace
+
+int main( int argc, char **argv )
+{
+  enum
+  {
+    OPT_TX_RING = 256,
+    OPT_QDISC_BYPASS,
+    OPT_SRC_IP,
+    OPT_DST_IP,
+    OPT_SRC_MAC,
+    OPT_DST_MAC,
+    OPT_SPORT,
+    OPT_DPORT,
+    OPT_SEED,
+    OPT_MBPS,
+    OPT_IMIX
+  };
+  static const struct option longopts[] = {
+      { "out", required_argument, nullptr, 'o' },
+      { "device", required_argument, nullptr, 'd' },
+      { "count", required_argument, nullptr, 'n' },
+      { "flows", required_argument, nullptr, 'f' },
+      { "ipv6", no_argument, nullptr, '6' },
+      { "tcp", no_argument, nullptr, 't' },
+      { "vlan", required_argument, nullptr, 'v' },
+      { "size", required_argument, nullptr, 's' },
+      { "imix", required_argument, nullptr, OPT_IMIX },
+      { "pps", required_argument, nullptr, 'p' },
+      { "mbps", required_argument, nullptr, OPT_MBPS },
+      { "tx-ring", no_argument, nullptr, OPT_TX_RING },
+      { "qdisc-bypass", no_argument, nullptr, OPT_QDISC_BYPASS },
+      { "src-ip", required_argument, nullptr, OPT_SRC_IP },
+      { "dst-ip", required_argument, nullptr, OPT_DST_IP },
+      { "src-mac", required_argument, nullptr, OPT_SRC_MAC },
+      { "dst-mac", required_argument, nullptr, OPT_DST_MAC },
+      { "sport", required_argument, nullptr, OPT_SPORT },
+      { "dport", required_argument, nullptr, OPT_DPORT },
+      { "seed", required_argument, nullptr, OPT_SEED },
+      { nullptr, 0, nullptr, 0 } };
+
+  Options opts;
+  SizeMix mix;
+  try
+  {
+    int opt;
+    while ( ( opt = getopt_long( argc, argv, "o:d:n:f:6tv:s:p:", longopts, nullptr ) ) != -1 )
+    {
+      switch ( opt )
+      {
+      case 'o':
+        opts.out = optarg;
+        break;
+      case 'd':
+        opts.device = optarg;
+        break;
+      case 'n':
+        opts.count = std::stoull( optarg );
+        break;
+      case 'f':
+        opts.flows = static_cast<uint32_t>( std::max( 1ul, std::stoul( optarg ) ) );
+        break;
+      case '6':
+        opts.ipv6 = true;
+        break;
+      case 't':
+        opts.tcp = true;
+        break;
+      case 'v':
+        opts.vlan = std::stoi( optarg ) & 0x0fff;
+        break;
+      case 's':
+        opts.sizes = optarg;
+        break;
+      case OPT_IMIX:
+        if ( !imix_profile( optarg ) ) throw std::invalid_argument( "IMIX profile" );
+        opts.sizes = imix_profile( optarg );
+        break;
+      case 'p':
+        opts.pps = std::stod( optarg );
+        break;
+      case OPT_MBPS:
+        opts.mbps = std::stod( optarg );
+        break;
+      case OPT_TX_RING:
+        opts.tx_ring = true;
+        break;
+      case OPT_QDISC_BYPASS:
+        opts.qdisc_bypass = true;
+        break;
+      case OPT_SRC_IP:
+        opts.src_ip = optarg;
+        break;
+      case OPT_DST_IP:
+        opts.dst_ip = optarg;
+        break;
+      case OPT_SRC_MAC:
+        if ( !parse_mac( optarg, opts.src_mac ) ) throw std::invalid_argument( "MAC address" );
+        break;
+      case OPT_DST_MAC:
+        if ( !parse_mac( optarg, opts.dst_mac ) ) throw std::invalid_argument( "MAC address" );
+        break;
+      case OPT_SPORT:
+        opts.sport = static_cast<uint16_t>( std::stoul( optarg ) );
+        break;
+      case OPT_DPORT:
+        opts.dport = static_cast<uint16_t>( std::stoul( optarg ) );
+        break;
+      case OPT_SEED:
+        opts.seed = std::stoull( optarg );
+        break;
+      default:
+        usage( argv[0] );
+        return 1;
+      }
+    }
+    mix = parse_sizes( opts.sizes );
+  }
+  catch ( const std::exception &ex )
+  {
+    std::cerr << "Invalid argument: " << ex.what() << std::endl;
+    return 1;
+  }
+  if ( opts.out.empty() == opts.device.empty() || ( opts.count == 0 && opts.device.empty() ) )
+  {
+    usage( argv[0] );
+    return 1;
+  }
+
+  std::signal( SIGINT, on_signal );
+  std::signal( SIGTERM, on_signal );
+
+  try
+  {
+    return with_builder( opts, [&]( const auto &builder ) {
+      if ( !opts.out.empty() )
+      {
+        PcapOutput out( opts.out, opts );
+        return generate( builder, mix, opts, out );
+      }
+      const std::size_t max_frame = *std::max_element( mix.sizes.begin(), mix.sizes.end() );
+      DeviceOutput out( opts.device, opts, max_frame );
+      return generate( builder, mix, opts, out );
+    } );
+  }
+  catch ( const std::exception &ex )
+  {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,339 @@
+#include <Loopback/Telemetry.hpp>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// End-to-end probe for a running Loopback app: sends timestamped frames into its ingress device
+// and receives them from its egress device, then reports sustained pps/Gbps, loss and one-way
+// latency. Both devices must be on this host (see scripts/bench_e2e.sh), so one clock serves both
+// ends.
+//
+//   LoopbackPerf --tx gen0 --rx sink0 --size 64 --duration 10 --json report.jsonl
+
+namespace {
+
+// IEEE 802 local experimental ethertype: ignored by the kernel stack, filtered on by the receiver
+constexpr uint16_t PROBE_ETHERTYPE = 0x88b5;
+constexpr uint32_t PROBE_MAGIC = 0x4c425046; // "LBPF"
+constexpr std::size_t BATCH = 64;
+
+struct ProbeHeader
+{
+  uint32_t magic;
+  uint32_t run; // tells this run's frames from stragglers of an earlier one
+  uint64_t seq;
+  uint64_t sent_ns;
+};
+
+constexpr std::size_t MIN_FRAME = sizeof( struct ether_header ) + sizeof( ProbeHeader );
+
+struct Options
+{
+  std::string tx;
+  std::string rx;
+  std::string label = "loopback";
+  std::size_t size = 64;
+  double duration = 10;
+  uint64_t pps = 0; // 0: as fast as the socket takes them
+  unsigned drain_ms = 500;
+  std::string json;
+  std::string csv;
+};
+
+struct Result
+{
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t received_bytes = 0;
+  uint64_t reordered = 0;
+  double seconds = 0;
+  Loopback::LatencyHistogram::Summary latency;
+};
+
+uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch() )
+      .count();
+}
+
+int open_packet_socket( const std::string &ifname, uint16_t protocol, std::string &error )
+{
+  int fd = socket( AF_PACKET, SOCK_RAW, htons( protocol ) );
+  if ( fd < 0 )
+  {
+    error = std::string( "socket: " ) + std::strerror( errno );
+    return -1;
+  }
+  struct sockaddr_ll addr = {};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons( protocol );
+  addr.sll_ifindex = if_nametoindex( ifname.c_str() );
+  if ( addr.sll_ifindex == 0 || bind( fd, (struct sockaddr *)&addr, sizeof( addr ) ) != 0 )
+  {
+    error = ifname + ": " + std::strerror( errno );
+    close( fd );
+    return -1;
+  }
+  return fd;
+}
+
+// Sends batches of frames until `duration` has passed, paced per batch when `pps` is set
+uint64_t transmit( int fd, const Options &opts, uint32_t run )
+{
+  std::vector<std::vector<uint8_t>> frames( BATCH, std::vector<uint8_t>( opts.size ) );
+  std::vector<struct iovec> iov( BATCH );
+  std::vector<struct mmsghdr> msgs( BATCH );
+  for ( std::size_t i = 0; i < BATCH; ++i )
+  {
+    struct ether_header *eth = reinterpret_cast<struct ether_header *>( frames[i].data() );
+    std::memset( eth->ether_dhost, 0xff, ETH_ALEN );
+    std::memset( eth->ether_shost, 0, ETH_ALEN );
+    eth->ether_shost[0] = 0x02; // locally administered
+    eth->ether_type = htons( PROBE_ETHERTYPE );
+    iov[i] = { frames[i].data(), frames[i].size() };
+    msgs[i] = {};
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  const uint64_t start = now_ns();
+  const uint64_t end = start + static_cast<uint64_t>( opts.duration * 1e9 );
+  uint64_t seq = 0;
+  for ( uint64_t now = start; now < end; now = now_ns() )
+  {
+    if ( opts.pps )
+    {
+      uint64_t due = start + seq * 1000000000ull / opts.pps;
+      if ( now < due )
+      {
+        if ( due - now > 100000 )
+          std::this_thread::sleep_for( std::chrono::nanoseconds( due - now ) );
+        continue;
+      }
+    }
+    for ( std::size_t i = 0; i < BATCH; ++i )
+    {
+      ProbeHeader hdr{ PROBE_MAGIC, run, seq + i, now };
+      std::memcpy( frames[i].data() + sizeof( struct ether_header ), &hdr, sizeof( hdr ) );
+    }
+    int n = sendmmsg( fd, msgs.data(), BATCH, 0 );
+    if ( n > 0 ) seq += n;
+    else if ( errno != ENOBUFS && errno != EAGAIN )
+    {
+      std::cerr << "sendmmsg: " << std::strerror( errno ) << std::endl;
+      break;
+    }
+  }
+  return seq;
+}
+
+// Receives until `stop` is set, recording the latency of every frame of this run
+void receive( int fd,
+              uint32_t run,
+              const std::atomic<bool> &stop,
+              Result &result,
+              Loopback::LatencyHistogram &latency )
+{
+  std::vector<std::vector<uint8_t>> frames( BATCH, std::vector<uint8_t>( 65536 ) );
+  std::vector<struct iovec> iov( BATCH );
+  std::vector<struct mmsghdr> msgs( BATCH );
+  for ( std::size_t i = 0; i < BATCH; ++i )
+  {
+    iov[i] = { frames[i].data(), frames[i].size() };
+    msgs[i] = {};
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  struct timeval timeout = { 0, 100000 };
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+  // a deep socket buffer, so frames are not lost in the probe while it is descheduled
+  int bytes = 64 << 20;
+  if ( setsockopt( fd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof( bytes ) ) != 0 )
+    setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof( bytes ) );
+
+  uint64_t next_seq = 0;
+  while ( !stop.load( std::memory_order_relaxed ) )
+  {
+    int n = recvmmsg( fd, msgs.data(), BATCH, 0, nullptr );
+    uint64_t now = now_ns();
+    for ( int i = 0; i < n; ++i )
+    {
+      if ( msgs[i].msg_len < MIN_FRAME ) continue;
+      ProbeHeader hdr;
+      std::memcpy( &hdr, frames[i].data() + sizeof( struct ether_header ), sizeof( hdr ) );
+      if ( hdr.magic != PROBE_MAGIC || hdr.run != run ) continue;
+      ++result.received;
+      result.received_bytes += msgs[i].msg_len;
+      if ( hdr.seq < next_seq ) ++result.reordered;
+      else next_seq = hdr.seq + 1;
+      latency.record( now - hdr.sent_ns );
+    }
+  }
+}
+
+void write_json( const Options &opts, const Result &r )
+{
+  std::ofstream out( opts.json, std::ios::app );
+  const uint64_t lost = r.sent > r.received ? r.sent - r.received : 0;
+  out << "{\"label\":\"" << opts.label << "\",\"size\":" << opts.size
+      << ",\"duration_s\":" << r.seconds << ",\"offered_pps\":" << opts.pps
+      << ",\"sent\":" << r.sent << ",\"received\":" << r.received << ",\"lost\":" << lost
+      << ",\"loss_pct\":" << ( r.sent ? 100.0 * lost / r.sent : 0.0 )
+      << ",\"reordered\":" << r.reordered << ",\"rx_pps\":" << r.received / r.seconds
+      << ",\"rx_gbps\":" << r.received_bytes * 8 / r.seconds / 1e9
+      << ",\"latency_ns\":{\"p50\":" << r.latency.p50 << ",\"p99\":" << r.latency.p99
+      << ",\"p999\":" << r.latency.p999 << ",\"max\":" << r.latency.max << "}}\n";
+}
+
+void write_csv( const Options &opts, const Result &r )
+{
+  bool header = std::ifstream( opts.csv ).peek() == std::ifstream::traits_type::eof();
+  std::ofstream out( opts.csv, std::ios::app );
+  if ( header )
+  {
+    out << "label,size,duration_s,offered_pps,sent,received,lost,loss_pct,reordered,rx_pps,"
+           "rx_gbps,p50_ns,p99_ns,p999_ns,max_ns\n";
+  }
+  const uint64_t lost = r.sent > r.received ? r.sent - r.received : 0;
+  out << opts.label << "," << opts.size << "," << r.seconds << "," << opts.pps << "," << r.sent
+      << "," << r.received << "," << lost << "," << ( r.sent ? 100.0 * lost / r.sent : 0.0 )
+      << "," << r.reordered << "," << r.received / r.seconds << ","
+      << r.received_bytes * 8 / r.seconds / 1e9 << "," << r.latency.p50 << ","
+      << r.latency.p99 << "," << r.latency.p999 << "," << r.latency.max << "\n";
+}
+
+void usage( const char *argv0 )
+{
+  std::cerr << "Usage: " << argv0
+            << " --tx <dev> --rx <dev> [--size bytes] [--duration s] [--pps n] [--drain-ms n]\n"
+               "       [--label name] [--json file] [--csv file]\n";
+}
+
+} // namespace
+
+int main( int argc, char **argv )
+{
+  static const struct option longopts[] = { { "tx", required_argument, nullptr, 't' },
+                                            { "rx", required_argument, nullptr, 'r' },
+                                            { "size", required_argument, nullptr, 's' },
+                                            { "duration", required_argument, nullptr, 'd' },
+                                            { "pps", required_argument, nullptr, 'p' },
+                                            { "drain-ms", required_argument, nullptr, 'D' },
+                                            { "label", required_argument, nullptr, 'l' },
+                                            { "json", required_argument, nullptr, 'j' },
+                                            { "csv", required_argument, nullptr, 'c' },
+                                            { nullptr, 0, nullptr, 0 } };
+  Options opts;
+  int opt;
+  try
+  {
+    while ( ( opt = getopt_long( argc, argv, "t:r:s:d:p:l:", longopts, nullptr ) ) != -1 )
+    {
+      switch ( opt )
+      {
+      case 't':
+        opts.tx = optarg;
+        break;
+      case 'r':
+        opts.rx = optarg;
+        break;
+      case 's':
+        opts.size = std::stoul( optarg );
+        break;
+      case 'd':
+        opts.duration = std::stod( optarg );
+        break;
+      case 'p':
+        opts.pps = std::stoull( optarg );
+        break;
+      case 'D':
+        opts.drain_ms = std::stoul( optarg );
+        break;
+      case 'l':
+        opts.label = optarg;
+        break;
+      case 'j':
+        opts.json = optarg;
+        break;
+      case 'c':
+        opts.csv = optarg;
+        break;
+      default:
+        usage( argv[0] );
+        return 1;
+      }
+    }
+  }
+  catch ( const std::exception &ex )
+  {
+    std::cerr << "Invalid argument: " << ex.what() << std::endl;
+    return 1;
+  }
+  if ( opts.tx.empty() || opts.rx.empty() || opts.duration <= 0 )
+  {
+    usage( argv[0] );
+    return 1;
+  }
+  if ( opts.size < MIN_FRAME || opts.size > 65535 )
+  {
+    std::cerr << "--size must be between " << MIN_FRAME << " and 65535" << std::endl;
+    return 1;
+  }
+
+  std::string error;
+  int tx_fd = open_packet_socket( opts.tx, 0, error );
+  int rx_fd = tx_fd < 0 ? -1 : open_packet_socket( opts.rx, PROBE_ETHERTYPE, error );
+  if ( rx_fd < 0 )
+  {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+
+  const uint32_t run = static_cast<uint32_t>( now_ns() ) ^ static_cast<uint32_t>( getpid() );
+  Result result;
+  Loopback::LatencyHistogram latency;
+  std::atomic<bool> stop{ false };
+  std::thread rx( [&] { receive( rx_fd, run, stop, result, latency ); } );
+
+  const uint64_t start = now_ns();
+  result.sent = transmit( tx_fd, opts, run );
+  result.seconds = ( now_ns() - start ) / 1e9;
+  std::this_thread::sleep_for( std::chrono::milliseconds( opts.drain_ms ) ); // frames in flight
+  stop = true;
+  rx.join();
+  close( tx_fd );
+  close( rx_fd );
+
+  using Histogram = Loopback::LatencyHistogram;
+  result.latency =
+      Histogram::summarize( latency.snapshot(), Histogram::Counts( Histogram::BUCKETS ) );
+
+  const uint64_t lost = result.sent > result.received ? result.sent - result.received : 0;
+  std::cout << opts.label << " size=" << opts.size << " sent=" << result.sent
+            << " received=" << result.received << " lost=" << lost
+            << " rx_pps=" << result.received / result.seconds
+            << " rx_gbps=" << result.received_bytes * 8 / result.seconds / 1e9
+            << " latency_us p50=" << result.latency.p50 / 1e3 << " p99=" << result.latency.p99 / 1e3
+            << " p99.9=" << result.latency.p999 / 1e3 << " max=" << result.latency.max / 1e3
+            << std::endl;
+
+  if ( !opts.json.empty() ) write_json( opts, result );
+  if ( !opts.csv.empty() ) write_csv( opts, result );
+  return 0;
+}
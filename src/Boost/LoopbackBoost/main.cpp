@@ -1,139 +1,556 @@
+#include <Logging/BasicLogController.hpp>
+#include <Logging/EventLog.hpp>
+#include <Loopback/BoundedQueue.hpp>
+#include <Loopback/Fanout.hpp>
+#include <Loopback/MmapPcapReader.hpp>
+#include <Loopback/Pacer.hpp>
+#include <Loopback/PacketArena.hpp>
+#include <Loopback/PacketPipeline.hpp>
+#include <Loopback/PacketSender.hpp>
+#include <Loopback/PcapSinks.hpp>
+#include <Loopback/SpscRing.hpp>
+#include <Loopback/Telemetry.hpp>
+#include <Loopback/TpacketV3Source.hpp>
+#include <Loopback/UringPcapWriter.hpp>
+#include <algorithm>
+#include <atomic>
 #include <boost/chrono.hpp>
 #include <boost/program_options.hpp>
 #include <boost/thread.hpp>
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <pcap/pcap.h>
-#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
 #include <vector>
 
 namespace po = boost::program_options;
 
-// Thread-safe packet queue
-class PacketQueue
+// Cleared by SIGINT/SIGTERM so every worker winds down and the stats get printed
+static std::atomic<bool> running{ true };
+
+static void on_signal( int ) { running = false; }
+
+struct Packet
+{
+  struct pcap_pkthdr hdr;
+  std::vector<u_char> data;
+  uint64_t enqueued_ns = 0; // telemetry: when ingress pushed it, for queue sojourn latency
+};
+
+// Bounded packet queue (mutex + condvar, selected with --queue mutex). A full queue blocks
+// ingress or drops according to --overflow.
+using PacketQueue = Loopback::BoundedQueue<Packet>;
+
+// Lock-free packet queue (bounded SPSC ring, selected with --queue spsc). Supports the block
+// and drop-newest policies: evicting the oldest packet would need the producer to pop, which an
+// SPSC ring does not allow.
+class RingPacketQueue
 {
 public:
-  void push( const std::vector<u_char> &pkt, const struct pcap_pkthdr &hdr )
+  RingPacketQueue( size_t capacity,
+                   const Loopback::WaitStrategy &wait,
+                   Loopback::OverflowPolicy policy )
+      : ring_( capacity, wait ),
+        policy_( policy )
   {
-    boost::unique_lock<boost::mutex> lock( mutex_ );
-    queue_.push( { hdr, pkt } );
-    cond_.notify_one();
+    stats_.capacity = ring_.capacity();
   }
 
-  bool pop( std::vector<u_char> &pkt, struct pcap_pkthdr &hdr )
+  // Producer side only, so the counters need no synchronisation. Returns the number dropped,
+  // which are the last ones of the batch.
+  size_t push_bulk( Packet *pkts, size_t n )
   {
-    boost::unique_lock<boost::mutex> lock( mutex_ );
-    while ( queue_.empty() && running_ )
-      cond_.wait( lock );
-    if ( !running_ && queue_.empty() ) return false;
-    auto entry = queue_.front();
-    queue_.pop();
-    hdr = entry.first;
-    pkt = entry.second;
-    return true;
+    size_t pushed = ring_.try_push_bulk( pkts, n );
+    if ( pushed < n && policy_ == Loopback::OverflowPolicy::DropNewest )
+      stats_.dropped_newest += n - pushed;
+    else if ( pushed < n )
+    {
+      ++stats_.blocked;
+      pushed += ring_.push_bulk( pkts + pushed, n - pushed );
+    }
+    stats_.queued += pushed;
+    stats_.high_water = std::max( stats_.high_water, ring_.size_approx() );
+    return n - pushed;
   }
 
-  void stop()
-  {
-    boost::unique_lock<boost::mutex> lock( mutex_ );
-    running_ = false;
-    cond_.notify_all();
-  }
+  size_t pop_bulk( Packet *pkts, size_t max ) { return ring_.pop_bulk( pkts, max ); }
+
+  size_t try_pop_bulk( Packet *pkts, size_t max ) { return ring_.try_pop_bulk( pkts, max ); }
+
+  void stop() { ring_.close(); }
+
+  // Only consistent once both threads have stopped
+  Loopback::QueueStats stats() const { return stats_; }
 
 private:
-  std::queue<std::pair<struct pcap_pkthdr, std::vector<u_char>>> queue_;
-  boost::mutex mutex_;
-  boost::condition_variable cond_;
-  bool running_ = true;
+  Loopback::SpscRing<Packet> ring_;
+  Loopback::OverflowPolicy policy_;
+  Loopback::QueueStats stats_;
 };
 
-// Ingress thread
-class IngressWorker
+// libpcap handles, the mmap pcap reader, the TPACKET_V3 ring and the preloaded arena share
+// IngressWorker through these overloads
+inline int dispatchPackets( pcap_t *src, int cnt, pcap_handler cb, u_char *user )
 {
-public:
-  IngressWorker( pcap_t *handle, PacketQueue &queue )
-      : handle_( handle ),
-        queue_( queue )
+  return pcap_dispatch( src, cnt, cb, user );
+}
+
+inline int dispatchPackets( Loopback::MmapPcapReader *src, int cnt, pcap_handler cb, u_char *user )
+{
+  return src->dispatch( cnt, cb, user );
+}
+
+inline int dispatchPackets( Loopback::TpacketV3Source *src, int cnt, pcap_handler cb, u_char *user )
+{
+  return src->dispatch( cnt, cb, user );
+}
+
+inline int dispatchPackets( Loopback::PacketArena *src, int cnt, pcap_handler cb, u_char *user )
+{
+  return src->dispatch( cnt, cb, user );
+}
+
+inline bool isOffline( pcap_t *src ) { return pcap_file( src ) != nullptr; }
+inline bool isOffline( Loopback::MmapPcapReader * ) { return true; }
+inline bool isOffline( Loopback::TpacketV3Source * ) { return false; }
+inline bool isOffline( Loopback::PacketArena * ) { return true; }
+
+inline const char *sourceError( pcap_t *src ) { return pcap_geterr( src ); }
+inline const char *sourceError( Loopback::MmapPcapReader *src ) { return src->geterr(); }
+inline const char *sourceError( Loopback::TpacketV3Source *src ) { return src->geterr(); }
+inline const char *sourceError( Loopback::PacketArena *src ) { return src->geterr(); }
+
+// Per-thread telemetry and replay accounting of one pipeline, the PacketPipeline probe. The
+// telemetry stages are null unless --telemetry-ms is set; each hook runs on one thread only and
+// takes at most one clock reading per batch.
+struct Probes
+{
+  Loopback::Telemetry::Stage *ingress = nullptr;
+  Loopback::Telemetry::Stage *egress = nullptr;
+  const Loopback::Tsc *clock = nullptr;
+  uint64_t *forwarded = nullptr;          // optional: packets taken off the queue
+  Loopback::ReplayMeter *meter = nullptr; // optional: per-loop throughput of --preload
+
+  void received( Packet *pkts, size_t n )
   {
+    EVENTLOG( "ingress rx packets={}", n );
+    if ( !ingress ) return;
+    uint64_t now = clock->now_ns(), bytes = 0;
+    for ( size_t i = 0; i < n; ++i )
+    {
+      pkts[i].enqueued_ns = now;
+      bytes += pkts[i].hdr.caplen;
+    }
+    ingress->add_packets( n, bytes );
   }
 
-  void operator()()
+  void dropped( const Packet &pkt )
   {
-    const u_char *pkt;
-    struct pcap_pkthdr *hdr;
-    while ( true )
+    EVENTLOG( "ingress drop len={}", pkt.hdr.caplen );
+    if ( ingress ) ingress->add_drops( 1 );
+  }
+
+  // Queue sojourn: one clock reading per popped batch against each packet's enqueue time
+  void dequeued( const Packet *pkts, size_t n )
+  {
+    EVENTLOG( "egress dequeue packets={}", n );
+    if ( forwarded ) *forwarded += n;
+    if ( meter ) meter->start();
+    if ( !egress ) return;
+    uint64_t now = clock->now_ns(), bytes = 0;
+    for ( size_t i = 0; i < n; ++i )
     {
-      int ret = pcap_next_ex( handle_, &hdr, &pkt );
-      if ( ret == 1 )
-      {
-        std::vector<u_char> copy( pkt, pkt + hdr->caplen );
-        queue_.push( copy, *hdr );
-      }
-      else if ( ret == -2 )
-        break;
-      else if ( ret == -1 )
-      {
-        std::cerr << "Ingress error: " << pcap_geterr( handle_ ) << std::endl;
-        break;
-      }
+      bytes += pkts[i].hdr.caplen;
+      egress->latency.record( now > pkts[i].enqueued_ns ? now - pkts[i].enqueued_ns : 0 );
     }
-    queue_.stop();
+    egress->add_packets( n, bytes );
   }
 
-private:
-  pcap_t *handle_;
-  PacketQueue &queue_;
+  void sent( size_t n )
+  {
+    if ( meter ) meter->add( n );
+  }
 };
 
-// Egress thread
-class EgressWorker
+// Ingress: dispatch hands over whatever is in the current capture buffer (up to a batch), which
+// the pipeline pushes to the queue in one go.
+template <typename Source> class CaptureSource
 {
 public:
-  EgressWorker( pcap_t *handle, pcap_dumper_t *dumper, PacketQueue &queue )
+  using Item = Packet;
+
+  explicit CaptureSource( Source *handle )
       : handle_( handle ),
-        dumper_( dumper ),
-        queue_( queue )
+        offline_( isOffline( handle ) )
   {
   }
 
-  void operator()()
+  size_t receive( Packet *pkts, size_t max )
   {
-    std::vector<u_char> pkt;
-    struct pcap_pkthdr hdr;
-    while ( queue_.pop( pkt, hdr ) )
+    Collector collector{ pkts, 0 };
+    int ret = dispatchPackets(
+        handle_, static_cast<int>( max ), &CaptureSource::collect, (u_char *)&collector );
+    if ( ret == 0 && offline_ )
+      done_ = true; // EOF (file), on a live device 0 is just the read timeout
+    else if ( ret == -2 )
+      done_ = true;
+    else if ( ret == -1 )
     {
-      if ( dumper_ ) { pcap_dump( (u_char *)dumper_, &hdr, pkt.data() ); }
-      else if ( handle_ )
-      {
-        if ( pcap_sendpacket( handle_, pkt.data(), pkt.size() ) != 0 )
-        {
-          std::cerr << "Egress send error: " << pcap_geterr( handle_ ) << std::endl;
-        }
-      }
+      std::cerr << "Ingress error: " << sourceError( handle_ ) << std::endl;
+      done_ = true;
     }
+    return collector.count;
   }
 
+  // Live captures return from dispatch at least once per read timeout, so a signal ends them
+  bool done() const { return done_ || !running; }
+
+  // A dropped packet stays in the batch, the next dispatch reuses its buffer
+  void reject( Packet & ) {}
+
 private:
-  pcap_t *handle_;
-  pcap_dumper_t *dumper_;
-  PacketQueue &queue_;
+  struct Collector
+  {
+    Packet *pkts;
+    size_t count;
+  };
+
+  static void collect( u_char *user, const struct pcap_pkthdr *hdr, const u_char *pkt )
+  {
+    auto *collector = reinterpret_cast<Collector *>( user );
+    Packet &entry = collector->pkts[collector->count++];
+    entry.hdr = *hdr;
+    entry.data.assign( pkt, pkt + hdr->caplen ); // reuses capacity recycled by the queue
+  }
+
+  Source *handle_;
+  bool offline_;
+  bool done_ = false;
+};
+
+// Packets own their bytes, nothing to release once they are written
+struct PacketAccess
+{
+  const struct pcap_pkthdr &header( const Packet &pkt ) const { return pkt.hdr; }
+  const u_char *data( const Packet &pkt ) const { return pkt.data.data(); }
+  void done( Packet & ) const {}
 };
 
+// One PacketPipeline instantiation per source, queue and egress sink type
+template <typename Queue, typename Source>
+Loopback::QueueStats runWorkers( Queue &queue,
+                                 Source *ingress,
+                                 const Loopback::PcapEgress &egress,
+                                 size_t batch,
+                                 const Probes &probes )
+{
+  CaptureSource<Source> source( ingress );
+  Loopback::with_pcap_sink( egress, PacketAccess{}, [&]( auto &sink ) {
+    using Sink = std::decay_t<decltype( sink )>;
+    Loopback::PacketPipeline<CaptureSource<Source>, Queue, Sink, Probes> pipeline(
+        source, queue, sink, batch, probes );
+    boost::thread ingressThread( [&pipeline] { pipeline.ingress(); } );
+    boost::thread egressThread( [&pipeline] { pipeline.egress(); } );
+    ingressThread.join();
+    egressThread.join();
+  } );
+  return queue.stats();
+}
+
+struct QueueOptions
+{
+  std::string type;
+  size_t ringSize;
+  size_t batch;
+  Loopback::WaitStrategy wait;
+  Loopback::OverflowPolicy overflow = Loopback::OverflowPolicy::Block;
+};
+
+template <typename Source>
+Loopback::QueueStats runLoopback( const QueueOptions &opts,
+                                  Source *ingress,
+                                  const Loopback::PcapEgress &egress,
+                                  const Probes &probes )
+{
+  if ( opts.type == "mutex" )
+  {
+    PacketQueue queue( opts.ringSize, opts.overflow );
+    return runWorkers( queue, ingress, egress, opts.batch, probes );
+  }
+  RingPacketQueue queue( opts.ringSize, opts.wait, opts.overflow );
+  return runWorkers( queue, ingress, egress, opts.batch, probes );
+}
+
 // Helper to detect PCAP file by extension
 bool isPcapFile( const std::string &s ) { return s.find( ".pcap" ) != std::string::npos; }
 
-int main( int argc, char **argv )
+// With several workers each one writes its own file: out.pcap -> out-0.pcap, out-1.pcap, ...
+// A device is shared, every worker sends on it.
+std::string workerPath( const std::string &path, unsigned worker, unsigned workers )
+{
+  const std::size_t ext = path.rfind( ".pcap" );
+  if ( workers == 1 || !isPcapFile( path ) || ext == std::string::npos ) return path;
+  std::string out = path;
+  return out.insert( ext, "-" + std::to_string( worker ) );
+}
+
+struct AppConfig
 {
-  std::string ingress, egress;
+  std::string ingress, egress, readerType, writerType, backend, egressBackend;
   int snaplen = 65535;
+  bool preload = false;
+  unsigned loops = 1;
+  bool hugepages = false;
+  Loopback::TpacketV3Source::Options tpacketOpts;
+  Loopback::UringPcapWriter::Options writerOpts;
+  Loopback::PacketSender::Options senderOpts;
+};
+
+// Everything one ingress -> queue -> egress chain owns. --workers N runs N of these side by side.
+struct Pipeline
+{
+  pcap_t *ingressHandle = nullptr;
+  std::unique_ptr<Loopback::MmapPcapReader> reader;
+  std::unique_ptr<Loopback::TpacketV3Source> tpacket;
+  std::unique_ptr<Loopback::PacketArena> arena;
+  pcap_dumper_t *dumper = nullptr;
+  pcap_t *egressHandle = nullptr;
+  std::unique_ptr<Loopback::UringPcapWriter> writer;
+  std::unique_ptr<Loopback::PacketSender> sender;
+  uint64_t forwarded = 0;
+  Loopback::Pacer *pacer = nullptr;
+  Loopback::ReplayMeter *meter = nullptr;
+  Loopback::QueueStats queueStats;
+  Probes probes;
+
+  Pipeline() = default;
+  Pipeline( const Pipeline & ) = delete;
+  Pipeline &operator=( const Pipeline & ) = delete;
+
+  ~Pipeline()
+  {
+    if ( dumper ) pcap_dump_close( dumper );
+    if ( egressHandle ) pcap_close( egressHandle );
+    if ( ingressHandle ) pcap_close( ingressHandle );
+  }
+
+  void run( const QueueOptions &opts )
+  {
+    Loopback::PcapEgress sink{
+        egressHandle, dumper, writer.get(), sender.get(), pacer, probes.egress };
+    Probes hooks = probes;
+    hooks.forwarded = &forwarded;
+    hooks.meter = meter;
+    if ( reader ) { queueStats = runLoopback( opts, reader.get(), sink, hooks ); }
+    else if ( arena ) { queueStats = runLoopback( opts, arena.get(), sink, hooks ); }
+    else if ( tpacket ) { queueStats = runLoopback( opts, tpacket.get(), sink, hooks ); }
+    else { queueStats = runLoopback( opts, ingressHandle, sink, hooks ); }
+  }
+};
+
+// Throws std::runtime_error on failure
+void openIngress( Pipeline &p, const AppConfig &cfg )
+{
+  char errbuf[PCAP_ERRBUF_SIZE];
+  if ( !isPcapFile( cfg.ingress ) && cfg.backend == "tpacket" )
+  {
+    p.tpacket = std::make_unique<Loopback::TpacketV3Source>( cfg.ingress, cfg.tpacketOpts );
+    // AF_PACKET delivers Ethernet frames, a dead handle carries linktype/snaplen for the dumper
+    p.ingressHandle = pcap_open_dead( DLT_EN10MB, cfg.snaplen );
+  }
+  else if ( isPcapFile( cfg.ingress ) && cfg.preload )
+  {
+    p.arena = std::make_unique<Loopback::PacketArena>( cfg.ingress, cfg.loops, cfg.hugepages );
+    p.ingressHandle = pcap_open_dead_with_tstamp_precision(
+        p.arena->datalink(), p.arena->snapshot(), p.arena->precision() );
+  }
+  else if ( isPcapFile( cfg.ingress ) && cfg.readerType == "mmap" &&
+            Loopback::MmapPcapReader::is_classic( cfg.ingress ) ) // pcapng goes to libpcap
+  {
+    p.reader = std::make_unique<Loopback::MmapPcapReader>( cfg.ingress );
+    p.reader->set_precision( p.reader->file_precision() ); // keep nanoseconds for replay pacing
+    // nothing live behind the mapping, a dead handle carries linktype/snaplen/precision for the
+    // dumper
+    p.ingressHandle = pcap_open_dead_with_tstamp_precision(
+        p.reader->datalink(), p.reader->snapshot(), p.reader->precision() );
+  }
+  else if ( isPcapFile( cfg.ingress ) )
+  {
+    p.ingressHandle = pcap_open_offline( cfg.ingress.c_str(), errbuf );
+  }
+  else { p.ingressHandle = pcap_open_live( cfg.ingress.c_str(), cfg.snaplen, 1, 1000, errbuf ); }
+  if ( !p.ingressHandle ) throw std::runtime_error( errbuf );
+}
+
+// Throws std::runtime_error on failure
+void openEgress( Pipeline &p, const AppConfig &cfg, const std::string &egress )
+{
+  char errbuf[PCAP_ERRBUF_SIZE];
+  if ( isPcapFile( egress ) && cfg.writerType == "uring" )
+  {
+    Loopback::UringPcapWriter::Options writerOpts = cfg.writerOpts;
+    writerOpts.nanosecond =
+        pcap_get_tstamp_precision( p.ingressHandle ) == PCAP_TSTAMP_PRECISION_NANO;
+    p.writer = std::make_unique<Loopback::UringPcapWriter>( egress,
+                                                            pcap_datalink( p.ingressHandle ),
+                                                            pcap_snapshot( p.ingressHandle ),
+                                                            writerOpts );
+  }
+  else if ( isPcapFile( egress ) )
+  {
+    p.dumper = pcap_dump_open( p.ingressHandle, egress.c_str() );
+    if ( !p.dumper ) throw std::runtime_error( pcap_geterr( p.ingressHandle ) );
+  }
+  else if ( cfg.egressBackend != "libpcap" )
+  {
+    p.sender = std::make_unique<Loopback::PacketSender>( egress, cfg.senderOpts );
+  }
+  else
+  {
+    p.egressHandle = pcap_open_live( egress.c_str(), cfg.snaplen, 1, 1000, errbuf );
+    if ( !p.egressHandle ) throw std::runtime_error( errbuf );
+  }
+}
+
+int main( int argc, char **argv )
+{
+  AppConfig cfg;
+  unsigned txFlushUs = 100;
+  QueueOptions queueOpts;
+  unsigned parkUs = 100;
+  std::string overflow;
+  unsigned workers = 1;
+  std::string fanoutType;
+  uint16_t fanoutGroup = 0;
+  bool replay = false;
+  Loopback::Pacer::Options pacerOpts;
+  unsigned paceSpinUs = 100;
+  unsigned telemetryMs = 0;
+  std::string telemetryLog, telemetryJsonPath;
+  std::string eventLogPath;
 
   // --- CLI ---
   po::options_description desc( "Loopback Boost App Options" );
   desc.add_options()( "help,h", "show help" )(
-      "ingress,i", po::value<std::string>( &ingress )->required(), "ingress file or device" )(
-      "egress,e", po::value<std::string>( &egress )->required(), "egress file or device" )(
-      "snaplen,s", po::value<int>( &snaplen )->default_value( 65535 ), "snapshot length" );
+      "ingress,i", po::value<std::string>( &cfg.ingress )->required(), "ingress file or device" )(
+      "egress,e", po::value<std::string>( &cfg.egress )->required(), "egress file or device" )(
+      "snaplen,s", po::value<int>( &cfg.snaplen )->default_value( 65535 ), "snapshot length" )(
+      "reader,r",
+      po::value<std::string>( &cfg.readerType )->default_value( "mmap" ),
+      "pcap file ingress reader: mmap (zero-copy) or libpcap" )(
+      "ingress-backend",
+      po::value<std::string>( &cfg.backend )->default_value( "libpcap" ),
+      "live device ingress: libpcap or tpacket (AF_PACKET TPACKET_V3 ring)" )(
+      "block-size",
+      po::value<uint32_t>( &cfg.tpacketOpts.block_size )->default_value( 1 << 20 ),
+      "tpacket: ring block size in bytes (multiple of the page size)" )(
+      "block-count",
+      po::value<uint32_t>( &cfg.tpacketOpts.block_count )->default_value( 64 ),
+      "tpacket: number of ring blocks" )(
+      "block-timeout-ms",
+      po::value<uint32_t>( &cfg.tpacketOpts.retire_timeout_ms )->default_value( 10 ),
+      "tpacket: retire a partially filled block after this many milliseconds" )(
+      "workers",
+      po::value<unsigned>( &workers )->default_value( 1 ),
+      "live device ingress: pipelines sharing one PACKET_FANOUT group" )(
+      "fanout",
+      po::value<std::string>( &fanoutType )->default_value( "hash" ),
+      "workers: fanout mode, hash (per flow), cpu (per receiving CPU) or lb (round robin)" )(
+      "fanout-group",
+      po::value<uint16_t>( &fanoutGroup )->default_value( 0 ),
+      "workers: PACKET_FANOUT group id, 0 derives one from the process id" )(
+      "preload",
+      po::bool_switch( &cfg.preload ),
+      "pcap file ingress: load the whole capture into memory before replaying it" )(
+      "loop",
+      po::value<unsigned>( &cfg.loops )->default_value( 1 ),
+      "preload: replay the capture this many times" )(
+      "hugepages",
+      po::bool_switch( &cfg.hugepages ),
+      "preload: back the capture with 2 MiB hugepages (falls back to THP)" )(
+      "replay",
+      po::bool_switch( &replay ),
+      "pcap file ingress: release packets with their original inter-packet gaps" )(
+      "speedup",
+      po::value<double>( &pacerOpts.speedup )->default_value( 1.0 ),
+      "replay: divide the original gaps by this factor (implies --replay)" )(
+      "pps",
+      po::value<double>( &pacerOpts.pps )->default_value( 0 ),
+      "replay: ignore timestamps and release this many packets per second" )(
+      "mbps",
+      po::value<double>( &pacerOpts.mbps )->default_value( 0 ),
+      "replay: ignore timestamps and release packets at this many Mbit/s" )(
+      "pace-spin-us",
+      po::value<unsigned>( &paceSpinUs )->default_value( 100 ),
+      "replay: busy-wait the last microseconds of every gap instead of sleeping" )(
+      "writer,w",
+      po::value<std::string>( &cfg.writerType )->default_value( "uring" ),
+      "pcap file egress writer: uring (batched io_uring) or libpcap" )(
+      "write-buffer",
+      po::value<size_t>( &cfg.writerOpts.buffer_size )->default_value( 4 * 1024 * 1024 ),
+      "uring writer: bytes per write buffer" )(
+      "direct",
+      po::bool_switch( &cfg.writerOpts.direct ),
+      "uring writer: open the egress file with O_DIRECT" )(
+      "egress-backend",
+      po::value<std::string>( &cfg.egressBackend )->default_value( "sendmmsg" ),
+      "live device egress: sendmmsg, txring (PACKET_TX_RING) or libpcap (one send per packet)" )(
+      "tx-batch",
+      po::value<uint32_t>( &cfg.senderOpts.batch )->default_value( 64 ),
+      "sendmmsg/txring: packets per send batch" )(
+      "tx-flush-us",
+      po::value<unsigned>( &txFlushUs )->default_value( 100 ),
+      "sendmmsg/txring: max microseconds a packet waits for its batch to fill" )(
+      "tx-frame-size",
+      po::value<uint32_t>( &cfg.senderOpts.frame_size )->default_value( 2048 ),
+      "sendmmsg/txring: largest packet sent, bigger ones are dropped and counted" )(
+      "tx-ring-frames",
+      po::value<uint32_t>( &cfg.senderOpts.ring_frames )->default_value( 4096 ),
+      "txring: number of frames in the PACKET_TX_RING" )(
+      "qdisc-bypass",
+      po::bool_switch( &cfg.senderOpts.qdisc_bypass ),
+      "sendmmsg/txring: bypass the kernel qdisc layer (PACKET_QDISC_BYPASS)" )(
+      "queue,q",
+      po::value<std::string>( &queueOpts.type )->default_value( "spsc" ),
+      "ingress->egress queue: spsc (lock-free ring) or mutex" )(
+      "ring-size",
+      po::value<size_t>( &queueOpts.ringSize )->default_value( 4096 ),
+      "queue capacity in packets (spsc rounds up to a power of two)" )(
+      "overflow",
+      po::value<std::string>( &overflow )->default_value( "block" ),
+      "full queue: block (backpressure), drop-newest or drop-oldest (mutex queue only)" )(
+      "batch,b",
+      po::value<size_t>( &queueOpts.batch )->default_value( 64 ),
+      "packets per push/pop batch" )(
+      "spin",
+      po::value<uint32_t>( &queueOpts.wait.spin_iterations )->default_value( 1024 ),
+      "spsc wait: busy-spin iterations before yielding" )(
+      "yield",
+      po::value<uint32_t>( &queueOpts.wait.yield_iterations )->default_value( 64 ),
+      "spsc wait: yield iterations before parking" )(
+      "park-us",
+      po::value<unsigned>( &parkUs )->default_value( 100 ),
+      "spsc wait: max park time in microseconds" )(
+      "telemetry-ms",
+      po::value<unsigned>( &telemetryMs )->default_value( 0 ),
+      "publish per-thread counters and queue latency every N ms (0 = off)" )(
+      "telemetry-log",
+      po::value<std::string>( &telemetryLog )->default_value( "loopback-telemetry.log" ),
+      "telemetry: log file, records also go to the console" )(
+      "telemetry-json",
+      po::value<std::string>( &telemetryJsonPath )->default_value( "" ),
+      "telemetry: also append the bare JSON lines to this file" )(
+      "event-log",
+      po::value<std::string>( &eventLogPath )->default_value( "" ),
+      "trace enqueue/drop/send-failure events to this binary file (see EventLogDecoder)" );
 
   po::variables_map vm;
+  Loopback::FanoutMode fanoutMode = Loopback::FanoutMode::Hash;
   try
   {
     po::store( po::parse_command_line( argc, argv, desc ), vm );
@@ -143,6 +560,50 @@ int main( int argc, char **argv )
       return 0;
     }
     po::notify( vm );
+    if ( queueOpts.type != "spsc" && queueOpts.type != "mutex" )
+      throw po::validation_error( po::validation_error::invalid_option_value, "queue" );
+    if ( queueOpts.batch == 0 )
+      throw po::validation_error( po::validation_error::invalid_option_value, "batch" );
+    if ( queueOpts.ringSize == 0 )
+      throw po::validation_error( po::validation_error::invalid_option_value, "ring-size" );
+    if ( !Loopback::parse_overflow_policy( overflow, queueOpts.overflow ) ||
+         ( queueOpts.overflow == Loopback::OverflowPolicy::DropOldest &&
+           queueOpts.type == "spsc" ) )
+      throw po::validation_error( po::validation_error::invalid_option_value, "overflow" );
+    if ( cfg.readerType != "mmap" && cfg.readerType != "libpcap" )
+      throw po::validation_error( po::validation_error::invalid_option_value, "reader" );
+    if ( cfg.writerType != "uring" && cfg.writerType != "libpcap" )
+      throw po::validation_error( po::validation_error::invalid_option_value, "writer" );
+    if ( cfg.backend != "libpcap" && cfg.backend != "tpacket" )
+      throw po::validation_error( po::validation_error::invalid_option_value, "ingress-backend" );
+    if ( cfg.egressBackend != "sendmmsg" && cfg.egressBackend != "txring" &&
+         cfg.egressBackend != "libpcap" )
+      throw po::validation_error( po::validation_error::invalid_option_value, "egress-backend" );
+    if ( cfg.senderOpts.batch == 0 )
+      throw po::validation_error( po::validation_error::invalid_option_value, "tx-batch" );
+    // fanout only exists for live AF_PACKET sockets
+    if ( workers == 0 || ( workers > 1 && isPcapFile( cfg.ingress ) ) )
+      throw po::validation_error( po::validation_error::invalid_option_value, "workers" );
+    if ( fanoutType == "cpu" )
+      fanoutMode = Loopback::FanoutMode::Cpu;
+    else if ( fanoutType == "lb" )
+      fanoutMode = Loopback::FanoutMode::LoadBalance;
+    else if ( fanoutType != "hash" )
+      throw po::validation_error( po::validation_error::invalid_option_value, "fanout" );
+    replay = replay || !vm["speedup"].defaulted() || pacerOpts.pps > 0 || pacerOpts.mbps > 0;
+    if ( pacerOpts.speedup <= 0 )
+      throw po::validation_error( po::validation_error::invalid_option_value, "speedup" );
+    if ( replay && !isPcapFile( cfg.ingress ) ) // live ingress is already paced by the wire
+      throw po::validation_error( po::validation_error::invalid_option_value, "replay" );
+    if ( cfg.preload && !isPcapFile( cfg.ingress ) )
+      throw po::validation_error( po::validation_error::invalid_option_value, "preload" );
+    if ( cfg.loops == 0 || ( cfg.loops > 1 && !cfg.preload ) )
+      throw po::validation_error( po::validation_error::invalid_option_value, "loop" );
+    pacerOpts.spin = std::chrono::microseconds( paceSpinUs );
+    queueOpts.wait.park_timeout = std::chrono::microseconds( parkUs );
+    cfg.senderOpts.flush_deadline = std::chrono::microseconds( txFlushUs );
+    cfg.senderOpts.mode = cfg.egressBackend == "txring" ? Loopback::PacketSender::Mode::TxRing
+                                                        : Loopback::PacketSender::Mode::Sendmmsg;
   }
   catch ( const std::exception &ex )
   {
@@ -150,54 +611,241 @@ int main( int argc, char **argv )
     std::cout << desc << std::endl;
     return 1;
   }
+  if ( fanoutGroup == 0 ) fanoutGroup = static_cast<uint16_t>( ::getpid() & 0xffff );
 
-  char errbuf[PCAP_ERRBUF_SIZE];
+  // --- Open ingress & egress, one pair per worker ---
+  std::vector<std::unique_ptr<Pipeline>> pipelines;
+  for ( unsigned i = 0; i < workers; ++i )
+  {
+    pipelines.push_back( std::make_unique<Pipeline>() );
+    Pipeline &p = *pipelines.back();
+    try
+    {
+      openIngress( p, cfg );
+      if ( workers > 1 )
+      {
+        int fd = p.tpacket ? p.tpacket->fd() : pcap_fileno( p.ingressHandle );
+        Loopback::join_fanout( fd, fanoutGroup, fanoutMode );
+      }
+    }
+    catch ( const std::exception &ex )
+    {
+      std::cerr << "Cannot open ingress: " << ex.what() << std::endl;
+      return 1;
+    }
 
-  // --- Open ingress ---
-  pcap_t *ingressHandle = nullptr;
-  if ( isPcapFile( ingress ) ) { ingressHandle = pcap_open_offline( ingress.c_str(), errbuf ); }
-  else { ingressHandle = pcap_open_live( ingress.c_str(), snaplen, 1, 1000, errbuf ); }
-  if ( !ingressHandle )
+    const std::string egress = workerPath( cfg.egress, i, workers );
+    try
+    {
+      openEgress( p, cfg, egress );
+    }
+    catch ( const std::exception &ex )
+    {
+      std::cerr << "Cannot open egress " << ( isPcapFile( egress ) ? "file" : "device" ) << ": "
+                << ex.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // Replay needs pcap ingress, so there is exactly one pipeline to pace
+  std::unique_ptr<Loopback::Pacer> pacer;
+  if ( replay )
   {
-    std::cerr << "Cannot open ingress: " << errbuf << std::endl;
-    return 1;
+    pacerOpts.nanosecond =
+        pcap_get_tstamp_precision( pipelines[0]->ingressHandle ) == PCAP_TSTAMP_PRECISION_NANO;
+    pacer = std::make_unique<Loopback::Pacer>( pacerOpts );
+    pipelines[0]->pacer = pacer.get();
   }
 
-  // --- Open egress ---
-  pcap_dumper_t *dumper = nullptr;
-  pcap_t *egressHandle = nullptr;
-  if ( isPcapFile( egress ) )
+  // Preload needs pcap ingress as well
+  std::unique_ptr<Loopback::ReplayMeter> meter;
+  if ( pipelines[0]->arena )
+  {
+    const Loopback::PacketArena &arena = *pipelines[0]->arena;
+    meter = std::make_unique<Loopback::ReplayMeter>( arena.packets(), arena.bytes() );
+    pipelines[0]->meter = meter.get();
+    std::cout << "Preloaded: packets=" << arena.packets() << " bytes=" << arena.bytes()
+              << " mapped=" << arena.mapped() << " hugetlb=" << ( arena.hugetlb() ? "yes" : "no" )
+              << " loops=" << arena.loops() << std::endl;
+  }
+
+  // --- Telemetry: one ingress and one egress stage per worker ---
+  Loopback::Telemetry telemetry;
+  std::unique_ptr<Loopback::Tsc> tsc;
+  std::ofstream telemetryJson; // written by the log's thread, so it must outlive the log
+  std::unique_ptr<Logging::BasicLogController> log;
+  std::unique_ptr<Loopback::TelemetryReporter> reporter;
+  if ( telemetryMs )
   {
-    dumper = pcap_dump_open( ingressHandle, egress.c_str() );
-    if ( !dumper )
+    tsc = std::make_unique<Loopback::Tsc>();
+    for ( unsigned i = 0; i < workers; ++i )
     {
-      std::cerr << "Cannot open egress file: " << pcap_geterr( ingressHandle ) << std::endl;
-      pcap_close( ingressHandle );
-      return 1;
+      Probes &probes = pipelines[i]->probes;
+      const std::string id = std::to_string( i );
+      probes.ingress = &telemetry.stage( "ingress-" + id, Loopback::Telemetry::Role::Ingress );
+      probes.egress = &telemetry.stage( "egress-" + id, Loopback::Telemetry::Role::Egress );
+      probes.clock = tsc.get();
+    }
+    // async: the reporter thread only enqueues, the file and console writes run on the pool's
+    log = std::make_unique<Logging::BasicLogController>(
+        "telemetry", telemetryLog, Logging::BasicLogController::Async{} );
+    if ( !telemetryJsonPath.empty() )
+    {
+      telemetryJson.open( telemetryJsonPath, std::ios::app );
+      if ( !telemetryJson )
+      {
+        std::cerr << "Cannot open telemetry file: " << telemetryJsonPath << std::endl;
+        return 1;
+      }
+      log->set_callback( [&telemetryJson]( const std::string &line ) {
+        telemetryJson << line << std::endl;
+      } );
     }
+    std::shared_ptr<spdlog::logger> logger = log->logger();
+    reporter = std::make_unique<Loopback::TelemetryReporter>(
+        telemetry, std::chrono::milliseconds( telemetryMs ), [logger]( const std::string &json ) {
+          SPDLOG_LOGGER_INFO( logger, "{}", json );
+        } );
   }
-  else
+
+  // --- Binary event trace, decoded offline ---
+  if ( !eventLogPath.empty() )
   {
-    egressHandle = pcap_open_live( egress.c_str(), snaplen, 1, 1000, errbuf );
-    if ( !egressHandle )
+    try
+    {
+      Logging::EventLog::start( eventLogPath );
+    }
+    catch ( const std::exception &ex )
     {
-      std::cerr << "Cannot open egress device: " << errbuf << std::endl;
-      pcap_close( ingressHandle );
+      std::cerr << "Cannot open event log: " << ex.what() << std::endl;
       return 1;
     }
   }
 
-  // --- Packet queue & threads ---
-  PacketQueue queue;
-  boost::thread ingressThread( IngressWorker( ingressHandle, queue ) );
-  boost::thread egressThread( EgressWorker( egressHandle, dumper, queue ) );
+  std::signal( SIGINT, on_signal );
+  std::signal( SIGTERM, on_signal );
 
-  ingressThread.join();
-  egressThread.join();
+  // --- Packet queues & threads ---
+  if ( workers == 1 ) { pipelines[0]->run( queueOpts ); }
+  else
+  {
+    boost::thread_group group;
+    for ( auto &p : pipelines )
+    {
+      Pipeline *pipeline = p.get();
+      group.create_thread( [pipeline, &queueOpts] { pipeline->run( queueOpts ); } );
+    }
+    group.join_all();
+  }
+  if ( reporter ) reporter->stop(); // publishes the final totals
+  Logging::EventLog::stop();
 
-  if ( dumper ) pcap_dump_close( dumper );
-  if ( egressHandle ) pcap_close( egressHandle );
-  if ( ingressHandle ) pcap_close( ingressHandle );
+  // --- Statistics, summed over workers ---
+  Loopback::TpacketV3Source::Stats ts;
+  Loopback::UringPcapWriter::Stats ws;
+  Loopback::PacketSender::Stats ss;
+  Loopback::QueueStats qs;
+  double latencySumUs = 0;
+  uint64_t forwarded = 0;
+  std::string perWorker;
+  for ( auto &p : pipelines )
+  {
+    forwarded += p->forwarded;
+    perWorker += " " + std::to_string( p->forwarded );
+    qs.capacity = p->queueStats.capacity;
+    qs.high_water = std::max( qs.high_water, p->queueStats.high_water );
+    qs.queued += p->queueStats.queued;
+    qs.dropped_newest += p->queueStats.dropped_newest;
+    qs.dropped_oldest += p->queueStats.dropped_oldest;
+    qs.blocked += p->queueStats.blocked;
+    if ( p->tpacket )
+    {
+      Loopback::TpacketV3Source::Stats s = p->tpacket->stats();
+      ts.packets += s.packets;
+      ts.drops += s.drops;
+      ts.freezes += s.freezes;
+    }
+    if ( p->writer )
+    {
+      if ( !p->writer->close() )
+        std::cerr << "Egress write error: " << p->writer->error() << std::endl;
+      Loopback::UringPcapWriter::Stats s = p->writer->stats();
+      ws.packets += s.packets;
+      ws.bytes += s.bytes;
+      ws.writes += s.writes;
+      ws.stalls += s.stalls;
+      latencySumUs += s.latency_avg_us * s.writes;
+      ws.latency_max_us = std::max( ws.latency_max_us, s.latency_max_us );
+      ws.bytes_per_sec += s.bytes_per_sec;
+    }
+    if ( p->sender )
+    {
+      p->sender->flush();
+      const Loopback::PacketSender::Stats &s = p->sender->stats();
+      ss.packets += s.packets;
+      ss.bytes += s.bytes;
+      ss.batches += s.batches;
+      ss.partial_batches += s.partial_batches;
+      ss.failed += s.failed;
+      ss.oversize += s.oversize;
+      if ( s.last_errno ) ss.last_errno = s.last_errno;
+    }
+  }
+  if ( ws.writes ) ws.latency_avg_us = latencySumUs / ws.writes;
+
+  const Pipeline &first = *pipelines.front();
+  if ( workers > 1 )
+  {
+    std::cout << "Workers: " << workers << " fanout=" << fanoutType << " forwarded=" << forwarded
+              << " per_worker=" << perWorker.substr( 1 ) << std::endl;
+  }
+  std::cout << "Queue: type=" << queueOpts.type << " capacity=" << qs.capacity
+            << " overflow=" << Loopback::to_string( queueOpts.overflow )
+            << " high_water=" << qs.high_water << " queued=" << qs.queued
+            << " dropped_newest=" << qs.dropped_newest << " dropped_oldest=" << qs.dropped_oldest
+            << " blocked=" << qs.blocked << std::endl;
+  if ( meter )
+  {
+    for ( size_t i = 0; i < meter->loops().size(); ++i )
+    {
+      const Loopback::ReplayMeter::Loop &loop = meter->loops()[i];
+      std::cout << "Loop " << i + 1 << ": seconds=" << loop.seconds << " pps=" << loop.pps
+                << " Gbps=" << loop.gbps << std::endl;
+    }
+    Loopback::ReplayMeter::Loop total = meter->total();
+    std::cout << "Sustained: seconds=" << total.seconds << " pps=" << total.pps
+              << " Gbps=" << total.gbps << std::endl;
+  }
+  if ( pacer )
+  {
+    Loopback::Pacer::Stats ps = pacer->stats();
+    std::cout << "Replay pacing: packets=" << ps.packets << " target_pps=" << ps.target_pps
+              << " achieved_pps=" << ps.achieved_pps << " target_mbps=" << ps.target_mbps
+              << " achieved_mbps=" << ps.achieved_mbps << " error_ns p50<=" << ps.error_p50_ns
+              << " p99<=" << ps.error_p99_ns << " p99.9<=" << ps.error_p999_ns
+              << " max=" << ps.error_max_ns << " late=" << ps.late << std::endl;
+  }
+  if ( first.tpacket )
+  {
+    std::cout << "Ingress tpacket: packets=" << ts.packets << " drops=" << ts.drops
+              << " freezes=" << ts.freezes << std::endl;
+  }
+  if ( first.writer )
+  {
+    std::cout << "Egress writer: packets=" << ws.packets << " bytes=" << ws.bytes
+              << " writes=" << ws.writes << " stalls=" << ws.stalls
+              << " latency_avg_us=" << ws.latency_avg_us << " latency_max_us=" << ws.latency_max_us
+              << " MB/s=" << ws.bytes_per_sec / 1e6 << std::endl;
+  }
+  if ( first.sender )
+  {
+    std::cout << "Egress sender: packets=" << ss.packets << " bytes=" << ss.bytes
+              << " batches=" << ss.batches << " partial_batches=" << ss.partial_batches
+              << " failed=" << ss.failed << " oversize=" << ss.oversize;
+    if ( ss.last_errno ) std::cout << " last_error=\"" << std::strerror( ss.last_errno ) << "\"";
+    std::cout << std::endl;
+  }
+  pipelines.clear();
 
   std::cout << "Loopback completed." << std::endl;
   return 0;
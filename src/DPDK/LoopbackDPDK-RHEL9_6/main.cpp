@@ -1,41 +1,38 @@
+#include <Logging/EventLog.hpp>
+#include <Loopback/BoundedQueue.hpp>
+#include <Loopback/PacketPipeline.hpp>
+#include <rte_cycles.h>
 #include <rte_eal.h>
+#include <rte_errno.h>
 #include <rte_ethdev.h>
+#include <rte_launch.h>
+#include <rte_lcore.h>
 #include <rte_mbuf.h>
+#include <rte_pause.h>
+#include <rte_malloc.h>
+#include <rte_ring.h>
 
-#include <condition_variable>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
-#include <mutex>
-#include <queue>
-#include <thread>
+#include <limits>
+#include <string>
 
 constexpr uint16_t NB_MBUF = 8192;
 constexpr uint16_t BURST_SIZE = 32;
+constexpr uint16_t MIN_TX_BURST = 4;   // the TX buffer's flush threshold adapts within these
+constexpr uint16_t MAX_TX_BURST = 128;
+constexpr int TX_RETRIES = 4;          // extra rte_eth_tx_burst() calls before unsent mbufs drop
+constexpr unsigned DRAIN_US = 100;     // longest a packet waits in the TX buffer
 
-// Thread-safe queue
-class PacketQueue
-{
-public:
-  void push( struct rte_mbuf *pkt )
-  {
-    std::unique_lock<std::mutex> lock( mutex_ );
-    queue_.push( pkt );
-    cv_.notify_one();
-  }
+constexpr size_t QUEUE_DEPTH = 4096; // below NB_MBUF so the RX rings can still be refilled
 
-  struct rte_mbuf *pop()
-  {
-    std::unique_lock<std::mutex> lock( mutex_ );
-    cv_.wait( lock, [this] { return !queue_.empty(); } );
-    struct rte_mbuf *pkt = queue_.front();
-    queue_.pop();
-    return pkt;
-  }
+// Cleared by SIGINT/SIGTERM so both lcores wind down and the queue stats get printed
+static std::atomic<bool> running{ true };
 
-private:
-  std::queue<struct rte_mbuf *> queue_;
-  std::mutex mutex_;
-  std::condition_variable cv_;
-};
+static void on_signal( int ) { running = false; }
 
 // Initialize a port
 bool init_port( uint16_t port_id, struct rte_mempool *mbuf_pool )
@@ -55,45 +52,338 @@ bool init_port( uint16_t port_id, struct rte_mempool *mbuf_pool )
   return rte_eth_dev_start( port_id ) == 0;
 }
 
-// Ingress thread
-void ingress_thread( uint16_t port_id, PacketQueue &queue )
+// Ingress: one RX burst per receive(), until SIGINT/SIGTERM
+struct RxBurstSource
 {
-  struct rte_mbuf *bufs[BURST_SIZE];
+  using Item = struct rte_mbuf *;
+
+  uint16_t port_id;
 
-  while ( true )
+  size_t receive( struct rte_mbuf **bufs, size_t max )
+  {
+    return rte_eth_rx_burst( port_id, 0, bufs, static_cast<uint16_t>( max ) );
+  }
+
+  bool done() const { return !running; }
+
+  // Dropped by the queue: the newest mbuf or, with drop-oldest, the evicted one
+  void reject( struct rte_mbuf *buf ) { rte_pktmbuf_free( buf ); }
+};
+
+//! @brief SPSC rte_ring between the ingress and egress lcores, as a PacketPipeline batch queue.
+//
+// A whole RX burst goes in with one rte_ring_sp_enqueue_burst() and comes out with one
+// rte_ring_sc_dequeue_burst(): no lock and no wakeup per packet. Both sides spin, as lcores do.
+// With OverflowPolicy::Block ingress retries until egress makes room; with DropNewest whatever
+// does not fit is handed back to the pipeline, which frees it. Only the producer may drop, so
+// DropOldest is not supported.
+//
+class PacketRing
+{
+public:
+  PacketRing( unsigned capacity, int socket_id, Loopback::OverflowPolicy overflow )
+      : m_ring( rte_ring_create( "loopback_ring",
+                                 capacity,
+                                 socket_id,
+                                 RING_F_SP_ENQ | RING_F_SC_DEQ | RING_F_EXACT_SZ ) ),
+        m_overflow( overflow )
   {
-    uint16_t nb_rx = rte_eth_rx_burst( port_id, 0, bufs, BURST_SIZE );
-    for ( uint16_t i = 0; i < nb_rx; ++i )
+  }
+
+  ~PacketRing() { rte_ring_free( m_ring ); }
+
+  PacketRing( const PacketRing & ) = delete;
+  PacketRing &operator=( const PacketRing & ) = delete;
+
+  explicit operator bool() const { return m_ring != nullptr; }
+
+  // Ingress: returns the number not queued, which are the last ones of the batch
+  size_t push_bulk( struct rte_mbuf **bufs, size_t n )
+  {
+    unsigned free_space = 0;
+    size_t done = enqueue( bufs, n, free_space );
+    if ( done < n && m_overflow == Loopback::OverflowPolicy::Block )
     {
-      queue.push( bufs[i] );
+      ++m_stats.blocked;
+      while ( done < n && !m_stopped.load( std::memory_order_relaxed ) )
+      {
+        rte_pause();
+        done += enqueue( bufs + done, n - done, free_space );
+      }
+    }
+
+    m_stats.queued += done;
+    m_stats.dropped_newest += n - done;
+    m_stats.high_water = std::max<size_t>( m_stats.high_water, capacity() - free_space );
+    return n - done;
+  }
+
+  size_t try_pop_bulk( struct rte_mbuf **out, size_t max )
+  {
+    return rte_ring_sc_dequeue_burst(
+        m_ring, reinterpret_cast<void **>( out ), static_cast<unsigned>( max ), nullptr );
+  }
+
+  // Egress: spins for at least one mbuf. Returns 0 once stopped and drained.
+  size_t pop_bulk( struct rte_mbuf **out, size_t max )
+  {
+    while ( true )
+    {
+      size_t n = try_pop_bulk( out, max );
+      if ( n ) return n;
+      // pick up anything enqueued between the failed pop and the stop
+      if ( m_stopped.load( std::memory_order_acquire ) ) return try_pop_bulk( out, max );
+      rte_pause();
     }
   }
-}
 
-// Egress thread
-void egress_thread( uint16_t port_id, PacketQueue &queue )
+  void stop() { m_stopped.store( true, std::memory_order_release ); }
+  bool stopped() const { return m_stopped.load( std::memory_order_acquire ); }
+  bool empty() const { return rte_ring_empty( m_ring ); }
+
+  size_t capacity() const { return rte_ring_get_capacity( m_ring ); }
+
+  // Written by ingress only; read once both lcores have finished
+  Loopback::QueueStats stats() const
+  {
+    Loopback::QueueStats stats = m_stats;
+    stats.capacity = capacity();
+    return stats;
+  }
+
+private:
+  size_t enqueue( struct rte_mbuf **bufs, size_t n, unsigned &free_space )
+  {
+    return rte_ring_sp_enqueue_burst(
+        m_ring, reinterpret_cast<void **>( bufs ), static_cast<unsigned>( n ), &free_space );
+  }
+
+  struct rte_ring *m_ring;
+  const Loopback::OverflowPolicy m_overflow;
+  std::atomic<bool> m_stopped{ false };
+  Loopback::QueueStats m_stats;
+};
+
+//! @brief Egress through an rte_eth_tx_buffer that is drained by size or by a TSC deadline.
+//
+// Packets are buffered until the buffer holds a full TX burst, or until the first of them has
+// waited `drain_us`. The burst size adapts: a buffer that fills before its deadline doubles it,
+// up to MAX_TX_BURST, for throughput under load; a buffer drained by the deadline halves it, down
+// to MIN_TX_BURST, so a trickle goes out in small bursts and its latency stays bounded. When the
+// ring runs empty egress keeps buffering for the rest of the deadline in case more arrives.
+//
+// Whatever the NIC does not take is retried TX_RETRIES times from the buffer's error callback,
+// then freed; both are counted.
+//
+class TxBufferSink
 {
-  struct rte_mbuf *bufs[BURST_SIZE];
+public:
+  struct Stats
+  {
+    uint64_t sent = 0;        // on the first rte_eth_tx_burst()
+    uint64_t retried = 0;     // on a retry
+    uint64_t dropped = 0;     // freed after TX_RETRIES retries
+    uint64_t full_drains = 0; // buffer flushed because it held a whole burst
+    uint64_t deadline_drains = 0;
+    uint16_t burst = 0;       // flush threshold at exit
+  };
+
+  TxBufferSink( uint16_t port_id, const PacketRing &ring, unsigned drain_us )
+      : m_port_id( port_id ),
+        m_ring( ring ),
+        m_drain_tsc( ( rte_get_tsc_hz() + US_PER_S - 1 ) / US_PER_S * drain_us ),
+        m_buffer( static_cast<struct rte_eth_dev_tx_buffer *>(
+            rte_zmalloc_socket( "tx_buffer",
+                                RTE_ETH_TX_BUFFER_SIZE( MAX_TX_BURST ),
+                                0,
+                                rte_eth_dev_socket_id( port_id ) ) ) )
+  {
+    if ( !m_buffer ) return;
+    rte_eth_tx_buffer_init( m_buffer, BURST_SIZE );
+    rte_eth_tx_buffer_set_err_callback( m_buffer, on_unsent, this );
+  }
 
-  while ( true )
+  ~TxBufferSink() { rte_free( m_buffer ); }
+
+  TxBufferSink( const TxBufferSink & ) = delete;
+  TxBufferSink &operator=( const TxBufferSink & ) = delete;
+
+  explicit operator bool() const { return m_buffer != nullptr; }
+
+  void send( struct rte_mbuf **bufs, size_t n )
+  {
+    for ( size_t i = 0; i < n; ++i )
+    {
+      if ( m_buffer->length == 0 ) m_deadline = rte_rdtsc() + m_drain_tsc;
+      const bool fills = m_buffer->length + 1u >= m_buffer->size;
+      m_stats.sent += rte_eth_tx_buffer( m_port_id, 0, m_buffer, bufs[i] );
+      if ( fills )
+      {
+        ++m_stats.full_drains;
+        m_buffer->size = std::min<uint16_t>( m_buffer->size * 2, MAX_TX_BURST );
+      }
+    }
+    if ( m_buffer->length && rte_rdtsc() >= m_deadline ) drain_on_deadline();
+  }
+
+  // The ring is empty: wait for more until the deadline, or until ingress stops
+  void flush()
   {
-    for ( uint16_t i = 0; i < BURST_SIZE; ++i )
-      bufs[i] = queue.pop();
+    while ( m_buffer->length && m_ring.empty() )
+    {
+      if ( m_ring.stopped() || rte_rdtsc() >= m_deadline )
+      {
+        drain_on_deadline();
+        return;
+      }
+      rte_pause();
+    }
+  }
+
+  void close() { m_stats.sent += rte_eth_tx_buffer_flush( m_port_id, 0, m_buffer ); }
 
-    uint16_t nb_tx = rte_eth_tx_burst( port_id, 0, bufs, BURST_SIZE );
+  Stats stats() const
+  {
+    Stats stats = m_stats;
+    stats.burst = m_buffer->size;
+    return stats;
+  }
 
-    for ( uint16_t i = nb_tx; i < BURST_SIZE; ++i )
-      rte_pktmbuf_free( bufs[i] );
+private:
+  void drain_on_deadline()
+  {
+    ++m_stats.deadline_drains;
+    m_stats.sent += rte_eth_tx_buffer_flush( m_port_id, 0, m_buffer );
+    m_buffer->size = std::max<uint16_t>( m_buffer->size / 2, MIN_TX_BURST );
   }
+
+  // rte_eth_tx_buffer error callback: the mbufs of a flushed burst the NIC did not take
+  static void on_unsent( struct rte_mbuf **unsent, uint16_t count, void *userdata )
+  {
+    TxBufferSink &sink = *static_cast<TxBufferSink *>( userdata );
+    uint16_t sent = 0;
+    for ( int retry = 0; retry < TX_RETRIES && sent < count; ++retry )
+      sent += rte_eth_tx_burst( sink.m_port_id, 0, unsent + sent, count - sent );
+
+    sink.m_stats.retried += sent;
+    sink.m_stats.dropped += count - sent;
+    if ( sent < count ) EVENTLOG( "egress tx dropped={} of {} after retries", count - sent, count );
+    for ( uint16_t i = sent; i < count; ++i )
+      rte_pktmbuf_free( unsent[i] );
+  }
+
+  const uint16_t m_port_id;
+  const PacketRing &m_ring;
+  const uint64_t m_drain_tsc;
+  struct rte_eth_dev_tx_buffer *m_buffer;
+  uint64_t m_deadline = 0;
+  Stats m_stats;
+};
+
+// Event trace of the queue's decisions (see LOOPBACK_EVENT_LOG)
+struct TraceProbe : Loopback::NullProbe
+{
+  void received( struct rte_mbuf **bufs, size_t n )
+  {
+    for ( size_t i = 0; i < n; ++i )
+      EVENTLOG( "ingress rx len={}", rte_pktmbuf_pkt_len( bufs[i] ) );
+  }
+
+  // Runs before RxBurstSource::reject() frees the mbuf, so its length is still valid
+  void dropped( struct rte_mbuf *buf )
+  {
+    EVENTLOG( "ingress drop len={}", rte_pktmbuf_pkt_len( buf ) );
+  }
+};
+
+using Pipeline = Loopback::PacketPipeline<RxBurstSource, PacketRing, TxBufferSink, TraceProbe>;
+
+// lcore entry points for rte_eal_remote_launch()
+static int ingress_lcore( void *pipeline )
+{
+  static_cast<Pipeline *>( pipeline )->ingress();
+  return 0;
+}
+
+static int egress_lcore( void *pipeline )
+{
+  static_cast<Pipeline *>( pipeline )->egress();
+  return 0;
 }
 
 int main( int argc, char *argv[] )
 {
-  if ( rte_eal_init( argc, argv ) < 0 )
+  const char *prog = argv[0];
+  const char *usage = " [EAL options] -- [queue-depth] [block|drop-newest] [drain-us]";
+  int eal_args = rte_eal_init( argc, argv );
+  if ( eal_args < 0 )
   {
     std::cerr << "Failed to init EAL" << std::endl;
     return 1;
   }
+  argc -= eal_args;
+  argv += eal_args;
+
+  // Application arguments follow the EAL ones: -- [queue-depth] [block|drop-newest] [drain-us]
+  // EAL is up from here on, so argument errors release it before returning
+  size_t queue_depth = QUEUE_DEPTH;
+  try
+  {
+    if ( argc > 1 ) queue_depth = std::stoul( argv[1] );
+  }
+  catch ( const std::exception & )
+  {
+    queue_depth = 0;
+  }
+  if ( queue_depth == 0 ) // rte_ring_create() cannot make an empty ring
+  {
+    std::cerr << "Invalid queue depth: " << argv[1] << std::endl;
+    std::cerr << "Usage: " << prog << usage << std::endl;
+    rte_eal_cleanup();
+    return 1;
+  }
+  Loopback::OverflowPolicy overflow = Loopback::OverflowPolicy::Block;
+  if ( argc > 2 && !Loopback::parse_overflow_policy( argv[2], overflow ) )
+  {
+    std::cerr << "Unknown overflow policy: " << argv[2] << std::endl;
+    std::cerr << "Usage: " << prog << usage << std::endl;
+    rte_eal_cleanup();
+    return 1;
+  }
+  unsigned long drain_arg = DRAIN_US;
+  try
+  {
+    if ( argc > 3 ) drain_arg = std::stoul( argv[3] );
+  }
+  catch ( const std::exception & )
+  {
+    drain_arg = std::numeric_limits<unsigned long>::max();
+  }
+  if ( drain_arg > std::numeric_limits<unsigned>::max() )
+  {
+    std::cerr << "Invalid drain-us: " << argv[3] << std::endl;
+    std::cerr << "Usage: " << prog << usage << std::endl;
+    rte_eal_cleanup();
+    return 1;
+  }
+  unsigned drain_us = static_cast<unsigned>( drain_arg );
+  if ( overflow == Loopback::OverflowPolicy::DropOldest )
+  {
+    std::cerr << "drop-oldest is not supported by the SPSC ring, use block or drop-newest"
+              << std::endl;
+    rte_eal_cleanup();
+    return 1;
+  }
+
+  // Ingress and egress each run on an EAL worker lcore (e.g. -l 0-2). With a single worker,
+  // egress runs on the main lcore.
+  unsigned rx_lcore = rte_get_next_lcore( -1, 1, 0 );
+  if ( rx_lcore >= RTE_MAX_LCORE )
+  {
+    std::cerr << "Needs at least two lcores, e.g. -l 0-1" << std::endl;
+    return 1;
+  }
+  unsigned tx_lcore = rte_get_next_lcore( rx_lcore, 1, 0 );
 
   struct rte_mempool *mbuf_pool = rte_pktmbuf_pool_create(
       "MBUF_POOL", NB_MBUF, 0, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id() );
@@ -112,13 +402,64 @@ int main( int argc, char *argv[] )
     return 1;
   }
 
-  PacketQueue queue;
+  std::signal( SIGINT, on_signal );
+  std::signal( SIGTERM, on_signal );
+
+  // Optional binary event trace, rendered offline by EventLogDecoder
+  if ( const char *event_log = std::getenv( "LOOPBACK_EVENT_LOG" ) )
+  {
+    try
+    {
+      Logging::EventLog::start( event_log );
+    }
+    catch ( const std::exception &ex )
+    {
+      std::cerr << "Cannot open event log: " << ex.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // On the ingress port's NUMA node, where the mbufs it carries are received
+  const int ring_socket = rte_eth_dev_socket_id( ingress_port );
+  PacketRing queue( static_cast<unsigned>( queue_depth ), ring_socket, overflow );
+  if ( !queue )
+  {
+    std::cerr << "Failed to create ring: " << rte_strerror( rte_errno ) << std::endl;
+    return 1;
+  }
+
+  RxBurstSource source{ ingress_port };
+  TxBufferSink sink( egress_port, queue, drain_us );
+  if ( !sink )
+  {
+    std::cerr << "Failed to allocate TX buffer" << std::endl;
+    return 1;
+  }
+  Pipeline pipeline( source, queue, sink, BURST_SIZE );
+
+  std::cout << "Ingress on lcore " << rx_lcore << ", egress on lcore "
+            << ( tx_lcore < RTE_MAX_LCORE ? tx_lcore : rte_lcore_id() ) << ", ring on socket "
+            << ring_socket << std::endl;
+
+  rte_eal_remote_launch( ingress_lcore, &pipeline, rx_lcore );
+  if ( tx_lcore < RTE_MAX_LCORE )
+    rte_eal_remote_launch( egress_lcore, &pipeline, tx_lcore );
+  else
+    egress_lcore( &pipeline );
+  rte_eal_mp_wait_lcore();
+  Logging::EventLog::stop();
 
-  std::thread ingress( ingress_thread, ingress_port, std::ref( queue ) );
-  std::thread egress( egress_thread, egress_port, std::ref( queue ) );
+  Loopback::QueueStats qs = queue.stats();
+  std::cout << "Queue: capacity=" << qs.capacity << " overflow=" << Loopback::to_string( overflow )
+            << " high_water=" << qs.high_water << " queued=" << qs.queued
+            << " dropped_newest=" << qs.dropped_newest << " dropped_oldest=" << qs.dropped_oldest
+            << " blocked=" << qs.blocked << std::endl;
 
-  ingress.join();
-  egress.join();
+  TxBufferSink::Stats ts = sink.stats();
+  std::cout << "TX: sent=" << ts.sent << " retried=" << ts.retried << " dropped=" << ts.dropped
+            << " full_drains=" << ts.full_drains << " deadline_drains=" << ts.deadline_drains
+            << " burst=" << ts.burst << " drain_us=" << drain_us << std::endl;
 
+  rte_eal_cleanup();
   return 0;
 }
@@ -0,0 +1,227 @@
+#include <Logging/EventLog.hpp>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Renders a binary Logging::EventLog file as text, one event per line, ordered by timestamp:
+//
+//   +<seconds since start> t<thread> <file>:<line> <formatted message>
+
+struct Format
+{
+  std::string file;
+  uint32_t line = 0;
+  std::string fmt;
+  std::string types;
+};
+
+struct Event
+{
+  uint64_t tsc;
+  uint32_t thread;
+  uint16_t id;
+  std::vector<uint64_t> args;
+};
+
+class Reader
+{
+public:
+  explicit Reader( std::istream &in )
+      : m_in( in )
+  {
+  }
+
+  template <typename T> bool get( T &value )
+  {
+    return static_cast<bool>( m_in.read( reinterpret_cast<char *>( &value ), sizeof( value ) ) );
+  }
+
+  bool get( std::string &value, uint32_t len )
+  {
+    value.resize( len );
+    return static_cast<bool>( m_in.read( &value[0], len ) );
+  }
+
+private:
+  std::istream &m_in;
+};
+
+static std::string render( const Format &f, const std::vector<uint64_t> &args )
+{
+  std::string out;
+  std::size_t arg = 0;
+  char buf[32];
+  for ( std::size_t i = 0; i < f.fmt.size(); ++i )
+  {
+    if ( f.fmt.compare( i, 2, "{}" ) != 0 || arg >= args.size() )
+    {
+      out += f.fmt[i];
+      continue;
+    }
+    uint64_t w = args[arg];
+    switch ( f.types[arg++] )
+    {
+    case 'i':
+      std::snprintf( buf, sizeof( buf ), "%" PRId64, static_cast<int64_t>( w ) );
+      break;
+    case 'f':
+    {
+      double d;
+      std::memcpy( &d, &w, sizeof( d ) );
+      std::snprintf( buf, sizeof( buf ), "%g", d );
+      break;
+    }
+    case 'p':
+      std::snprintf( buf, sizeof( buf ), "0x%" PRIx64, w );
+      break;
+    default:
+      std::snprintf( buf, sizeof( buf ), "%" PRIu64, w );
+    }
+    out += buf;
+    ++i;
+  }
+  return out;
+}
+
+int main( int argc, char **argv )
+{
+  if ( argc != 2 )
+  {
+    std::cerr << "Usage: " << argv[0] << " <file.evlog>\n";
+    return 1;
+  }
+  std::ifstream in( argv[1], std::ios::binary );
+  char magic[sizeof( Logging::EventLogFormat::MAGIC )];
+  if ( !in.read( magic, sizeof( magic ) ) ||
+       std::memcmp( magic, Logging::EventLogFormat::MAGIC, sizeof( magic ) ) != 0 )
+  {
+    std::cerr << argv[1] << ": not an event log\n";
+    return 1;
+  }
+
+  Reader r( in );
+  std::map<uint16_t, Format> formats;
+  std::vector<Event> events;
+  std::map<uint32_t, uint64_t> dropped;
+  uint64_t first_tsc = 0, first_ns = 0, last_tsc = 0, last_ns = 0;
+  bool have_clock = false, truncated = false;
+
+  char type;
+  while ( in.get( type ) )
+  {
+    if ( type == 'F' )
+    {
+      uint16_t id, nargs;
+      uint32_t line, file_len, fmt_len;
+      Format f;
+      if ( !r.get( id ) || !r.get( nargs ) || !r.get( line ) || !r.get( file_len ) ||
+           !r.get( fmt_len ) || !r.get( f.file, file_len ) || !r.get( f.fmt, fmt_len ) ||
+           !r.get( f.types, nargs ) )
+      {
+        truncated = true;
+        break;
+      }
+      f.line = line;
+      formats[id] = std::move( f );
+    }
+    else if ( type == 'C' )
+    {
+      uint32_t thread, len;
+      if ( !r.get( thread ) || !r.get( len ) )
+      {
+        truncated = true;
+        break;
+      }
+      std::vector<uint64_t> words( len / 8 );
+      if ( !in.read( reinterpret_cast<char *>( words.data() ), len ) )
+      {
+        truncated = true;
+        break;
+      }
+      for ( std::size_t i = 0; i + 2 <= words.size(); )
+      {
+        uint16_t id = words[i] & 0xffff;
+        if ( id == Logging::EventLogFormat::PADDING ) break;
+        std::size_t nargs = ( words[i] >> 16 ) & 0xffff;
+        if ( i + 2 + nargs > words.size() ) break;
+        events.push_back( { words[i + 1],
+                            thread,
+                            id,
+                            std::vector<uint64_t>( &words[i + 2], &words[i + 2 + nargs] ) } );
+        i += 2 + nargs;
+      }
+    }
+    else if ( type == 'T' )
+    {
+      uint64_t tsc, ns;
+      if ( !r.get( tsc ) || !r.get( ns ) )
+      {
+        truncated = true;
+        break;
+      }
+      if ( !have_clock )
+      {
+        first_tsc = tsc;
+        first_ns = ns;
+        have_clock = true;
+      }
+      last_tsc = tsc;
+      last_ns = ns;
+    }
+    else if ( type == 'D' )
+    {
+      uint32_t thread;
+      uint64_t n;
+      if ( !r.get( thread ) || !r.get( n ) )
+      {
+        truncated = true;
+        break;
+      }
+      dropped[thread] += n;
+    }
+    else
+    {
+      std::cerr << argv[1] << ": unknown entry '" << type << "' at offset "
+                << static_cast<long long>( in.tellg() ) - 1 << "\n";
+      return 1;
+    }
+  }
+
+  // TSC rate from the first and last clock pairs, 1 tick = 1 ns if the file has only one
+  double ns_per_tick = 1.0;
+  if ( last_tsc > first_tsc ) ns_per_tick = double( last_ns - first_ns ) / ( last_tsc - first_tsc );
+
+  std::stable_sort( events.begin(), events.end(), []( const Event &a, const Event &b ) {
+    return a.tsc < b.tsc;
+  } );
+
+  for ( const Event &e : events )
+  {
+    double secs = ( static_cast<int64_t>( e.tsc - first_tsc ) * ns_per_tick ) / 1e9;
+    std::printf( "+%.9f t%u ", secs, e.thread );
+    auto f = formats.find( e.id );
+    if ( f == formats.end() )
+    {
+      std::printf( "<unknown format %u>\n", e.id );
+      continue;
+    }
+    std::printf( "%s:%u %s\n",
+                 f->second.file.c_str(),
+                 f->second.line,
+                 render( f->second, e.args ).c_str() );
+  }
+
+  for ( const auto &d : dropped )
+  {
+    if ( d.second )
+      std::cerr << "thread " << d.first << ": " << d.second << " events dropped (buffer full)\n";
+  }
+  if ( truncated ) std::cerr << argv[1] << ": truncated, the log was not stopped cleanly\n";
+  return 0;
+}
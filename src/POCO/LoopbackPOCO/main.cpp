@@ -5,134 +5,248 @@
 // You can tail the pcap output file using
 // sudo tcpdump -n -r <file.pcap> -U
 
-#include <Poco/Condition.h>
-#include <Poco/Mutex.h>
-#include <Poco/Runnable.h>
+#include <Logging/BasicLogController.hpp>
+#include <Logging/EventLog.hpp>
+#include <Loopback/BoundedQueue.hpp>
+#include <Loopback/MmapPcapReader.hpp>
+#include <Loopback/PacketSender.hpp>
+#include <Loopback/Pacer.hpp>
+#include <Loopback/PacketArena.hpp>
+#include <Loopback/PacketPipeline.hpp>
+#include <Loopback/PacketPool.hpp>
+#include <Loopback/PcapSinks.hpp>
+#include <Loopback/Telemetry.hpp>
+#include <Loopback/TpacketV3Source.hpp>
+#include <Loopback/UringPcapWriter.hpp>
+#include <Poco/Exception.h>
+#include <Poco/RunnableAdapter.h>
 #include <Poco/Thread.h>
 #include <Poco/Util/Application.h>
 #include <Poco/Util/HelpFormatter.h>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <pcap/pcap.h>
-#include <queue>
 #include <vector>
 
 using namespace Poco::Util;
 
-// Thread-safe packet queue
-class PacketQueue
+// Per-slot header: the pcap record header plus, with --telemetry-ms, when ingress queued it
+struct SlotHeader
 {
-public:
-  void push( const std::vector<u_char> &pkt, const struct pcap_pkthdr &hdr )
-  {
-    Poco::Mutex::ScopedLock lock( _mutex );
-    _queue.push( { hdr, pkt } );
-    _cond.signal();
-  }
+  struct pcap_pkthdr pcap;
+  uint64_t enqueuedNs;
+};
 
-  bool pop( std::vector<u_char> &pkt, struct pcap_pkthdr &hdr )
-  {
-    Poco::Mutex::ScopedLock lock( _mutex );
-    while ( _queue.empty() && _running )
-    {
-      _cond.wait( _mutex );
-    }
-    if ( !_running && _queue.empty() ) return false;
-    auto entry = _queue.front();
-    _queue.pop();
-    hdr = entry.first;
-    pkt = entry.second;
-    return true;
-  }
+// Packet buffers live in the pool, only their handles cross the queue
+using PacketPool = Loopback::PacketPool<SlotHeader>;
 
-  void stop()
-  {
-    Poco::Mutex::ScopedLock lock( _mutex );
-    _running = false;
-    _cond.broadcast();
-  }
+// Bounded queue of pool handles. What a full queue does depends on --overflow: block ingress
+// (backpressure) or drop the newest/oldest packet and hand its slot back to ingress.
+using PacketQueue = Loopback::BoundedQueue<PacketPool::Handle>;
 
-private:
-  std::queue<std::pair<struct pcap_pkthdr, std::vector<u_char>>> _queue;
-  Poco::Mutex _mutex;
-  Poco::Condition _cond;
-  bool _running = true;
-};
+// libpcap handles, the mmap pcap reader, the TPACKET_V3 ring and the preloaded arena share
+// IngressWorker through these overloads
+inline int nextPacket( pcap_t *src, struct pcap_pkthdr **hdr, const u_char **pkt )
+{
+  return pcap_next_ex( src, hdr, pkt );
+}
+
+inline int nextPacket( Loopback::MmapPcapReader *src, struct pcap_pkthdr **hdr, const u_char **pkt )
+{
+  return src->next_ex( hdr, pkt );
+}
+
+inline int
+nextPacket( Loopback::TpacketV3Source *src, struct pcap_pkthdr **hdr, const u_char **pkt )
+{
+  return src->next_ex( hdr, pkt );
+}
+
+inline int nextPacket( Loopback::PacketArena *src, struct pcap_pkthdr **hdr, const u_char **pkt )
+{
+  return src->next_ex( hdr, pkt );
+}
+
+inline const char *sourceError( pcap_t *src ) { return pcap_geterr( src ); }
+inline const char *sourceError( Loopback::MmapPcapReader *src ) { return src->geterr(); }
+inline const char *sourceError( Loopback::TpacketV3Source *src ) { return src->geterr(); }
+inline const char *sourceError( Loopback::PacketArena *src ) { return src->geterr(); }
+
+// Cleared by SIGINT/SIGTERM so both threads wind down and the stats get printed
+static std::atomic<bool> running{ true };
+
+static void on_signal( int ) { running = false; }
+
+// Packets per ingress push and egress send
+constexpr size_t PIPELINE_BATCH = 64;
 
-// Ingress thread: reads from pcap_t (live or file)
-class IngressWorker : public Poco::Runnable
+// Ingress: reads from pcap_t (live or file), the mmap pcap reader, the TPACKET_V3 ring or the
+// preloaded arena into pool slots. Files are read a batch at a time; a live source hands over
+// every packet as soon as it arrives.
+template <typename Source> class PoolSource
 {
 public:
-  IngressWorker( pcap_t *handle, PacketQueue &q )
+  using Item = PacketPool::Handle;
+
+  PoolSource( Source *handle, PacketPool &pool, bool offline )
       : _handle( handle ),
-        _queue( q )
+        _pool( pool ),
+        _batch( offline ? PIPELINE_BATCH : 1 )
   {
+    _spares.reserve( PIPELINE_BATCH );
   }
 
-  void run() override
+  size_t receive( PacketPool::Handle *slots, size_t max )
   {
     const u_char *pkt;
     struct pcap_pkthdr *hdr;
-    while ( true )
+    size_t n = 0;
+    max = std::min( max, _batch );
+    while ( n < max )
     {
-      int ret = pcap_next_ex( _handle, &hdr, &pkt );
-      if ( ret == 1 )
+      int ret = nextPacket( _handle, &hdr, &pkt );
+      if ( ret == 0 ) break; // live read timeout
+      if ( ret == -2 )
+      {
+        _done = true; // EOF (file)
+        break;
+      }
+      if ( ret == -1 )
       {
-        std::vector<u_char> copy( pkt, pkt + hdr->caplen );
-        _queue.push( copy, *hdr );
+        std::cerr << "Ingress error: " << sourceError( _handle ) << std::endl;
+        _done = true;
+        break;
       }
-      else if ( ret == -2 )
+      // the only copy: libpcap's buffer -> pool slot (files may exceed --snaplen, truncate)
+      PacketPool::Handle slot;
+      if ( !_spares.empty() )
       {
-        break; // EOF (file)
+        slot = _spares.back();
+        _spares.pop_back();
       }
-      else if ( ret == -1 )
+      else if ( !_pool.acquire( slot ) )
       {
-        std::cerr << "Ingress error: " << pcap_geterr( _handle ) << std::endl;
+        _done = true;
         break;
       }
+      struct pcap_pkthdr &slotHdr = _pool.header( slot ).pcap;
+      slotHdr = *hdr;
+      slotHdr.caplen = std::min<bpf_u_int32>( hdr->caplen, _pool.slot_size() );
+      std::memcpy( _pool.data( slot ), pkt, slotHdr.caplen );
+      slots[n++] = slot;
     }
-    _queue.stop();
+    return n;
   }
 
+  // Live captures return at least once per read timeout, so a signal ends them
+  bool done() const { return _done || !running; }
+
+  // A dropped packet's slot is kept for the next packet, only egress may release into the pool
+  void reject( PacketPool::Handle slot ) { _spares.push_back( slot ); }
+
 private:
-  pcap_t *_handle;
-  PacketQueue &_queue;
+  Source *_handle;
+  PacketPool &_pool;
+  const size_t _batch;
+  std::vector<PacketPool::Handle> _spares;
+  bool _done = false;
 };
 
-// Egress thread: dequeues and writes out
-class EgressWorker : public Poco::Runnable
+// Egress sinks read the pcap record straight out of the slot and release it once written
+struct SlotAccess
 {
-public:
-  EgressWorker( pcap_t *handle, pcap_dumper_t *dumper, PacketQueue &q )
-      : _handle( handle ),
-        _dumper( dumper ),
-        _queue( q )
+  PacketPool *pool;
+
+  const struct pcap_pkthdr &header( PacketPool::Handle slot ) const
   {
+    return pool->header( slot ).pcap;
   }
+  const u_char *data( PacketPool::Handle slot ) const { return pool->data( slot ); }
+  void done( PacketPool::Handle slot ) const { pool->release( slot ); }
+};
 
-  void run() override
+// Telemetry, tracing and replay accounting, the PacketPipeline probe. The stages are null unless
+// --telemetry-ms is set; each hook runs on one thread only.
+struct Probes
+{
+  PacketPool *pool;
+  Loopback::Telemetry::Stage *ingress; // this thread only
+  Loopback::Telemetry::Stage *egress;
+  const Loopback::Tsc *clock;
+  Loopback::ReplayMeter *meter; // optional: --preload per-loop throughput
+
+  void received( PacketPool::Handle *slots, size_t n )
   {
-    std::vector<u_char> pkt;
-    struct pcap_pkthdr hdr;
-    while ( _queue.pop( pkt, hdr ) )
+    uint64_t now = ingress ? clock->now_ns() : 0, bytes = 0;
+    for ( size_t i = 0; i < n; ++i )
     {
-      if ( _dumper ) { pcap_dump( (u_char *)_dumper, &hdr, pkt.data() ); }
-      else
-      {
-        if ( pcap_sendpacket( _handle, pkt.data(), pkt.size() ) != 0 )
-        {
-          std::cerr << "Egress send error: " << pcap_geterr( _handle ) << std::endl;
-        }
-      }
+      SlotHeader &hdr = pool->header( slots[i] );
+      EVENTLOG( "ingress rx slot={} len={}", slots[i], hdr.pcap.caplen );
+      hdr.enqueuedNs = now;
+      bytes += hdr.pcap.caplen;
     }
+    if ( ingress ) ingress->add_packets( n, bytes );
   }
 
-private:
-  pcap_t *_handle;        // used if live device
-  pcap_dumper_t *_dumper; // used if writing to PCAP file
-  PacketQueue &_queue;
+  // The newest packet with drop-newest, the evicted oldest one with drop-oldest
+  void dropped( PacketPool::Handle slot )
+  {
+    EVENTLOG( "ingress drop slot={} len={}", slot, pool->header( slot ).pcap.caplen );
+    if ( ingress ) ingress->add_drops( 1 );
+  }
+
+  void dequeued( const PacketPool::Handle *slots, size_t n )
+  {
+    if ( meter ) meter->start();
+    if ( !egress ) return;
+    uint64_t now = clock->now_ns(), bytes = 0;
+    for ( size_t i = 0; i < n; ++i )
+    {
+      const SlotHeader &hdr = pool->header( slots[i] );
+      egress->latency.record( now > hdr.enqueuedNs ? now - hdr.enqueuedNs : 0 );
+      bytes += hdr.pcap.caplen;
+    }
+    egress->add_packets( n, bytes );
+  }
+
+  void sent( size_t n )
+  {
+    if ( meter ) meter->add( n );
+  }
 };
 
+// One PacketPipeline instantiation per source and egress sink type, run on two Poco threads
+template <typename Source>
+void runPipeline( Source *handle,
+                  bool offline,
+                  PacketPool &pool,
+                  PacketQueue &queue,
+                  const Loopback::PcapEgress &egress,
+                  const Probes &probes )
+{
+  PoolSource<Source> source( handle, pool, offline );
+  Loopback::with_pcap_sink( egress, SlotAccess{ &pool }, [&]( auto &sink ) {
+    using Sink = std::decay_t<decltype( sink )>;
+    using Pipeline = Loopback::PacketPipeline<PoolSource<Source>, PacketQueue, Sink, Probes>;
+    Pipeline pipeline( source, queue, sink, PIPELINE_BATCH, probes );
+    Poco::RunnableAdapter<Pipeline> ingressWorker( pipeline, &Pipeline::ingress );
+    Poco::RunnableAdapter<Pipeline> egressWorker( pipeline, &Pipeline::egress );
+
+    Poco::Thread t1, t2;
+    t1.start( ingressWorker );
+    t2.start( egressWorker );
+
+    t1.join();
+    t2.join();
+  } );
+}
+
 class LoopbackApp : public Application
 {
 public:
@@ -152,6 +266,107 @@ protected:
         Option( "egress", "e", "egress sink (pcap file or device)" ).argument( "file|dev" ) );
     options.addOption(
         Option( "snaplen", "s", "snapshot length" ).argument( "n" ).required( false ) );
+    options.addOption( Option( "pool-size", "p", "packet buffers in the slab pool (default 4096)" )
+                           .argument( "n" )
+                           .required( false ) );
+    options.addOption(
+        Option( "queue-depth", "q", "packets queued for egress (default 2048, below pool-size)" )
+            .argument( "n" )
+            .required( false ) );
+    options.addOption(
+        Option( "overflow", "", "full queue: block (default), drop-newest or drop-oldest" )
+            .argument( "policy" )
+            .required( false ) );
+    options.addOption(
+        Option( "reader", "r", "pcap file ingress reader: mmap (default) or libpcap" )
+            .argument( "mmap|libpcap" )
+            .required( false ) );
+    options.addOption(
+        Option( "ingress-backend", "", "live device ingress: libpcap (default) or tpacket" )
+            .argument( "libpcap|tpacket" )
+            .required( false ) );
+    options.addOption(
+        Option( "block-size", "", "tpacket: ring block size in bytes (default 1 MiB)" )
+            .argument( "bytes" )
+            .required( false ) );
+    options.addOption( Option( "block-count", "", "tpacket: number of ring blocks (default 64)" )
+                           .argument( "n" )
+                           .required( false ) );
+    options.addOption(
+        Option( "block-timeout-ms", "", "tpacket: block retire timeout in ms (default 10)" )
+            .argument( "ms" )
+            .required( false ) );
+    options.addOption(
+        Option( "writer", "w", "pcap file egress writer: uring (default) or libpcap" )
+            .argument( "uring|libpcap" )
+            .required( false ) );
+    options.addOption(
+        Option( "write-buffer", "", "uring writer: bytes per write buffer (default 4 MiB)" )
+            .argument( "bytes" )
+            .required( false ) );
+    options.addOption( Option( "direct", "", "uring writer: open the egress file with O_DIRECT" )
+                           .required( false ) );
+    options.addOption(
+        Option( "egress-backend", "", "live device egress: sendmmsg (default), txring or libpcap" )
+            .argument( "type" )
+            .required( false ) );
+    options.addOption( Option( "tx-batch", "", "sendmmsg/txring: packets per batch (default 64)" )
+                           .argument( "n" )
+                           .required( false ) );
+    options.addOption(
+        Option( "tx-flush-us", "", "sendmmsg/txring: batch flush deadline in us (default 100)" )
+            .argument( "us" )
+            .required( false ) );
+    options.addOption(
+        Option( "tx-frame-size", "", "sendmmsg/txring: largest packet sent (default 2048)" )
+            .argument( "bytes" )
+            .required( false ) );
+    options.addOption(
+        Option( "tx-ring-frames", "", "txring: frames in the PACKET_TX_RING (default 4096)" )
+            .argument( "n" )
+            .required( false ) );
+    options.addOption(
+        Option( "qdisc-bypass", "", "sendmmsg/txring: bypass the qdisc layer" ).required( false ) );
+    options.addOption(
+        Option( "preload", "", "pcap file ingress: load the whole capture into memory first" )
+            .required( false ) );
+    options.addOption( Option( "loop", "", "preload: replay the capture n times (default 1)" )
+                           .argument( "n" )
+                           .required( false ) );
+    options.addOption( Option( "hugepages", "", "preload: back the capture with 2 MiB hugepages" )
+                           .required( false ) );
+    options.addOption(
+        Option( "replay", "", "pcap file ingress: keep the original inter-packet gaps" )
+            .required( false ) );
+    options.addOption( Option( "speedup", "", "replay: divide the original gaps by this factor" )
+                           .argument( "x" )
+                           .required( false ) );
+    options.addOption( Option( "pps", "", "replay: release this many packets per second" )
+                           .argument( "rate" )
+                           .required( false ) );
+    options.addOption( Option( "mbps", "", "replay: release packets at this many Mbit/s" )
+                           .argument( "rate" )
+                           .required( false ) );
+    options.addOption(
+        Option( "pace-spin-us", "", "replay: busy-wait the last us of every gap (default 100)" )
+            .argument( "us" )
+            .required( false ) );
+    options.addOption(
+        Option( "telemetry-ms", "", "publish per-thread counters and queue latency every n ms" )
+            .argument( "ms" )
+            .required( false ) );
+    options.addOption(
+        Option( "telemetry-log", "", "telemetry: log file (default loopback-telemetry.log)" )
+            .argument( "file" )
+            .required( false ) );
+    options.addOption(
+        Option( "telemetry-json", "", "telemetry: also append the bare JSON lines to this file" )
+            .argument( "file" )
+            .required( false ) );
+    options.addOption(
+        Option( "event-log", "", "trace enqueue/drop/send-failure events to this binary file" )
+            .argument( "file" )
+            .required( false ) );
   }
 
   void handleOption( const std::string &name, const std::string &value ) override
@@ -164,6 +379,101 @@ protected:
       _egress = value;
     else if ( name == "snaplen" )
       _snaplen = std::stoi( value );
+    else if ( name == "pool-size" )
+    {
+      _poolSize = std::stoul( value );
+      if ( _poolSize == 0 ) throw Poco::InvalidArgumentException( "pool-size", value );
+    }
+    else if ( name == "queue-depth" )
+      _queueDepth = std::stoul( value );
+    else if ( name == "overflow" )
+    {
+      if ( !Loopback::parse_overflow_policy( value, _overflow ) )
+        throw Poco::InvalidArgumentException( "overflow", value );
+    }
+    else if ( name == "reader" )
+    {
+      if ( value != "mmap" && value != "libpcap" )
+        throw Poco::InvalidArgumentException( "reader", value );
+      _reader = value;
+    }
+    else if ( name == "ingress-backend" )
+    {
+      if ( value != "libpcap" && value != "tpacket" )
+        throw Poco::InvalidArgumentException( "ingress-backend", value );
+      _backend = value;
+    }
+    else if ( name == "block-size" )
+      _tpacketOpts.block_size = std::stoul( value );
+    else if ( name == "block-count" )
+      _tpacketOpts.block_count = std::stoul( value );
+    else if ( name == "block-timeout-ms" )
+      _tpacketOpts.retire_timeout_ms = std::stoul( value );
+    else if ( name == "writer" )
+    {
+      if ( value != "uring" && value != "libpcap" )
+        throw Poco::InvalidArgumentException( "writer", value );
+      _writer = value;
+    }
+    else if ( name == "write-buffer" )
+      _writerOpts.buffer_size = std::stoul( value );
+    else if ( name == "direct" )
+      _writerOpts.direct = true;
+    else if ( name == "egress-backend" )
+    {
+      if ( value != "sendmmsg" && value != "txring" && value != "libpcap" )
+        throw Poco::InvalidArgumentException( "egress-backend", value );
+      _egressBackend = value;
+    }
+    else if ( name == "tx-batch" )
+    {
+      _senderOpts.batch = std::stoul( value );
+      if ( _senderOpts.batch == 0 ) throw Poco::InvalidArgumentException( "tx-batch", value );
+    }
+    else if ( name == "tx-flush-us" )
+      _senderOpts.flush_deadline = std::chrono::microseconds( std::stoul( value ) );
+    else if ( name == "tx-frame-size" )
+      _senderOpts.frame_size = std::stoul( value );
+    else if ( name == "tx-ring-frames" )
+      _senderOpts.ring_frames = std::stoul( value );
+    else if ( name == "qdisc-bypass" )
+      _senderOpts.qdisc_bypass = true;
+    else if ( name == "preload" )
+      _preload = true;
+    else if ( name == "loop" )
+    {
+      _loops = std::stoul( value );
+      if ( _loops == 0 ) throw Poco::InvalidArgumentException( "loop", value );
+    }
+    else if ( name == "hugepages" )
+      _hugepages = true;
+    else if ( name == "replay" )
+      _replay = true;
+    else if ( name == "speedup" )
+    {
+      _pacerOpts.speedup = std::stod( value );
+      _replay = true;
+    }
+    else if ( name == "pps" )
+    {
+      _pacerOpts.pps = std::stod( value );
+      _replay = true;
+    }
+    else if ( name == "mbps" )
+    {
+      _pacerOpts.mbps = std::stod( value );
+      _replay = true;
+    }
+    else if ( name == "pace-spin-us" )
+      _pacerOpts.spin = std::chrono::microseconds( std::stoul( value ) );
+    else if ( name == "telemetry-ms" )
+      _telemetryMs = std::stoul( value );
+    else if ( name == "telemetry-log" )
+      _telemetryLog = value;
+    else if ( name == "telemetry-json" )
+      _telemetryJson = value;
+    else if ( name == "event-log" )
+      _eventLog = value;
   }
 
   int main( const std::vector<std::string> & ) override
@@ -177,12 +487,78 @@ protected:
       fmt.format( std::cout );
       return EXIT_OK;
     }
+    if ( _replay && !isPcapFile( _ingress ) ) // a live device is already paced by the wire
+    {
+      std::cerr << "--replay needs a pcap file ingress" << std::endl;
+      return EXIT_SOFTWARE;
+    }
+    if ( _loops > 1 && !_preload ) // only the preloaded arena can be replayed again
+    {
+      std::cerr << "--loop needs --preload" << std::endl;
+      return EXIT_SOFTWARE;
+    }
 
     char errbuf[PCAP_ERRBUF_SIZE];
 
     // --- Open ingress ---
     pcap_t *ingress = nullptr;
-    if ( isPcapFile( _ingress ) ) { ingress = pcap_open_offline( _ingress.c_str(), errbuf ); }
+    std::unique_ptr<Loopback::MmapPcapReader> reader;
+    std::unique_ptr<Loopback::TpacketV3Source> tpacket;
+    std::unique_ptr<Loopback::PacketArena> arena;
+    if ( !isPcapFile( _ingress ) && _backend == "tpacket" )
+    {
+      try
+      {
+        tpacket = std::make_unique<Loopback::TpacketV3Source>( _ingress, _tpacketOpts );
+      }
+      catch ( const std::exception &ex )
+      {
+        std::cerr << "Cannot open ingress: " << ex.what() << std::endl;
+        return EXIT_SOFTWARE;
+      }
+      // AF_PACKET delivers Ethernet frames, a dead handle carries linktype/snaplen for the dumper
+      ingress = pcap_open_dead( DLT_EN10MB, _snaplen );
+    }
+    else if ( isPcapFile( _ingress ) && _preload )
+    {
+      try
+      {
+        arena = std::make_unique<Loopback::PacketArena>( _ingress, _loops, _hugepages );
+      }
+      catch ( const std::exception &ex )
+      {
+        std::cerr << "Cannot open ingress: " << ex.what() << std::endl;
+        return EXIT_SOFTWARE;
+      }
+      ingress = pcap_open_dead_with_tstamp_precision(
+          arena->datalink(), arena->snapshot(), arena->precision() );
+      std::cout << "Preloaded: packets=" << arena->packets() << " bytes=" << arena->bytes()
+                << " mapped=" << arena->mapped()
+                << " hugetlb=" << ( arena->hugetlb() ? "yes" : "no" )
+                << " loops=" << arena->loops() << std::endl;
+    }
+    else if ( isPcapFile( _ingress ) && _reader != "libpcap" &&
+              Loopback::MmapPcapReader::is_classic( _ingress ) ) // pcapng goes to libpcap
+    {
+      try
+      {
+        reader = std::make_unique<Loopback::MmapPcapReader>( _ingress );
+        reader->set_precision( reader->file_precision() ); // keep nanoseconds for replay pacing
+      }
+      catch ( const std::exception &ex )
+      {
+        std::cerr << "Cannot open ingress: " << ex.what() << std::endl;
+        return EXIT_SOFTWARE;
+      }
+      // nothing live behind the mapping, a dead handle carries linktype/snaplen/precision for
+      // the dumper
+      ingress = pcap_open_dead_with_tstamp_precision(
+          reader->datalink(), reader->snapshot(), reader->precision() );
+    }
+    else if ( isPcapFile( _ingress ) )
+    {
+      ingress = pcap_open_offline( _ingress.c_str(), errbuf );
+    }
     else { ingress = pcap_open_live( _ingress.c_str(), _snaplen, 1, 1000, errbuf ); }
     if ( !ingress )
     {
@@ -193,7 +569,25 @@ protected:
     // --- Open egress ---
     pcap_dumper_t *dumper = nullptr;
     pcap_t *egressHandle = nullptr;
-    if ( isPcapFile( _egress ) )
+    std::unique_ptr<Loopback::UringPcapWriter> writer;
+    std::unique_ptr<Loopback::PacketSender> sender;
+    const bool nanosecond = pcap_get_tstamp_precision( ingress ) == PCAP_TSTAMP_PRECISION_NANO;
+    if ( isPcapFile( _egress ) && _writer != "libpcap" )
+    {
+      _writerOpts.nanosecond = nanosecond;
+      try
+      {
+        writer = std::make_unique<Loopback::UringPcapWriter>(
+            _egress, pcap_datalink( ingress ), pcap_snapshot( ingress ), _writerOpts );
+      }
+      catch ( const std::exception &ex )
+      {
+        std::cerr << "Cannot open egress pcap: " << ex.what() << std::endl;
+        pcap_close( ingress );
+        return EXIT_SOFTWARE;
+      }
+    }
+    else if ( isPcapFile( _egress ) )
     {
       dumper = pcap_dump_open( ingress, _egress.c_str() ); // reuse linktype
       if ( !dumper )
@@ -203,6 +597,20 @@ protected:
         return EXIT_SOFTWARE;
       }
     }
+    else if ( _egressBackend != "libpcap" )
+    {
+      if ( _egressBackend == "txring" ) _senderOpts.mode = Loopback::PacketSender::Mode::TxRing;
+      try
+      {
+        sender = std::make_unique<Loopback::PacketSender>( _egress, _senderOpts );
+      }
+      catch ( const std::exception &ex )
+      {
+        std::cerr << "Cannot open egress device: " << ex.what() << std::endl;
+        pcap_close( ingress );
+        return EXIT_SOFTWARE;
+      }
+    }
     else
     {
       egressHandle = pcap_open_live( _egress.c_str(), _snaplen, 1, 1000, errbuf );
@@ -214,22 +622,144 @@ protected:
       }
     }
 
-    // --- Start workers ---
-    PacketQueue queue;
-    IngressWorker ingressWorker( ingress, queue );
-    EgressWorker egressWorker( egressHandle, dumper, queue );
+    // --- Replay pacing (pcap ingress only, checked above) ---
+    std::unique_ptr<Loopback::Pacer> pacer;
+    if ( _replay )
+    {
+      _pacerOpts.nanosecond = nanosecond;
+      pacer = std::make_unique<Loopback::Pacer>( _pacerOpts );
+    }
 
-    Poco::Thread t1, t2;
-    t1.start( ingressWorker );
-    t2.start( egressWorker );
+    // --- Per-loop throughput of a preloaded replay ---
+    std::unique_ptr<Loopback::ReplayMeter> meter;
+    if ( arena )
+      meter = std::make_unique<Loopback::ReplayMeter>( arena->packets(), arena->bytes() );
 
-    t1.join();
-    t2.join();
+    // --- Telemetry: one stage per worker thread ---
+    Loopback::Telemetry telemetry;
+    Loopback::Telemetry::Stage *rxStage = nullptr, *txStage = nullptr;
+    std::unique_ptr<Loopback::Tsc> tsc;
+    std::ofstream telemetryJson; // written by the log's thread, so it must outlive the log
+    std::unique_ptr<Logging::BasicLogController> log;
+    std::unique_ptr<Loopback::TelemetryReporter> reporter;
+    if ( _telemetryMs )
+    {
+      tsc = std::make_unique<Loopback::Tsc>();
+      rxStage = &telemetry.stage( "ingress", Loopback::Telemetry::Role::Ingress );
+      txStage = &telemetry.stage( "egress", Loopback::Telemetry::Role::Egress );
+      // async: the reporter thread only enqueues, the file and console writes run on the pool's
+      log = std::make_unique<Logging::BasicLogController>(
+          "telemetry", _telemetryLog, Logging::BasicLogController::Async{} );
+      if ( !_telemetryJson.empty() )
+      {
+        telemetryJson.open( _telemetryJson, std::ios::app );
+        if ( !telemetryJson )
+        {
+          std::cerr << "Cannot open telemetry file: " << _telemetryJson << std::endl;
+          return EXIT_SOFTWARE;
+        }
+        log->set_callback( [&telemetryJson]( const std::string &line ) {
+          telemetryJson << line << std::endl;
+        } );
+      }
+      std::shared_ptr<spdlog::logger> logger = log->logger();
+      reporter = std::make_unique<Loopback::TelemetryReporter>(
+          telemetry,
+          std::chrono::milliseconds( _telemetryMs ),
+          [logger]( const std::string &json ) { SPDLOG_LOGGER_INFO( logger, "{}", json ); } );
+    }
 
+    // --- Binary event trace, decoded offline ---
+    if ( !_eventLog.empty() )
+    {
+      try
+      {
+        Logging::EventLog::start( _eventLog );
+      }
+      catch ( const std::exception &ex )
+      {
+        std::cerr << "Cannot open event log: " << ex.what() << std::endl;
+        return EXIT_SOFTWARE;
+      }
+    }
+
+    std::signal( SIGINT, on_signal );
+    std::signal( SIGTERM, on_signal );
+
+    // --- Start workers ---
+    PacketPool pool( _poolSize, _snaplen );
+    PacketQueue queue( _queueDepth, _overflow );
+    Probes probes{ &pool, rxStage, txStage, tsc.get(), meter.get() };
+    Loopback::PcapEgress egress{
+        egressHandle, dumper, writer.get(), sender.get(), pacer.get(), txStage };
+    const bool offline = isPcapFile( _ingress );
+    if ( reader ) { runPipeline( reader.get(), offline, pool, queue, egress, probes ); }
+    else if ( tpacket ) { runPipeline( tpacket.get(), offline, pool, queue, egress, probes ); }
+    else if ( arena ) { runPipeline( arena.get(), offline, pool, queue, egress, probes ); }
+    else { runPipeline( ingress, offline, pool, queue, egress, probes ); }
+    if ( reporter ) reporter->stop(); // publishes the final totals
+    Logging::EventLog::stop();
+
+    if ( writer )
+    {
+      if ( !writer->close() ) std::cerr << "Egress write error: " << writer->error() << std::endl;
+      Loopback::UringPcapWriter::Stats ws = writer->stats();
+      std::cout << "Egress writer: packets=" << ws.packets << " bytes=" << ws.bytes
+                << " writes=" << ws.writes << " stalls=" << ws.stalls
+                << " latency_avg_us=" << ws.latency_avg_us
+                << " latency_max_us=" << ws.latency_max_us << " MB/s=" << ws.bytes_per_sec / 1e6
+                << std::endl;
+    }
+    if ( sender )
+    {
+      const Loopback::PacketSender::Stats &ss = sender->stats();
+      std::cout << "Egress sender: packets=" << ss.packets << " bytes=" << ss.bytes
+                << " batches=" << ss.batches << " partial_batches=" << ss.partial_batches
+                << " failed=" << ss.failed << " oversize=" << ss.oversize;
+      if ( ss.last_errno ) std::cout << " last_error=\"" << std::strerror( ss.last_errno ) << "\"";
+      std::cout << std::endl;
+    }
+    if ( meter )
+    {
+      for ( size_t i = 0; i < meter->loops().size(); ++i )
+      {
+        const Loopback::ReplayMeter::Loop &loop = meter->loops()[i];
+        std::cout << "Loop " << i + 1 << ": seconds=" << loop.seconds << " pps=" << loop.pps
+                  << " Gbps=" << loop.gbps << std::endl;
+      }
+      Loopback::ReplayMeter::Loop total = meter->total();
+      std::cout << "Sustained: seconds=" << total.seconds << " pps=" << total.pps
+                << " Gbps=" << total.gbps << std::endl;
+    }
+    if ( pacer )
+    {
+      Loopback::Pacer::Stats ps = pacer->stats();
+      std::cout << "Replay pacing: packets=" << ps.packets << " target_pps=" << ps.target_pps
+                << " achieved_pps=" << ps.achieved_pps << " target_mbps=" << ps.target_mbps
+                << " achieved_mbps=" << ps.achieved_mbps << " error_ns p50<=" << ps.error_p50_ns
+                << " p99<=" << ps.error_p99_ns << " p99.9<=" << ps.error_p999_ns
+                << " max=" << ps.error_max_ns << " late=" << ps.late << std::endl;
+    }
     if ( dumper ) pcap_dump_close( dumper );
     if ( egressHandle ) pcap_close( egressHandle );
     if ( ingress ) pcap_close( ingress );
 
+    if ( tpacket )
+    {
+      Loopback::TpacketV3Source::Stats ts = tpacket->stats();
+      std::cout << "Ingress tpacket: packets=" << ts.packets << " drops=" << ts.drops
+                << " freezes=" << ts.freezes << std::endl;
+    }
+    Loopback::QueueStats qs = queue.stats();
+    std::cout << "Queue: capacity=" << qs.capacity
+              << " overflow=" << Loopback::to_string( queue.policy() )
+              << " high_water=" << qs.high_water << " queued=" << qs.queued
+              << " dropped_newest=" << qs.dropped_newest << " dropped_oldest=" << qs.dropped_oldest
+              << " blocked=" << qs.blocked << std::endl;
+    PacketPool::Stats poolStats = pool.stats();
+    std::cout << "Packet pool: slots=" << poolStats.slots << " slot_size=" << pool.slot_size()
+              << " high_water=" << poolStats.high_water << " exhausted=" << poolStats.exhausted
+              << std::endl;
     std::cout << "Loopback finished." << std::endl;
     return EXIT_OK;
   }
@@ -239,6 +769,25 @@ private:
   std::string _ingress;
   std::string _egress;
   int _snaplen = 65535;
+  uint32_t _poolSize = 4096;
+  uint32_t _queueDepth = 2048;
+  Loopback::OverflowPolicy _overflow = Loopback::OverflowPolicy::Block;
+  std::string _reader = "mmap";
+  std::string _writer = "uring";
+  std::string _backend = "libpcap";
+  Loopback::TpacketV3Source::Options _tpacketOpts;
+  Loopback::UringPcapWriter::Options _writerOpts;
+  std::string _egressBackend = "sendmmsg";
+  Loopback::PacketSender::Options _senderOpts;
+  bool _preload = false;
+  uint32_t _loops = 1;
+  bool _hugepages = false;
+  bool _replay = false;
+  Loopback::Pacer::Options _pacerOpts;
+  uint32_t _telemetryMs = 0;
+  std::string _telemetryLog = "loopback-telemetry.log";
+  std::string _telemetryJson;
+  std::string _eventLog; // binary trace, rendered by EventLogDecoder
 
   bool isPcapFile( const std::string &s ) { return s.find( ".pcap" ) != std::string::npos; }
 };